@@ -18,6 +18,21 @@
 #define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
 #include <np_opencv_converter.hpp>
 
+/// COMPONENT
+#include "python_array_view.h"
+#include "python_cloud_columns.h"
+#include "python_cloud_filters.h"
+#include "python_cloud_index.h"
+#include "python_history.h"
+#include "python_input_arrays.h"
+#include "python_native.h"
+#include "python_parameters.h"
+#include "python_parallel.h"
+#include "python_result_cache.h"
+#include "python_shared_array.h"
+#include "python_signals.h"
+#include "python_vision.h"
+
 /// SYSTEM
 #include <boost/python.hpp>
 #include <pcl/PCLPointField.h>
@@ -63,14 +78,65 @@ namespace  {
  * CORE
  */
 
+// ports are reused by label, so that setup can run again when the script is reloaded
+template <typename Port>
+Port* findPort(const std::vector<std::shared_ptr<Port>>& ports, const std::string& label)
+{
+    for(const std::shared_ptr<Port>& port : ports) {
+        if(port->getLabel() == label) {
+            return port.get();
+        }
+    }
+    return nullptr;
+}
+
 Input* addInput(NodeModifier* modifier, const std::string& label, bool optional)
 {
+    if(Input* existing = findPort(modifier->getMessageInputs(), label)) {
+        return existing;
+    }
     return modifier->addInput(makeEmpty<connection_types::AnyMessage>(), label, optional);
 }
 Output* addOutput(NodeModifier* modifier, const std::string& label)
 {
+    if(Output* existing = findPort(modifier->getMessageOutputs(), label)) {
+        return existing;
+    }
     return modifier->addOutput(makeEmpty<connection_types::AnyMessage>(), label);
 }
+Slot* addSlot(NodeModifier* modifier, const std::string& label, const object& handler)
+{
+    PythonSignals* signals = PythonSignals::current();
+    if(!signals) {
+        PyErr_SetString(PyExc_RuntimeError, "slots can only be added from the setup of a python node");
+        throw_error_already_set();
+    }
+    return signals->addSlot(modifier, label, handler);
+}
+Event* addEvent(NodeModifier* modifier, const std::string& label)
+{
+    if(Event* existing = findPort(modifier->getEvents(), label)) {
+        return existing;
+    }
+    return modifier->addEvent(label);
+}
+
+void triggerMany(Event* event, int n)
+{
+    // connected slots never need the GIL of this interpreter
+    ScopedGilRelease nogil;
+    for(int i = 0; i < n; ++i) {
+        event->trigger();
+    }
+}
+void triggerCoalesced(Event* event)
+{
+    if(PythonSignals* signals = PythonSignals::current()) {
+        signals->coalesce(event);
+    } else {
+        event->trigger();
+    }
+}
 
 void registerCore()
 {
@@ -80,6 +146,8 @@ void registerCore()
             ;
     class_<Event, boost::noncopyable>("Event", no_init)
             .def("trigger", &Event::trigger)
+            .def("trigger_many", &triggerMany, args("n"))
+            .def("trigger_coalesced", &triggerCoalesced)
             ;
     class_<Slot, boost::noncopyable>("Slot", no_init)
             ;
@@ -91,9 +159,11 @@ void registerCore()
 
     def("addInput", &addInput, args("label", "optional"), return_value_policy<reference_existing_object>());
     def("addOutput", &addOutput, args("label"), return_value_policy<reference_existing_object>());
+    def("addSlot", &addSlot, args("label", "handler"), return_value_policy<reference_existing_object>());
+    def("addEvent", &addEvent, args("label"), return_value_policy<reference_existing_object>());
 
     def("getMessage", static_cast<TokenDataConstPtr(*)(Input*)>(&msg::getMessage), args("input"));
-    def("publish", static_cast<void(*)(Output*,TokenDataConstPtr)>(&msg::publish), args("output", "message"));
+    def("publish", &PythonResultCache::publish, args("output", "message"));
 
     register_ptr_to_python< std::shared_ptr<Input> >();
     register_ptr_to_python< std::shared_ptr<Output> >();
@@ -125,6 +195,15 @@ Payload getTemplateValue(const Instance& self)
 }
 
 
+template <typename Payload>
+void publishValue(Output* output, Payload value, std::string frame)
+{
+    auto msg = makeEmpty<connection_types::GenericValueMessage<Payload>>();
+    msg->frame_id = frame;
+    msg->value = value;
+    PythonResultCache::publish(output, msg);
+}
+
 template <typename Payload>
 void register_generic_value_message(const std::string& name)
 {
@@ -134,7 +213,7 @@ void register_generic_value_message(const std::string& name)
     implicitly_convertible<std::shared_ptr<connection_types::GenericValueMessage<Payload>>, std::shared_ptr<TokenData> >();
     implicitly_convertible<std::shared_ptr<connection_types::GenericValueMessage<Payload> const>, std::shared_ptr<TokenData const> >();
 
-    def("publish", static_cast<void(*)(Output*, Payload, std::string)>(&msg::publish<Payload>), ( arg("output"), arg("message"), arg("frame")="/") );
+    def("publish", &publishValue<Payload>, ( arg("output"), arg("message"), arg("frame")="/") );
 }
 
 void registerGenericValueMessages()
@@ -166,7 +245,7 @@ void publishCvMat(Output* output, const cv::Mat& cvmat, Encoding enc)
     connection_types::CvMatMessage::Ptr msg = makeEmpty<connection_types::CvMatMessage>();
     msg->value = cvmat;
     msg->setEncoding(enc);
-    msg::publish(output, msg);
+    PythonResultCache::publish(output, msg);
 }
 void registerCsApexVision()
 {
@@ -338,4 +417,24 @@ BOOST_PYTHON_MODULE(libcsapex_python)
     registerCsApexVision();
 
     registerPointCloud();
+
+    registerArrayView();
+
+    registerSharedArray();
+
+    registerInputArrays();
+
+    registerHistory();
+
+    registerParameters();
+
+    registerCloudIndex();
+
+    registerCloudFilters();
+
+    registerCloudColumns();
+
+    registerVision();
+
+    registerNative();
 }
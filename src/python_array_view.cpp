@@ -0,0 +1,105 @@
+/// HEADER
+#include "python_array_view.h"
+
+/// SYSTEM
+#include <opencv2/core/core.hpp>
+#include <cstdint>
+
+using namespace csapex;
+namespace bp = boost::python;
+
+namespace
+{
+const char* byte_order()
+{
+    const std::uint16_t probe = 1;
+    return *reinterpret_cast<const std::uint8_t*>(&probe) == 1 ? "<" : ">";
+}
+}
+
+ArrayView::ArrayView()
+    : data(nullptr), readonly(true)
+{
+}
+
+ArrayView::ArrayView(std::shared_ptr<const void> owner, const void *data,
+                     const std::vector<Py_ssize_t> &shape, const std::string &typestr, bool readonly)
+    : owner(owner), data(data), shape(shape), type(typestr), readonly(readonly)
+{
+}
+
+ArrayView::ArrayView(std::shared_ptr<const void> owner, const void *data,
+                     const std::vector<Py_ssize_t> &shape, const std::vector<Py_ssize_t> &strides,
+                     const std::string &typestr, bool readonly)
+    : owner(owner), data(data), shape(shape), strides(strides), type(typestr), readonly(readonly)
+{
+}
+
+bp::dict ArrayView::arrayInterface() const
+{
+    bp::list shape_list;
+    for(Py_ssize_t s : shape) {
+        shape_list.append(s);
+    }
+
+    bp::dict res;
+    res["version"] = 3;
+    res["typestr"] = type;
+    res["shape"] = bp::tuple(shape_list);
+    res["data"] = bp::make_tuple(reinterpret_cast<std::uintptr_t>(data), readonly);
+    if(!strides.empty()) {
+        bp::list stride_list;
+        for(Py_ssize_t s : strides) {
+            stride_list.append(s);
+        }
+        res["strides"] = bp::tuple(stride_list);
+    }
+    if(!fields.empty()) {
+        bp::list descr;
+        for(const auto& field : fields) {
+            descr.append(bp::make_tuple(field.first, field.second));
+        }
+        res["descr"] = descr;
+    }
+    return res;
+}
+
+bp::object ArrayView::toNumpy() const
+{
+    return bp::import("numpy").attr("asarray")(bp::object(*this));
+}
+
+namespace csapex
+{
+template <> std::string ArrayView::typestr<float>() { return std::string(byte_order()) + "f4"; }
+template <> std::string ArrayView::typestr<double>() { return std::string(byte_order()) + "f8"; }
+template <> std::string ArrayView::typestr<std::int8_t>() { return "|i1"; }
+template <> std::string ArrayView::typestr<std::uint8_t>() { return "|u1"; }
+template <> std::string ArrayView::typestr<std::int16_t>() { return std::string(byte_order()) + "i2"; }
+template <> std::string ArrayView::typestr<std::uint16_t>() { return std::string(byte_order()) + "u2"; }
+template <> std::string ArrayView::typestr<std::int32_t>() { return std::string(byte_order()) + "i4"; }
+template <> std::string ArrayView::typestr<std::uint32_t>() { return std::string(byte_order()) + "u4"; }
+template <> std::string ArrayView::typestr<std::int64_t>() { return std::string(byte_order()) + "i8"; }
+template <> std::string ArrayView::typestr<std::uint64_t>() { return std::string(byte_order()) + "u8"; }
+
+bool ArrayView::depthTypestr(int depth, std::string &res)
+{
+    switch(depth) {
+    case CV_8U: res = typestr<std::uint8_t>(); return true;
+    case CV_8S: res = typestr<std::int8_t>(); return true;
+    case CV_16U: res = typestr<std::uint16_t>(); return true;
+    case CV_16S: res = typestr<std::int16_t>(); return true;
+    case CV_32S: res = typestr<std::int32_t>(); return true;
+    case CV_32F: res = typestr<float>(); return true;
+    case CV_64F: res = typestr<double>(); return true;
+    default: return false;
+    }
+}
+
+void registerArrayView()
+{
+    bp::class_<ArrayView>("ArrayView", bp::no_init)
+            .add_property("__array_interface__", &ArrayView::arrayInterface)
+            ;
+}
+}
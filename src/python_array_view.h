@@ -0,0 +1,80 @@
+#ifndef PYTHON_ARRAY_VIEW_H
+#define PYTHON_ARRAY_VIEW_H
+
+/// SYSTEM
+#include <boost/python.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace csapex
+{
+
+/**
+ * @brief The ArrayView describes memory owned by C++ via the numpy array interface.
+ *        numpy keeps the view as base object, which in turn keeps the owner alive,
+ *        so no data is copied when converting it with numpy.asarray.
+ */
+class ArrayView
+{
+public:
+    ArrayView();
+    ArrayView(std::shared_ptr<const void> owner, const void* data,
+              const std::vector<Py_ssize_t>& shape, const std::string& typestr, bool readonly);
+    ArrayView(std::shared_ptr<const void> owner, const void* data,
+              const std::vector<Py_ssize_t>& shape, const std::vector<Py_ssize_t>& strides,
+              const std::string& typestr, bool readonly);
+
+    boost::python::dict arrayInterface() const;
+
+    //! converts the view to a numpy array, requires the GIL
+    boost::python::object toNumpy() const;
+
+    template <typename T>
+    static std::string typestr();
+
+    //! the typestr of an OpenCV depth, false if numpy has no equivalent
+    static bool depthTypestr(int depth, std::string& typestr);
+
+    //! hands a vector to numpy without copying it, requires the GIL
+    template <typename T>
+    static boost::python::object fromVector(std::shared_ptr<std::vector<T>> values, const std::vector<Py_ssize_t>& shape);
+
+public:
+    std::shared_ptr<const void> owner;
+    const void* data;
+    std::vector<Py_ssize_t> shape;
+    std::vector<Py_ssize_t> strides;
+    std::string type;
+    bool readonly;
+
+    //! name and typestr of each field of a structured element, empty for plain arrays
+    std::vector<std::pair<std::string, std::string>> fields;
+};
+
+template <> std::string ArrayView::typestr<float>();
+template <> std::string ArrayView::typestr<double>();
+template <> std::string ArrayView::typestr<std::int8_t>();
+template <> std::string ArrayView::typestr<std::uint8_t>();
+template <> std::string ArrayView::typestr<std::int16_t>();
+template <> std::string ArrayView::typestr<std::uint16_t>();
+template <> std::string ArrayView::typestr<std::int32_t>();
+template <> std::string ArrayView::typestr<std::uint32_t>();
+template <> std::string ArrayView::typestr<std::int64_t>();
+template <> std::string ArrayView::typestr<std::uint64_t>();
+
+template <typename T>
+boost::python::object ArrayView::fromVector(std::shared_ptr<std::vector<T>> values, const std::vector<Py_ssize_t>& shape)
+{
+    // an empty vector might not have a data pointer, which numpy does not accept
+    values->reserve(1);
+    return ArrayView(values, values->data(), shape, typestr<T>(), false).toNumpy();
+}
+
+void registerArrayView();
+
+}
+
+#endif // PYTHON_ARRAY_VIEW_H
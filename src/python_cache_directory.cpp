@@ -0,0 +1,45 @@
+/// HEADER
+#include "python_cache_directory.h"
+
+/// SYSTEM
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <sys/stat.h>
+
+namespace
+{
+void create_directories(const std::string& path)
+{
+    for(std::size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+        std::string prefix = path.substr(0, pos);
+        if(mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+            throw std::runtime_error("cannot create " + prefix + ": " + std::strerror(errno));
+        }
+        if(pos == std::string::npos) {
+            break;
+        }
+    }
+}
+}
+
+namespace csapex
+{
+std::string cacheDirectory(const std::string &kind, const char *env)
+{
+    std::string dir;
+    if(const char* value = std::getenv(env)) {
+        dir = value;
+    } else if(const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+        dir = std::string(xdg) + "/csapex_python/" + kind;
+    } else if(const char* home = std::getenv("HOME")) {
+        dir = std::string(home) + "/.cache/csapex_python/" + kind;
+    } else {
+        dir = "/tmp/csapex_python/" + kind;
+    }
+
+    create_directories(dir);
+    return dir;
+}
+}
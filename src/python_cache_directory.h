@@ -0,0 +1,19 @@
+#ifndef PYTHON_CACHE_DIRECTORY_H
+#define PYTHON_CACHE_DIRECTORY_H
+
+/// SYSTEM
+#include <string>
+
+namespace csapex
+{
+
+/**
+ * @brief cacheDirectory returns the directory for files of the given kind, creating it
+ *        if necessary. It is read from the environment variable env, if that is set,
+ *        and placed below $XDG_CACHE_HOME or ~/.cache/csapex_python otherwise.
+ */
+std::string cacheDirectory(const std::string& kind, const char* env);
+
+}
+
+#endif // PYTHON_CACHE_DIRECTORY_H
@@ -0,0 +1,321 @@
+/// HEADER
+#include "python_cloud_columns.h"
+
+/// PROJECT
+#include <csapex/msg/io.h>
+#include <csapex/msg/output.h>
+#include <csapex_point_cloud/msg/point_cloud_message.h>
+
+/// COMPONENT
+#include "python_array_view.h"
+#include "python_parallel.h"
+#include "python_payload_cache.h"
+#include "python_point_fields.h"
+#include "python_result_cache.h"
+
+/// SYSTEM
+#include <boost/make_shared.hpp>
+#include <boost/mpl/for_each.hpp>
+#include <boost/python.hpp>
+#include <boost/variant.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+using namespace csapex;
+namespace bp = boost::python;
+
+namespace
+{
+const std::size_t MIN_POINTS_PER_THREAD = 16384;
+
+const char* dtype(PointFieldType type)
+{
+    switch(type) {
+    case PointFieldType::UINT8: return "uint8";
+    case PointFieldType::UINT32: return "uint32";
+    default: return "float32";
+    }
+}
+
+/*
+ * KERNELS
+ */
+
+// PCL points start with x, y, z and one padding float, four points form a 4x4 matrix that is transposed
+template <typename PointT>
+void deinterleave_xyz(const PointT* points, std::size_t begin, std::size_t end, float* x, float* y, float* z)
+{
+    std::size_t i = begin;
+#ifdef __SSE__
+    for(; i + 4 <= end; i += 4) {
+        __m128 p0 = _mm_loadu_ps(&points[i].x);
+        __m128 p1 = _mm_loadu_ps(&points[i + 1].x);
+        __m128 p2 = _mm_loadu_ps(&points[i + 2].x);
+        __m128 p3 = _mm_loadu_ps(&points[i + 3].x);
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+        _mm_storeu_ps(x + i, p0);
+        _mm_storeu_ps(y + i, p1);
+        _mm_storeu_ps(z + i, p2);
+    }
+#endif
+    for(; i < end; ++i) {
+        x[i] = points[i].x;
+        y[i] = points[i].y;
+        z[i] = points[i].z;
+    }
+}
+
+template <typename PointT>
+void interleave_xyz(const float* x, const float* y, const float* z, std::size_t begin, std::size_t end, PointT* points)
+{
+    std::size_t i = begin;
+#ifdef __SSE__
+    const __m128 one = _mm_set1_ps(1.0f);
+    for(; i + 4 <= end; i += 4) {
+        __m128 p0 = _mm_loadu_ps(x + i);
+        __m128 p1 = _mm_loadu_ps(y + i);
+        __m128 p2 = _mm_loadu_ps(z + i);
+        __m128 p3 = one;
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+        _mm_storeu_ps(&points[i].x, p0);
+        _mm_storeu_ps(&points[i + 1].x, p1);
+        _mm_storeu_ps(&points[i + 2].x, p2);
+        _mm_storeu_ps(&points[i + 3].x, p3);
+    }
+#endif
+    for(; i < end; ++i) {
+        points[i].x = x[i];
+        points[i].y = y[i];
+        points[i].z = z[i];
+    }
+}
+
+template <typename PointT>
+void gather(const PointT* points, std::size_t begin, std::size_t end, const PointField& field, std::uint8_t* column)
+{
+    const std::uint8_t* base = reinterpret_cast<const std::uint8_t*>(points) + field.offset;
+    const std::size_t size = field.size();
+    for(std::size_t i = begin; i < end; ++i) {
+        std::memcpy(column + i * size, base + i * sizeof(PointT), size);
+    }
+}
+
+template <typename PointT>
+void scatter(const std::uint8_t* column, std::size_t begin, std::size_t end, const PointField& field, PointT* points)
+{
+    std::uint8_t* base = reinterpret_cast<std::uint8_t*>(points) + field.offset;
+    const std::size_t size = field.size();
+    for(std::size_t i = begin; i < end; ++i) {
+        std::memcpy(base + i * sizeof(PointT), column + i * size, size);
+    }
+}
+
+/*
+ * COLUMNS
+ */
+
+struct ColumnsVisitor : boost::static_visitor<void>
+{
+    template <typename PointT>
+    void operator () (const boost::shared_ptr<pcl::PointCloud<PointT>>& cloud)
+    {
+        if(!cloud) {
+            throw std::invalid_argument("the message does not contain a point cloud");
+        }
+        columns = PayloadCache<CloudColumns>::instance().get(cloud);
+        ScopedGilRelease nogil;
+        columns->build(*cloud);
+    }
+
+    std::shared_ptr<CloudColumns> columns;
+};
+
+bp::dict columns(const connection_types::PointCloudMessage& message)
+{
+    ColumnsVisitor visitor;
+    boost::apply_visitor(visitor, message.value);
+
+    bp::dict res;
+    for(const CloudColumns::Column& column : visitor.columns->getColumns()) {
+        ArrayView view(visitor.columns, column.data.data(), { static_cast<Py_ssize_t>(visitor.columns->size()) },
+                       column.type, true);
+        res[column.name] = view.toNumpy();
+    }
+    return res;
+}
+
+/*
+ * PUBLISH
+ */
+
+struct InputColumn
+{
+    InputColumn(const bp::dict& columns, const PointField& field, std::size_t n)
+        : field(field), data(nullptr), guard(nullptr, &PyBuffer_Release)
+    {
+        if(!columns.has_key(field.name)) {
+            return;
+        }
+        array = bp::import("numpy").attr("ascontiguousarray")(columns[field.name], dtype(field.type));
+        if(PyObject_GetBuffer(array.ptr(), &buffer, PyBUF_C_CONTIGUOUS) != 0) {
+            bp::throw_error_already_set();
+        }
+        guard.reset(&buffer);
+
+        if(buffer.ndim != 1 || static_cast<std::size_t>(buffer.shape[0]) != n) {
+            PyErr_Format(PyExc_ValueError, "column %s has to be one dimensional with %zu entries", field.name, n);
+            bp::throw_error_already_set();
+        }
+        data = static_cast<const std::uint8_t*>(buffer.buf);
+    }
+
+    PointField field;
+    const std::uint8_t* data;
+    bp::object array;
+    Py_buffer buffer;
+    std::unique_ptr<Py_buffer, void(*)(Py_buffer*)> guard;
+};
+
+struct PublishColumns
+{
+    PublishColumns(Output* output, const bp::dict& columns, const std::string& point_type,
+                   const std::string& frame, std::uint64_t stamp, bool& published)
+        : output(output), columns(columns), point_type(point_type), frame(frame), stamp(stamp), published(published)
+    {}
+
+    template <typename PointT>
+    void operator () (PointT) const
+    {
+        if(published || connection_types::traits::name<PointT>() != point_type) {
+            return;
+        }
+
+        if(!columns.has_key("x") || !columns.has_key("y") || !columns.has_key("z")) {
+            PyErr_SetString(PyExc_KeyError, "the columns x, y and z are required");
+            bp::throw_error_already_set();
+        }
+        const std::size_t n = bp::len(columns["x"]);
+
+        std::vector<std::unique_ptr<InputColumn>> xyz;
+        for(const char* name : { "x", "y", "z" }) {
+            xyz.emplace_back(new InputColumn(columns, PointField { name, 0, PointFieldType::FLOAT32 }, n));
+        }
+        std::vector<std::unique_ptr<InputColumn>> extra;
+        for(const PointField& field : extraPointFields<PointT>()) {
+            extra.emplace_back(new InputColumn(columns, field, n));
+        }
+
+        boost::shared_ptr<pcl::PointCloud<PointT>> cloud = boost::make_shared<pcl::PointCloud<PointT>>();
+        {
+            ScopedGilRelease nogil;
+
+            // default constructed points keep the defaults for all columns that are not given
+            cloud->points.resize(n);
+            cloud->width = static_cast<std::uint32_t>(n);
+            cloud->height = 1;
+            cloud->is_dense = false;
+            cloud->header.frame_id = frame;
+            cloud->header.stamp = stamp;
+
+            PointT* points = cloud->points.data();
+            const float* x = reinterpret_cast<const float*>(xyz[0]->data);
+            const float* y = reinterpret_cast<const float*>(xyz[1]->data);
+            const float* z = reinterpret_cast<const float*>(xyz[2]->data);
+            parallelFor(n, MIN_POINTS_PER_THREAD, [&](std::size_t begin, std::size_t end) {
+                interleave_xyz(x, y, z, begin, end, points);
+                for(const auto& column : extra) {
+                    if(column->data) {
+                        scatter(column->data, begin, end, column->field, points);
+                    }
+                }
+            });
+        }
+
+        auto message = std::make_shared<connection_types::PointCloudMessage>(frame, stamp);
+        message->value = cloud;
+        PythonResultCache::publish(output, message);
+        published = true;
+    }
+
+    Output* output;
+    const bp::dict& columns;
+    std::string point_type;
+    std::string frame;
+    std::uint64_t stamp;
+    bool& published;
+};
+
+void publish_cloud_columns(Output* output, const bp::dict& columns, const std::string& point_type,
+                           const std::string& frame, std::uint64_t stamp)
+{
+    bool published = false;
+    boost::mpl::for_each<connection_types::PointCloudPointTypes>(PublishColumns(output, columns, point_type, frame, stamp, published));
+    if(!published) {
+        PyErr_Format(PyExc_ValueError, "unknown point type %s", point_type.c_str());
+        bp::throw_error_already_set();
+    }
+}
+}
+
+CloudColumns::CloudColumns()
+    : size_(0)
+{
+}
+
+template <typename PointT>
+void CloudColumns::build(const pcl::PointCloud<PointT>& cloud)
+{
+    std::call_once(built_, [&]() {
+        const std::size_t n = cloud.points.size();
+        size_ = n;
+
+        std::vector<PointField> fields = pointFields<PointT>();
+
+        columns_.resize(fields.size());
+        for(std::size_t c = 0; c < fields.size(); ++c) {
+            columns_[c].name = fields[c].name;
+            columns_[c].type = fields[c].typestr();
+            columns_[c].item_size = fields[c].size();
+            // never empty, numpy does not accept a missing data pointer
+            columns_[c].data.resize(std::max<std::size_t>(1, n * columns_[c].item_size));
+        }
+
+        const PointT* points = cloud.points.data();
+        float* x = reinterpret_cast<float*>(columns_[0].data.data());
+        float* y = reinterpret_cast<float*>(columns_[1].data.data());
+        float* z = reinterpret_cast<float*>(columns_[2].data.data());
+        parallelFor(n, MIN_POINTS_PER_THREAD, [&](std::size_t begin, std::size_t end) {
+            deinterleave_xyz(points, begin, end, x, y, z);
+            for(std::size_t c = 3; c < fields.size(); ++c) {
+                gather(points, begin, end, fields[c], columns_[c].data.data());
+            }
+        });
+    });
+}
+
+std::size_t CloudColumns::size() const
+{
+    return size_;
+}
+
+const std::vector<CloudColumns::Column>& CloudColumns::getColumns() const
+{
+    return columns_;
+}
+
+namespace csapex
+{
+void registerCloudColumns()
+{
+    bp::def("publish_cloud_columns", &publish_cloud_columns,
+            (bp::arg("output"), bp::arg("columns"), bp::arg("point_type"), bp::arg("frame") = "/", bp::arg("stamp") = 0));
+
+    bp::scope parent = bp::object(bp::scope().attr("cloud"));
+    bp::def("columns", &columns, bp::args("cloud"));
+}
+}
@@ -0,0 +1,51 @@
+#ifndef PYTHON_CLOUD_COLUMNS_H
+#define PYTHON_CLOUD_COLUMNS_H
+
+/// SYSTEM
+#include <pcl/point_cloud.h>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace csapex
+{
+
+/**
+ * @brief The CloudColumns store the fields of a point cloud as separate contiguous
+ *        arrays (structure of arrays). They are built once per cloud and shared
+ *        through the PayloadCache, numpy only sees read-only views of them.
+ */
+class CloudColumns
+{
+public:
+    struct Column
+    {
+        std::string name;
+        std::string type;
+        std::size_t item_size;
+        std::vector<std::uint8_t> data;
+    };
+
+public:
+    CloudColumns();
+
+    //! deinterleaves the cloud once, concurrent callers wait for the first one
+    template <typename PointT>
+    void build(const pcl::PointCloud<PointT>& cloud);
+
+    std::size_t size() const;
+    const std::vector<Column>& getColumns() const;
+
+private:
+    std::once_flag built_;
+    std::size_t size_;
+    std::vector<Column> columns_;
+};
+
+void registerCloudColumns();
+
+}
+
+#endif // PYTHON_CLOUD_COLUMNS_H
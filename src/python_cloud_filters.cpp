@@ -0,0 +1,392 @@
+/// HEADER
+#include "python_cloud_filters.h"
+
+/// PROJECT
+#include <csapex_point_cloud/msg/point_cloud_message.h>
+
+/// COMPONENT
+#include "python_array_view.h"
+#include "python_parallel.h"
+
+/// SYSTEM
+#include <boost/make_shared.hpp>
+#include <boost/python.hpp>
+#include <boost/variant.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+using namespace csapex;
+namespace bp = boost::python;
+
+namespace
+{
+// smaller clouds are filtered on the calling thread
+const std::size_t MIN_POINTS_PER_THREAD = 16384;
+
+typedef std::vector<std::int32_t> Indices;
+
+template <typename PointT>
+using CloudPtr = boost::shared_ptr<pcl::PointCloud<PointT>>;
+
+template <typename PointT, typename Predicate>
+Indices select_if(const pcl::PointCloud<PointT>& cloud, const Predicate& predicate)
+{
+    const std::size_t n = cloud.points.size();
+    std::vector<std::uint8_t> mask(n);
+    parallelFor(n, MIN_POINTS_PER_THREAD, [&](std::size_t begin, std::size_t end) {
+        const PointT* points = cloud.points.data();
+        for(std::size_t i = begin; i < end; ++i) {
+            mask[i] = predicate(points[i]);
+        }
+    });
+
+    Indices indices;
+    indices.reserve(n);
+    for(std::size_t i = 0; i < n; ++i) {
+        if(mask[i]) {
+            indices.push_back(static_cast<std::int32_t>(i));
+        }
+    }
+    return indices;
+}
+
+template <typename PointT>
+CloudPtr<PointT> copy_indices(const pcl::PointCloud<PointT>& cloud, const Indices& indices)
+{
+    CloudPtr<PointT> res = boost::make_shared<pcl::PointCloud<PointT>>();
+    res->header = cloud.header;
+    res->points.resize(indices.size());
+    for(std::size_t i = 0; i < indices.size(); ++i) {
+        res->points[i] = cloud.points[indices[i]];
+    }
+    res->width = static_cast<std::uint32_t>(indices.size());
+    res->height = 1;
+    res->is_dense = cloud.is_dense;
+    return res;
+}
+
+/*
+ * SELECTORS
+ */
+
+struct Selector
+{
+    template <typename PointT>
+    CloudPtr<PointT> extract(const pcl::PointCloud<PointT>& cloud, const Indices& indices) const
+    {
+        return copy_indices(cloud, indices);
+    }
+};
+
+struct CropBox : public Selector
+{
+    template <typename PointT>
+    struct Predicate
+    {
+        const CropBox& box;
+
+        bool operator () (const PointT& p) const
+        {
+            bool inside = p.x >= box.min[0] && p.x <= box.max[0] &&
+                    p.y >= box.min[1] && p.y <= box.max[1] &&
+                    p.z >= box.min[2] && p.z <= box.max[2];
+            return inside != box.negative;
+        }
+    };
+
+    template <typename PointT>
+    Indices operator () (const pcl::PointCloud<PointT>& cloud) const
+    {
+        return select_if(cloud, Predicate<PointT>{*this});
+    }
+
+    float min[3];
+    float max[3];
+    bool negative;
+};
+
+struct Range : public Selector
+{
+    template <typename PointT>
+    struct Predicate
+    {
+        const Range& range;
+
+        bool operator () (const PointT& p) const
+        {
+            float d2 = p.x * p.x + p.y * p.y + p.z * p.z;
+            return d2 >= range.min_squared && d2 <= range.max_squared;
+        }
+    };
+
+    template <typename PointT>
+    Indices operator () (const pcl::PointCloud<PointT>& cloud) const
+    {
+        return select_if(cloud, Predicate<PointT>{*this});
+    }
+
+    float min_squared;
+    float max_squared;
+};
+
+struct NormalAngle : public Selector
+{
+    struct Predicate
+    {
+        const NormalAngle& filter;
+
+        bool operator () (const pcl::PointNormal& p) const
+        {
+            float dot = p.normal_x * filter.axis[0] + p.normal_y * filter.axis[1] + p.normal_z * filter.axis[2];
+            return std::abs(dot) >= filter.min_cos;
+        }
+    };
+
+    template <typename PointT>
+    Indices operator () (const pcl::PointCloud<PointT>&) const
+    {
+        throw std::invalid_argument("the point type has no normals");
+    }
+
+    Indices operator () (const pcl::PointCloud<pcl::PointNormal>& cloud) const
+    {
+        return select_if(cloud, Predicate{*this});
+    }
+
+    float axis[3];
+    float min_cos;
+};
+
+struct VoxelGrid : public Selector
+{
+    struct Cell
+    {
+        std::int32_t x, y, z;
+        std::int32_t index;
+
+        bool operator < (const Cell& other) const
+        {
+            if(x != other.x) return x < other.x;
+            if(y != other.y) return y < other.y;
+            if(z != other.z) return z < other.z;
+            return index < other.index;
+        }
+
+        bool sameVoxel(const Cell& other) const
+        {
+            return x == other.x && y == other.y && z == other.z;
+        }
+    };
+
+    // the first point of each voxel represents it, sorted by voxel
+    template <typename PointT>
+    Indices operator () (const pcl::PointCloud<PointT>& cloud) const
+    {
+        computeCells(cloud);
+
+        Indices indices;
+        for(std::size_t i = 0; i < cells.size(); ++i) {
+            if(i == 0 || !cells[i].sameVoxel(cells[i - 1])) {
+                indices.push_back(cells[i].index);
+            }
+        }
+        return indices;
+    }
+
+    // the representatives are moved to the centroid of their voxel
+    template <typename PointT>
+    CloudPtr<PointT> extract(const pcl::PointCloud<PointT>& cloud, const Indices& indices) const
+    {
+        CloudPtr<PointT> res = copy_indices(cloud, indices);
+
+        std::size_t cell = 0;
+        for(PointT& p : res->points) {
+            double x = 0, y = 0, z = 0;
+            std::size_t count = 0;
+            std::size_t first = cell;
+            do {
+                const PointT& member = cloud.points[cells[cell].index];
+                x += member.x;
+                y += member.y;
+                z += member.z;
+                ++count;
+                ++cell;
+            } while(cell < cells.size() && cells[cell].sameVoxel(cells[first]));
+
+            p.x = static_cast<float>(x / count);
+            p.y = static_cast<float>(y / count);
+            p.z = static_cast<float>(z / count);
+        }
+        res->is_dense = true;
+        return res;
+    }
+
+    template <typename PointT>
+    void computeCells(const pcl::PointCloud<PointT>& cloud) const
+    {
+        const std::size_t n = cloud.points.size();
+        const float inverse = 1.0f / leaf_size;
+        const float limit = static_cast<float>(std::numeric_limits<std::int32_t>::max());
+
+        std::vector<Cell> all(n);
+        std::vector<std::uint8_t> valid(n);
+        parallelFor(n, MIN_POINTS_PER_THREAD, [&](std::size_t begin, std::size_t end) {
+            for(std::size_t i = begin; i < end; ++i) {
+                const PointT& p = cloud.points[i];
+                float fx = std::floor(p.x * inverse);
+                float fy = std::floor(p.y * inverse);
+                float fz = std::floor(p.z * inverse);
+                // also rejects nan, all comparisons with it fail
+                valid[i] = std::abs(fx) < limit && std::abs(fy) < limit && std::abs(fz) < limit;
+                all[i] = Cell { static_cast<std::int32_t>(valid[i] ? fx : 0),
+                                static_cast<std::int32_t>(valid[i] ? fy : 0),
+                                static_cast<std::int32_t>(valid[i] ? fz : 0),
+                                static_cast<std::int32_t>(i) };
+            }
+        });
+
+        cells.clear();
+        cells.reserve(n);
+        for(std::size_t i = 0; i < n; ++i) {
+            if(valid[i]) {
+                cells.push_back(all[i]);
+            }
+        }
+        std::sort(cells.begin(), cells.end());
+    }
+
+    float leaf_size;
+    mutable std::vector<Cell> cells;
+};
+
+/*
+ * DISPATCH
+ */
+
+template <typename S>
+struct SelectVisitor : public boost::static_visitor<void>
+{
+    SelectVisitor(const S& selector, bool build_cloud, Indices& indices, connection_types::PointCloudMessage::variant& result)
+        : selector(selector), build_cloud(build_cloud), indices(indices), result(result)
+    {}
+
+    template <typename PointT>
+    void operator () (const CloudPtr<PointT>& cloud) const
+    {
+        if(!cloud) {
+            throw std::invalid_argument("the message does not contain a point cloud");
+        }
+        indices = selector(*cloud);
+        if(build_cloud) {
+            result = selector.extract(*cloud, indices);
+        }
+    }
+
+    const S& selector;
+    bool build_cloud;
+    Indices& indices;
+    connection_types::PointCloudMessage::variant& result;
+};
+
+template <typename S>
+bp::object apply(const connection_types::PointCloudMessage& message, const S& selector, bool return_indices)
+{
+    auto indices = std::make_shared<Indices>();
+    auto result = std::make_shared<connection_types::PointCloudMessage>(message.frame_id, message.stamp_micro_seconds);
+    {
+        ScopedGilRelease nogil;
+        SelectVisitor<S> visitor(selector, !return_indices, *indices, result->value);
+        boost::apply_visitor(visitor, message.value);
+    }
+
+    if(return_indices) {
+        return ArrayView::fromVector(indices, { static_cast<Py_ssize_t>(indices->size()) });
+    }
+    return bp::object(connection_types::PointCloudMessage::Ptr(result));
+}
+
+void read_vector(const bp::object& sequence, float* res, const char* name)
+{
+    if(bp::len(sequence) != 3) {
+        PyErr_Format(PyExc_ValueError, "%s has to have three components", name);
+        bp::throw_error_already_set();
+    }
+    for(int i = 0; i < 3; ++i) {
+        res[i] = bp::extract<float>(sequence[i]);
+    }
+}
+
+/*
+ * BINDINGS
+ */
+
+bp::object crop_box(const connection_types::PointCloudMessage& message, const bp::object& min, const bp::object& max,
+                    bool negative, bool return_indices)
+{
+    CropBox box;
+    read_vector(min, box.min, "min");
+    read_vector(max, box.max, "max");
+    box.negative = negative;
+    return apply(message, box, return_indices);
+}
+
+bp::object range(const connection_types::PointCloudMessage& message, double min_range, double max_range, bool return_indices)
+{
+    Range filter;
+    filter.min_squared = static_cast<float>(min_range * min_range);
+    filter.max_squared = static_cast<float>(max_range * max_range);
+    return apply(message, filter, return_indices);
+}
+
+bp::object normal_angle(const connection_types::PointCloudMessage& message, const bp::object& axis, double max_angle,
+                        bool return_indices)
+{
+    NormalAngle filter;
+    read_vector(axis, filter.axis, "axis");
+    float norm = std::sqrt(filter.axis[0] * filter.axis[0] + filter.axis[1] * filter.axis[1] + filter.axis[2] * filter.axis[2]);
+    if(norm == 0.0f) {
+        PyErr_SetString(PyExc_ValueError, "the axis must not be zero");
+        bp::throw_error_already_set();
+    }
+    for(float& a : filter.axis) {
+        a /= norm;
+    }
+    filter.min_cos = static_cast<float>(std::cos(max_angle));
+    return apply(message, filter, return_indices);
+}
+
+bp::object voxel_grid(const connection_types::PointCloudMessage& message, double leaf_size, bool return_indices)
+{
+    if(!(leaf_size > 0.0)) {
+        PyErr_SetString(PyExc_ValueError, "the leaf size has to be positive");
+        bp::throw_error_already_set();
+    }
+    VoxelGrid grid;
+    grid.leaf_size = static_cast<float>(leaf_size);
+    return apply(message, grid, return_indices);
+}
+}
+
+namespace csapex
+{
+void registerCloudFilters()
+{
+    std::string nested_name = bp::extract<std::string>(bp::scope().attr("__name__") + ".cloud");
+    bp::object nested_module(bp::handle<>(bp::borrowed(PyImport_AddModule(nested_name.c_str()))));
+    bp::scope().attr("cloud") = nested_module;
+    bp::scope parent = nested_module;
+
+    bp::def("crop_box", &crop_box, (bp::arg("cloud"), bp::arg("min"), bp::arg("max"),
+                                    bp::arg("negative") = false, bp::arg("return_indices") = false));
+    bp::def("range", &range, (bp::arg("cloud"), bp::arg("min_range"), bp::arg("max_range"),
+                              bp::arg("return_indices") = false));
+    bp::def("normal_angle", &normal_angle, (bp::arg("cloud"), bp::arg("axis"), bp::arg("max_angle"),
+                                            bp::arg("return_indices") = false));
+    bp::def("voxel_grid", &voxel_grid, (bp::arg("cloud"), bp::arg("leaf_size"),
+                                        bp::arg("return_indices") = false));
+}
+}
@@ -0,0 +1,18 @@
+#ifndef PYTHON_CLOUD_FILTERS_H
+#define PYTHON_CLOUD_FILTERS_H
+
+namespace csapex
+{
+
+/**
+ * @brief registerCloudFilters adds the csapex.cloud submodule, which implements
+ *        the common point cloud filters natively for all point types.
+ *
+ * Every filter returns a new PointCloudMessage, or the indices of the selected
+ * points as numpy array when called with return_indices=True.
+ */
+void registerCloudFilters();
+
+}
+
+#endif // PYTHON_CLOUD_FILTERS_H
@@ -0,0 +1,209 @@
+/// HEADER
+#include "python_cloud_index.h"
+
+/// PROJECT
+#include <csapex_point_cloud/msg/point_cloud_message.h>
+
+/// COMPONENT
+#include "python_array_view.h"
+#include "python_parallel.h"
+#include "python_payload_cache.h"
+
+/// SYSTEM
+#include <boost/make_shared.hpp>
+#include <boost/variant.hpp>
+#include <pcl/common/io.h>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+using namespace csapex;
+namespace bp = boost::python;
+
+namespace
+{
+// smaller batches are not worth the cost of starting threads
+const std::size_t MIN_QUERIES_PER_THREAD = 256;
+
+std::vector<pcl::PointXYZ> read_queries(const bp::object& queries)
+{
+    bp::object array = bp::import("numpy").attr("ascontiguousarray")(queries, "float32");
+
+    Py_buffer buffer;
+    if(PyObject_GetBuffer(array.ptr(), &buffer, PyBUF_C_CONTIGUOUS) != 0) {
+        bp::throw_error_already_set();
+    }
+    std::unique_ptr<Py_buffer, void(*)(Py_buffer*)> guard(&buffer, &PyBuffer_Release);
+
+    if(buffer.ndim != 2 || buffer.shape[1] < 3) {
+        PyErr_SetString(PyExc_ValueError, "queries have to be an array of shape (n, 3)");
+        bp::throw_error_already_set();
+    }
+
+    const float* data = static_cast<const float*>(buffer.buf);
+    const Py_ssize_t columns = buffer.shape[1];
+
+    std::vector<pcl::PointXYZ> res(buffer.shape[0]);
+    for(Py_ssize_t i = 0; i < buffer.shape[0]; ++i) {
+        const float* row = data + i * columns;
+        res[i].x = row[0];
+        res[i].y = row[1];
+        res[i].z = row[2];
+    }
+    return res;
+}
+
+struct CloudPayload : boost::static_visitor<void>
+{
+    template <typename PointT>
+    void operator () (const boost::shared_ptr<pcl::PointCloud<PointT>>& cloud)
+    {
+        payload = cloud;
+        extract = [cloud]() {
+            CloudIndex::Cloud::Ptr xyz = boost::make_shared<CloudIndex::Cloud>();
+            pcl::copyPointCloud(*cloud, *xyz);
+            return xyz;
+        };
+    }
+
+    boost::shared_ptr<const void> payload;
+    std::function<CloudIndex::Cloud::Ptr()> extract;
+};
+
+std::shared_ptr<CloudIndex> cloud_index(const connection_types::PointCloudMessage& message)
+{
+    CloudPayload visitor;
+    boost::apply_visitor(visitor, message.value);
+    if(!visitor.payload) {
+        PyErr_SetString(PyExc_ValueError, "the message does not contain a point cloud");
+        bp::throw_error_already_set();
+    }
+
+    std::shared_ptr<CloudIndex> index = PayloadCache<CloudIndex>::instance().get(visitor.payload);
+    {
+        ScopedGilRelease nogil;
+        index->build(visitor.extract);
+    }
+    return index;
+}
+}
+
+CloudIndex::CloudIndex()
+{
+}
+
+void CloudIndex::build(const std::function<Cloud::Ptr()>& extract)
+{
+    std::call_once(built_, [&]() {
+        cloud_ = extract();
+        if(!cloud_->empty()) {
+            tree_.setInputCloud(cloud_);
+        }
+    });
+}
+
+std::size_t CloudIndex::size() const
+{
+    return cloud_ ? cloud_->size() : 0;
+}
+
+bp::tuple CloudIndex::knn(const bp::object &queries, int k) const
+{
+    if(k <= 0) {
+        PyErr_SetString(PyExc_ValueError, "k has to be positive");
+        bp::throw_error_already_set();
+    }
+
+    std::vector<pcl::PointXYZ> points = read_queries(queries);
+    const std::size_t n = points.size();
+
+    auto indices = std::make_shared<std::vector<std::int32_t>>(n * k, -1);
+    auto distances = std::make_shared<std::vector<float>>(n * k, std::numeric_limits<float>::infinity());
+
+    if(size() > 0) {
+        ScopedGilRelease nogil;
+        parallelFor(n, MIN_QUERIES_PER_THREAD, [&](std::size_t begin, std::size_t end) {
+            std::vector<int> found;
+            std::vector<float> found_distances;
+            for(std::size_t i = begin; i < end; ++i) {
+                int count = tree_.nearestKSearch(points[i], k, found, found_distances);
+                std::copy(found.begin(), found.begin() + count, indices->begin() + i * k);
+                std::copy(found_distances.begin(), found_distances.begin() + count, distances->begin() + i * k);
+            }
+        });
+    }
+
+    std::vector<Py_ssize_t> shape { static_cast<Py_ssize_t>(n), k };
+    return bp::make_tuple(ArrayView::fromVector(indices, shape), ArrayView::fromVector(distances, shape));
+}
+
+bp::tuple CloudIndex::radius(const bp::object &queries, double radius, int max_neighbours) const
+{
+    std::vector<pcl::PointXYZ> points = read_queries(queries);
+    const std::size_t n = points.size();
+
+    auto offsets = std::make_shared<std::vector<std::int64_t>>(n + 1, 0);
+    auto indices = std::make_shared<std::vector<std::int32_t>>();
+    auto distances = std::make_shared<std::vector<float>>();
+
+    if(size() > 0) {
+        ScopedGilRelease nogil;
+
+        // every chunk collects its results separately, they are concatenated in query order afterwards
+        struct Chunk
+        {
+            std::size_t begin;
+            std::vector<std::int32_t> indices;
+            std::vector<float> distances;
+        };
+        std::mutex chunk_mutex;
+        std::vector<Chunk> chunks;
+
+        parallelFor(n, MIN_QUERIES_PER_THREAD, [&](std::size_t begin, std::size_t end) {
+            Chunk chunk;
+            chunk.begin = begin;
+            std::vector<int> found;
+            std::vector<float> found_distances;
+            for(std::size_t i = begin; i < end; ++i) {
+                int count = tree_.radiusSearch(points[i], radius, found, found_distances, std::max(0, max_neighbours));
+                chunk.indices.insert(chunk.indices.end(), found.begin(), found.begin() + count);
+                chunk.distances.insert(chunk.distances.end(), found_distances.begin(), found_distances.begin() + count);
+                (*offsets)[i + 1] = count;
+            }
+
+            std::unique_lock<std::mutex> lock(chunk_mutex);
+            chunks.push_back(std::move(chunk));
+        });
+
+        std::sort(chunks.begin(), chunks.end(), [](const Chunk& a, const Chunk& b) { return a.begin < b.begin; });
+        for(std::size_t i = 0; i < n; ++i) {
+            (*offsets)[i + 1] += (*offsets)[i];
+        }
+        indices->reserve(offsets->back());
+        distances->reserve(offsets->back());
+        for(const Chunk& chunk : chunks) {
+            indices->insert(indices->end(), chunk.indices.begin(), chunk.indices.end());
+            distances->insert(distances->end(), chunk.distances.begin(), chunk.distances.end());
+        }
+    }
+
+    std::vector<Py_ssize_t> flat { static_cast<Py_ssize_t>(indices->size()) };
+    return bp::make_tuple(ArrayView::fromVector(indices, flat), ArrayView::fromVector(distances, flat),
+                          ArrayView::fromVector(offsets, { static_cast<Py_ssize_t>(n + 1) }));
+}
+
+namespace csapex
+{
+void registerCloudIndex()
+{
+    bp::class_<CloudIndex, std::shared_ptr<CloudIndex>, boost::noncopyable>("CloudIndex", bp::no_init)
+            .add_property("size", &CloudIndex::size)
+            .def("knn", &CloudIndex::knn, (bp::arg("queries"), bp::arg("k")))
+            .def("radius", &CloudIndex::radius, (bp::arg("queries"), bp::arg("r"), bp::arg("max_neighbours") = 0))
+            ;
+
+    bp::def("cloud_index", &cloud_index, bp::args("cloud"));
+}
+}
@@ -0,0 +1,47 @@
+#ifndef PYTHON_CLOUD_INDEX_H
+#define PYTHON_CLOUD_INDEX_H
+
+/// SYSTEM
+#include <boost/python.hpp>
+#include <pcl/kdtree/kdtree_flann.h>
+#include <pcl/point_types.h>
+#include <functional>
+#include <mutex>
+
+namespace csapex
+{
+
+/**
+ * @brief The CloudIndex is a kd-tree over the coordinates of one point cloud.
+ *        Queries are batched and run on multiple threads without the GIL.
+ *        Indices are shared per cloud through the PayloadCache.
+ */
+class CloudIndex
+{
+public:
+    typedef pcl::PointCloud<pcl::PointXYZ> Cloud;
+
+    CloudIndex();
+
+    //! builds the tree once, concurrent callers wait for the first one
+    void build(const std::function<Cloud::Ptr()>& extract);
+
+    std::size_t size() const;
+
+    //! returns (indices, squared distances), both of shape (n, k), padded with -1 and inf
+    boost::python::tuple knn(const boost::python::object& queries, int k) const;
+
+    //! returns (indices, squared distances, offsets), the neighbours of query i are [offsets[i], offsets[i+1])
+    boost::python::tuple radius(const boost::python::object& queries, double radius, int max_neighbours) const;
+
+private:
+    std::once_flag built_;
+    Cloud::Ptr cloud_;
+    pcl::KdTreeFLANN<pcl::PointXYZ> tree_;
+};
+
+void registerCloudIndex();
+
+}
+
+#endif // PYTHON_CLOUD_INDEX_H
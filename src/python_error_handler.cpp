@@ -0,0 +1,199 @@
+/// HEADER
+#include "python_error_handler.h"
+
+/// SYSTEM
+#include <frameobject.h>
+#include <ctime>
+#include <functional>
+
+using namespace csapex;
+namespace bp = boost::python;
+
+namespace
+{
+const std::size_t MAX_TRACKED_TRACEBACKS = 64;
+
+void hash_combine(std::size_t& seed, std::size_t value)
+{
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+}
+
+PythonErrorHandler::PythonErrorHandler(std::chrono::milliseconds report_interval)
+    : errors_(0), suppressed_(0), report_interval_(report_interval), reported_errors_(0)
+{
+}
+
+bool PythonErrorHandler::handle(std::string& report)
+{
+    PyObject *type_ptr = NULL, *value_ptr = NULL, *traceback_ptr = NULL;
+    PyErr_Fetch(&type_ptr, &value_ptr, &traceback_ptr);
+    PyErr_NormalizeException(&type_ptr, &value_ptr, &traceback_ptr);
+
+    ++errors_;
+
+    std::size_t key = hash(type_ptr, value_ptr, traceback_ptr);
+    auto now = std::chrono::steady_clock::now();
+
+    auto pos = last_report_.find(key);
+    if(pos != last_report_.end() && now - pos->second < report_interval_) {
+        ++suppressed_;
+        ++suppressed_since_report_[key];
+        Py_XDECREF(type_ptr);
+        Py_XDECREF(value_ptr);
+        Py_XDECREF(traceback_ptr);
+        return false;
+    }
+
+    if(last_report_.size() >= MAX_TRACKED_TRACEBACKS) {
+        last_report_.clear();
+        suppressed_since_report_.clear();
+    }
+    last_report_[key] = now;
+
+    report = format(type_ptr, value_ptr, traceback_ptr);
+
+    std::size_t& suppressed = suppressed_since_report_[key];
+    if(suppressed > 0) {
+        report += "\n(" + std::to_string(suppressed) + " identical errors suppressed)";
+        suppressed = 0;
+    }
+
+    std::unique_lock<std::mutex> lock(snapshot_mutex_);
+    last_error_ = report;
+    last_error_time_ = std::chrono::system_clock::now();
+
+    return true;
+}
+
+std::string PythonErrorHandler::describe()
+{
+    PyObject *type_ptr = NULL, *value_ptr = NULL, *traceback_ptr = NULL;
+    PyErr_Fetch(&type_ptr, &value_ptr, &traceback_ptr);
+    return format(type_ptr, value_ptr, traceback_ptr);
+}
+
+void PythonErrorHandler::release()
+{
+    format_tb_ = bp::object();
+}
+
+PythonErrorHandler::Snapshot PythonErrorHandler::snapshot() const
+{
+    std::unique_lock<std::mutex> lock(snapshot_mutex_);
+
+    Snapshot res;
+    res.errors = errors_;
+    res.suppressed = suppressed_;
+    res.last_error = last_error_;
+    res.last_error_time = last_error_time_;
+    return res;
+}
+
+bool PythonErrorHandler::pollReport(std::string &report)
+{
+    Snapshot current = snapshot();
+
+    std::unique_lock<std::mutex> lock(snapshot_mutex_);
+    if(current.errors == reported_errors_) {
+        return false;
+    }
+    reported_errors_ = current.errors;
+
+    char time[16] = "";
+    std::time_t t = std::chrono::system_clock::to_time_t(current.last_error_time);
+    std::tm local;
+    if(localtime_r(&t, &local)) {
+        std::strftime(time, sizeof(time), "%H:%M:%S", &local);
+    }
+
+    // the traceback does not fit into a status line
+    std::string message = current.last_error.substr(0, current.last_error.find('\n'));
+
+    report = std::to_string(current.errors) + " errors, " + std::to_string(current.suppressed) + " suppressed, last at " +
+            time + ": " + message;
+    return true;
+}
+
+std::size_t PythonErrorHandler::hash(PyObject *type, PyObject *value, PyObject *traceback) const
+{
+    // the traceback is not formatted until the error is reported, the message is part of the key,
+    // so that e.g. a KeyError for another key is not suppressed
+    std::size_t seed = std::hash<const void*>()(type);
+    if(value != NULL) {
+        PyObject* message = PyObject_Str(value);
+        Py_ssize_t size = 0;
+#if PY_MAJOR_VERSION >= 3
+        const char* data = message ? PyUnicode_AsUTF8AndSize(message, &size) : NULL;
+#else
+        char* data = NULL;
+        if(message && PyString_AsStringAndSize(message, &data, &size) != 0) {
+            data = NULL;
+        }
+#endif
+        if(data) {
+            hash_combine(seed, std::hash<std::string>()(std::string(data, size)));
+        } else {
+            PyErr_Clear();
+        }
+        Py_XDECREF(message);
+    }
+    for(PyTracebackObject* tb = reinterpret_cast<PyTracebackObject*>(traceback); tb != NULL; tb = tb->tb_next) {
+#if PY_VERSION_HEX >= 0x03090000
+        PyCodeObject* code = PyFrame_GetCode(tb->tb_frame);
+        hash_combine(seed, std::hash<const void*>()(code));
+        Py_DECREF(code);
+#else
+        hash_combine(seed, std::hash<const void*>()(tb->tb_frame->f_code));
+#endif
+        hash_combine(seed, static_cast<std::size_t>(tb->tb_lineno));
+    }
+    return seed;
+}
+
+std::string PythonErrorHandler::format(PyObject *type_ptr, PyObject *value_ptr, PyObject *traceback_ptr)
+{
+    PyErr_NormalizeException(&type_ptr, &value_ptr, &traceback_ptr);
+
+    std::string ret("Unfetchable Python error");
+
+    if(type_ptr != NULL){
+        bp::handle<> h_type(type_ptr);
+        if(PyType_Check(type_ptr)) {
+            ret = reinterpret_cast<PyTypeObject*>(type_ptr)->tp_name;
+        } else {
+            ret = "Unknown exception type";
+        }
+    }
+
+    if(value_ptr != NULL){
+        bp::handle<> h_val(value_ptr);
+        bp::str a(h_val);
+        bp::extract<std::string> returned(a);
+        if(returned.check())
+            ret +=  ": " + returned();
+        else
+            ret += std::string(": Unparseable Python error: ");
+    }
+
+    if(traceback_ptr != NULL){
+        bp::handle<> h_tb(traceback_ptr);
+        try {
+            if(format_tb_.is_none()) {
+                format_tb_ = bp::import("traceback").attr("format_tb");
+            }
+            bp::object tb_list(format_tb_(h_tb));
+            bp::object tb_str(bp::str("\n").join(tb_list));
+            bp::extract<std::string> returned(tb_str);
+            if(returned.check())
+                ret += ":\n" + returned();
+            else
+                ret += std::string(": Unparseable Python traceback");
+
+        } catch(const bp::error_already_set&) {
+            PyErr_Clear();
+            ret += std::string(": Unparseable Python traceback");
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,80 @@
+#ifndef PYTHON_ERROR_HANDLER_H
+#define PYTHON_ERROR_HANDLER_H
+
+/// SYSTEM
+#include <boost/python.hpp>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonErrorHandler turns the currently set python error into a
+ *        description. Repeated errors with the same traceback and message are only
+ *        reported once per interval, the counters and the last reported error can be
+ *        queried without holding the GIL.
+ */
+class PythonErrorHandler
+{
+public:
+    struct Snapshot
+    {
+        std::size_t errors;
+        std::size_t suppressed;
+        //! the last reported error and when it was reported, suppressed errors do not change them
+        std::string last_error;
+        std::chrono::system_clock::time_point last_error_time;
+    };
+
+public:
+    PythonErrorHandler(std::chrono::milliseconds report_interval = std::chrono::milliseconds(5000));
+
+    /**
+     * @brief handle fetches and clears the current python error, requires the GIL
+     * @param report is set to the description, if the error should be reported
+     * @return true, iff the error should be reported
+     */
+    bool handle(std::string& report);
+
+    /**
+     * @brief describe fetches, clears and formats the current python error, requires the GIL
+     */
+    std::string describe();
+
+    /**
+     * @brief release drops the cached python objects, requires the GIL of the owning interpreter
+     */
+    void release();
+
+    Snapshot snapshot() const;
+
+    //! summarizes the counters and the last error, iff an error occurred since the last poll
+    bool pollReport(std::string& report);
+
+private:
+    std::string format(PyObject* type, PyObject* value, PyObject* traceback);
+    std::size_t hash(PyObject* type, PyObject* value, PyObject* traceback) const;
+
+private:
+    boost::python::object format_tb_;
+
+    std::atomic<std::size_t> errors_;
+    std::atomic<std::size_t> suppressed_;
+    std::chrono::milliseconds report_interval_;
+
+    std::unordered_map<std::size_t, std::chrono::steady_clock::time_point> last_report_;
+    std::unordered_map<std::size_t, std::size_t> suppressed_since_report_;
+
+    mutable std::mutex snapshot_mutex_;
+    std::string last_error_;
+    std::chrono::system_clock::time_point last_error_time_;
+    std::size_t reported_errors_;
+};
+
+}
+
+#endif // PYTHON_ERROR_HANDLER_H
@@ -0,0 +1,582 @@
+/// HEADER
+#include "python_expression.h"
+
+/// COMPONENT
+#include "python_parallel.h"
+
+/// SYSTEM
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+using namespace csapex;
+
+namespace
+{
+// elements per chunk, small enough for the stack of a chunk to stay in the cache
+const std::size_t CHUNK = 1024;
+const std::size_t MIN_ELEMENTS_PER_THREAD = 16 * CHUNK;
+
+// inputs beyond z are only reachable as in26, in27, ...
+const int ALPHABET_INPUTS = 26;
+
+template <typename T>
+void load(const std::uint8_t* data, std::ptrdiff_t stride, std::size_t begin, std::size_t length, float* dst)
+{
+    const std::uint8_t* p = data + begin * stride;
+    if(stride == sizeof(T)) {
+        const T* values = reinterpret_cast<const T*>(p);
+        for(std::size_t j = 0; j < length; ++j) {
+            dst[j] = static_cast<float>(values[j]);
+        }
+    } else {
+        for(std::size_t j = 0; j < length; ++j) {
+            T value;
+            std::memcpy(&value, p + j * stride, sizeof(T));
+            dst[j] = static_cast<float>(value);
+        }
+    }
+}
+
+template <typename F>
+inline void unary(float* a, std::size_t length, F f)
+{
+    for(std::size_t j = 0; j < length; ++j) {
+        a[j] = f(a[j]);
+    }
+}
+
+template <typename F>
+inline void binary(float* a, const float* b, std::size_t length, F f)
+{
+    for(std::size_t j = 0; j < length; ++j) {
+        a[j] = f(a[j], b[j]);
+    }
+}
+}
+
+bool Expression::Variable::operator == (const Variable& other) const
+{
+    return input == other.input && field == other.field;
+}
+
+Expression::Source Expression::Source::scalar(float value)
+{
+    return Source { Type::SCALAR, nullptr, 0, value };
+}
+
+Expression::Source Expression::Source::array(Type type, const void* data, std::ptrdiff_t stride)
+{
+    return Source { type, static_cast<const std::uint8_t*>(data), stride, 0.0f };
+}
+
+int Expression::arity(Op op)
+{
+    switch(op) {
+    case Op::LOAD: case Op::CONSTANT:
+        return 0;
+    case Op::NEG: case Op::NOT: case Op::ABS: case Op::SQRT: case Op::EXP:
+    case Op::LOG: case Op::SIN: case Op::COS: case Op::FLOOR:
+        return 1;
+    case Op::WHERE: case Op::CLIP:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+/*
+ * PARSER
+ */
+
+class Expression::Parser
+{
+public:
+    Parser(const std::string& text, Expression& expression)
+        : text_(text), pos_(0), expression_(expression), depth_(0)
+    {}
+
+    void parse()
+    {
+        parseOr();
+        skipSpace();
+        if(pos_ != text_.size()) {
+            fail("unexpected input");
+        }
+    }
+
+private:
+    // grammar, from the lowest to the highest precedence, like in Python and numpy:
+    //   or      := and ('or' and)*
+    //   and     := not ('and' not)*
+    //   not     := 'not' not | compare
+    //   compare := bitor (('<' | '<=' | '>' | '>=' | '==' | '!=') bitor)?
+    //   bitor   := bitand ('|' bitand)*
+    //   bitand  := sum ('&' sum)*
+    //   sum     := product (('+' | '-') product)*
+    //   product := unary (('*' | '/') unary)*
+    //   unary   := ('-' | '+' | '~') unary | power
+    //   power   := atom ('**' unary)?
+    //   atom    := number | variable | variable '.' field | function '(' arguments ')' | '(' or ')'
+    // '&', '|' and '~' combine truth values like on numpy booleans, so "(a > 0) & (b > 0)" needs
+    // the parentheses, just as in numpy
+
+    void parseOr()
+    {
+        parseAnd();
+        while(acceptWord("or")) {
+            parseAnd();
+            emit(Op::OR);
+        }
+    }
+
+    void parseAnd()
+    {
+        parseNot();
+        while(acceptWord("and")) {
+            parseNot();
+            emit(Op::AND);
+        }
+    }
+
+    void parseNot()
+    {
+        if(acceptWord("not")) {
+            parseNot();
+            emit(Op::NOT);
+        } else {
+            parseCompare();
+        }
+    }
+
+    void parseCompare()
+    {
+        parseBitOr();
+
+        static const std::vector<std::pair<const char*, Op>> comparisons {
+            {"<=", Op::LE}, {">=", Op::GE}, {"==", Op::EQ}, {"!=", Op::NE}, {"<", Op::LT}, {">", Op::GT}
+        };
+        for(const auto& c : comparisons) {
+            if(acceptOperator(c.first)) {
+                parseBitOr();
+                emit(c.second);
+                return;
+            }
+        }
+    }
+
+    void parseBitOr()
+    {
+        parseBitAnd();
+        while(acceptOperator("|")) {
+            parseBitAnd();
+            emit(Op::OR);
+        }
+    }
+
+    void parseBitAnd()
+    {
+        parseSum();
+        while(acceptOperator("&")) {
+            parseSum();
+            emit(Op::AND);
+        }
+    }
+
+    void parseSum()
+    {
+        parseProduct();
+        while(true) {
+            if(acceptOperator("+")) {
+                parseProduct();
+                emit(Op::ADD);
+            } else if(acceptOperator("-")) {
+                parseProduct();
+                emit(Op::SUB);
+            } else {
+                return;
+            }
+        }
+    }
+
+    void parseProduct()
+    {
+        parseUnary();
+        while(true) {
+            if(peekOperator("**")) {
+                return;
+            } else if(acceptOperator("*")) {
+                parseUnary();
+                emit(Op::MUL);
+            } else if(acceptOperator("/")) {
+                parseUnary();
+                emit(Op::DIV);
+            } else {
+                return;
+            }
+        }
+    }
+
+    void parseUnary()
+    {
+        if(acceptOperator("-")) {
+            parseUnary();
+            emit(Op::NEG);
+        } else if(acceptOperator("+")) {
+            parseUnary();
+        } else if(acceptOperator("~")) {
+            parseUnary();
+            emit(Op::NOT);
+        } else {
+            parsePower();
+        }
+    }
+
+    void parsePower()
+    {
+        parseAtom();
+        if(acceptOperator("**")) {
+            parseUnary();
+            emit(Op::POW);
+        }
+    }
+
+    void parseAtom()
+    {
+        skipSpace();
+        if(pos_ >= text_.size()) {
+            fail("unexpected end of expression");
+        }
+
+        char c = text_[pos_];
+        if(std::isdigit(c) || c == '.') {
+            parseNumber();
+
+        } else if(std::isalpha(c) || c == '_') {
+            std::size_t start = pos_;
+            std::string name = readName();
+            skipSpace();
+            if(pos_ < text_.size() && text_[pos_] == '(') {
+                ++pos_;
+                parseFunction(name, start);
+            } else if(name == "pi") {
+                emitConstant(static_cast<float>(M_PI));
+            } else {
+                parseVariable(name, start);
+            }
+
+        } else if(acceptOperator("(")) {
+            parseOr();
+            expect(")");
+
+        } else {
+            fail("expected a value");
+        }
+    }
+
+    void parseNumber()
+    {
+        const char* begin = text_.c_str() + pos_;
+        char* end = nullptr;
+        double value = std::strtod(begin, &end);
+        if(end == begin) {
+            fail("invalid number");
+        }
+        pos_ += end - begin;
+        emitConstant(static_cast<float>(value));
+    }
+
+    void parseVariable(const std::string& name, std::size_t start)
+    {
+        int input = Expression::inputIndex(name);
+        if(input < 0) {
+            pos_ = start;
+            fail("unknown name '" + name + "', inputs are called a, b, c, ... or in0, in1, in2, ...");
+        }
+
+        Variable variable { input, std::string() };
+        if(acceptOperator(".")) {
+            skipSpace();
+            if(pos_ >= text_.size() || !(std::isalpha(text_[pos_]) || text_[pos_] == '_')) {
+                fail("expected a field name");
+            }
+            variable.field = readName();
+        }
+
+        auto& variables = expression_.variables_;
+        auto pos = std::find(variables.begin(), variables.end(), variable);
+        int index = static_cast<int>(pos - variables.begin());
+        if(pos == variables.end()) {
+            variables.push_back(variable);
+        }
+        emit(Op::LOAD, index);
+    }
+
+    void parseFunction(const std::string& name, std::size_t start)
+    {
+        struct Function
+        {
+            const char* name;
+            int arguments;
+            Op op;
+        };
+        static const std::vector<Function> functions {
+            {"abs", 1, Op::ABS}, {"sqrt", 1, Op::SQRT}, {"exp", 1, Op::EXP}, {"log", 1, Op::LOG},
+            {"sin", 1, Op::SIN}, {"cos", 1, Op::COS}, {"floor", 1, Op::FLOOR},
+            {"min", 2, Op::MIN}, {"max", 2, Op::MAX},
+            {"where", 3, Op::WHERE}, {"clip", 3, Op::CLIP}
+        };
+
+        auto f = std::find_if(functions.begin(), functions.end(), [&](const Function& f) { return name == f.name; });
+        if(f == functions.end()) {
+            pos_ = start;
+            fail("unknown function '" + name + "'");
+        }
+
+        for(int i = 0; i < f->arguments; ++i) {
+            if(i > 0) {
+                expect(",");
+            }
+            parseOr();
+        }
+        expect(")");
+        emit(f->op);
+    }
+
+    void emit(Op op, int argument = 0)
+    {
+        // every operation replaces its operands by one result
+        depth_ = depth_ + 1 - arity(op);
+        expression_.program_.push_back(Instruction { op, argument, 0.0f });
+        expression_.stack_depth_ = std::max(expression_.stack_depth_, depth_);
+    }
+
+    void emitConstant(float value)
+    {
+        emit(Op::CONSTANT);
+        expression_.program_.back().value = value;
+    }
+
+    std::string readName()
+    {
+        std::size_t start = pos_;
+        while(pos_ < text_.size() && (std::isalnum(text_[pos_]) || text_[pos_] == '_')) {
+            ++pos_;
+        }
+        return text_.substr(start, pos_ - start);
+    }
+
+    bool acceptWord(const char* word)
+    {
+        skipSpace();
+        std::size_t length = std::strlen(word);
+        if(text_.compare(pos_, length, word) != 0) {
+            return false;
+        }
+        std::size_t next = pos_ + length;
+        if(next < text_.size() && (std::isalnum(text_[next]) || text_[next] == '_')) {
+            return false;
+        }
+        pos_ = next;
+        return true;
+    }
+
+    bool peekOperator(const char* op)
+    {
+        skipSpace();
+        return text_.compare(pos_, std::strlen(op), op) == 0;
+    }
+
+    bool acceptOperator(const char* op)
+    {
+        if(!peekOperator(op)) {
+            return false;
+        }
+        pos_ += std::strlen(op);
+        return true;
+    }
+
+    void expect(const char* op)
+    {
+        if(!acceptOperator(op)) {
+            fail(std::string("expected '") + op + "'");
+        }
+    }
+
+    void skipSpace()
+    {
+        while(pos_ < text_.size() && std::isspace(text_[pos_])) {
+            ++pos_;
+        }
+    }
+
+    void fail(const std::string& message)
+    {
+        std::stringstream ss;
+        ss << message << " at column " << (pos_ + 1);
+        throw std::runtime_error(ss.str());
+    }
+
+private:
+    const std::string& text_;
+    std::size_t pos_;
+    Expression& expression_;
+    std::size_t depth_;
+};
+
+/*
+ * EXPRESSION
+ */
+
+Expression::Expression()
+    : stack_depth_(0)
+{
+}
+
+std::string Expression::inputName(int input)
+{
+    if(input < ALPHABET_INPUTS) {
+        return std::string(1, static_cast<char>('a' + input));
+    }
+    return "in" + std::to_string(input);
+}
+
+int Expression::inputIndex(const std::string &name)
+{
+    if(name.size() == 1 && name[0] >= 'a' && name[0] < 'a' + ALPHABET_INPUTS) {
+        return name[0] - 'a';
+    }
+
+    // in0, in1, ..., without leading zeros so that every input has one name besides its letter
+    if(name.size() < 3 || name.size() > 7 || name.compare(0, 2, "in") != 0 || (name[2] == '0' && name.size() > 3)) {
+        return -1;
+    }
+    int input = 0;
+    for(std::size_t i = 2; i < name.size(); ++i) {
+        if(!std::isdigit(name[i])) {
+            return -1;
+        }
+        input = input * 10 + (name[i] - '0');
+    }
+    return input;
+}
+
+Expression Expression::parse(const std::string &text)
+{
+    Expression expression;
+    Parser(text, expression).parse();
+    return expression;
+}
+
+bool Expression::empty() const
+{
+    return program_.empty();
+}
+
+const std::vector<Expression::Variable>& Expression::getVariables() const
+{
+    return variables_;
+}
+
+void Expression::evaluate(const std::vector<Source> &sources, std::size_t n, float *out) const
+{
+    if(sources.size() != variables_.size()) {
+        throw std::invalid_argument("expected one source per variable");
+    }
+
+    const std::size_t chunks = (n + CHUNK - 1) / CHUNK;
+    parallelFor(chunks, MIN_ELEMENTS_PER_THREAD / CHUNK, [&](std::size_t begin, std::size_t end) {
+        std::vector<float> stack(stack_depth_ * CHUNK);
+        for(std::size_t chunk = begin; chunk < end; ++chunk) {
+            std::size_t first = chunk * CHUNK;
+            evaluateChunk(sources, first, std::min(CHUNK, n - first), stack.data(), out + first);
+        }
+    });
+}
+
+void Expression::evaluateChunk(const std::vector<Source> &sources, std::size_t begin, std::size_t length,
+                               float *stack, float *out) const
+{
+    // top points to the first free slot of the stack
+    float* top = stack;
+    for(const Instruction& instruction : program_) {
+        switch(instruction.op) {
+        case Op::LOAD: {
+            const Source& source = sources[instruction.argument];
+            switch(source.type) {
+            case Source::Type::SCALAR: std::fill(top, top + length, source.value); break;
+            case Source::Type::UINT8: load<std::uint8_t>(source.data, source.stride, begin, length, top); break;
+            case Source::Type::INT8: load<std::int8_t>(source.data, source.stride, begin, length, top); break;
+            case Source::Type::UINT16: load<std::uint16_t>(source.data, source.stride, begin, length, top); break;
+            case Source::Type::INT16: load<std::int16_t>(source.data, source.stride, begin, length, top); break;
+            case Source::Type::INT32: load<std::int32_t>(source.data, source.stride, begin, length, top); break;
+            case Source::Type::UINT32: load<std::uint32_t>(source.data, source.stride, begin, length, top); break;
+            case Source::Type::FLOAT32: load<float>(source.data, source.stride, begin, length, top); break;
+            case Source::Type::FLOAT64: load<double>(source.data, source.stride, begin, length, top); break;
+            }
+            top += CHUNK;
+            continue;
+        }
+        case Op::CONSTANT:
+            std::fill(top, top + length, instruction.value);
+            top += CHUNK;
+            continue;
+        default:
+            break;
+        }
+
+        // the operands are the topmost entries, the result replaces the first one
+        float* a = top - arity(instruction.op) * CHUNK;
+        float* b = a + CHUNK;
+        float* c = b + CHUNK;
+        top = a + CHUNK;
+
+        switch(instruction.op) {
+        case Op::NEG: unary(a, length, [](float x) { return -x; }); break;
+        case Op::NOT: unary(a, length, [](float x) { return x == 0.0f ? 1.0f : 0.0f; }); break;
+        case Op::ABS: unary(a, length, [](float x) { return std::abs(x); }); break;
+        case Op::SQRT: unary(a, length, [](float x) { return std::sqrt(x); }); break;
+        case Op::EXP: unary(a, length, [](float x) { return std::exp(x); }); break;
+        case Op::LOG: unary(a, length, [](float x) { return std::log(x); }); break;
+        case Op::SIN: unary(a, length, [](float x) { return std::sin(x); }); break;
+        case Op::COS: unary(a, length, [](float x) { return std::cos(x); }); break;
+        case Op::FLOOR: unary(a, length, [](float x) { return std::floor(x); }); break;
+
+        case Op::ADD: binary(a, b, length, [](float x, float y) { return x + y; }); break;
+        case Op::SUB: binary(a, b, length, [](float x, float y) { return x - y; }); break;
+        case Op::MUL: binary(a, b, length, [](float x, float y) { return x * y; }); break;
+        case Op::DIV: binary(a, b, length, [](float x, float y) { return x / y; }); break;
+        case Op::POW: binary(a, b, length, [](float x, float y) { return std::pow(x, y); }); break;
+        case Op::MIN: binary(a, b, length, [](float x, float y) { return y < x ? y : x; }); break;
+        case Op::MAX: binary(a, b, length, [](float x, float y) { return x < y ? y : x; }); break;
+        case Op::LT: binary(a, b, length, [](float x, float y) { return x < y ? 1.0f : 0.0f; }); break;
+        case Op::LE: binary(a, b, length, [](float x, float y) { return x <= y ? 1.0f : 0.0f; }); break;
+        case Op::GT: binary(a, b, length, [](float x, float y) { return x > y ? 1.0f : 0.0f; }); break;
+        case Op::GE: binary(a, b, length, [](float x, float y) { return x >= y ? 1.0f : 0.0f; }); break;
+        case Op::EQ: binary(a, b, length, [](float x, float y) { return x == y ? 1.0f : 0.0f; }); break;
+        case Op::NE: binary(a, b, length, [](float x, float y) { return x != y ? 1.0f : 0.0f; }); break;
+        case Op::AND: binary(a, b, length, [](float x, float y) { return x != 0.0f && y != 0.0f ? 1.0f : 0.0f; }); break;
+        case Op::OR: binary(a, b, length, [](float x, float y) { return x != 0.0f || y != 0.0f ? 1.0f : 0.0f; }); break;
+
+        case Op::WHERE:
+            for(std::size_t j = 0; j < length; ++j) {
+                a[j] = a[j] != 0.0f ? b[j] : c[j];
+            }
+            break;
+        case Op::CLIP:
+            for(std::size_t j = 0; j < length; ++j) {
+                a[j] = std::min(std::max(a[j], b[j]), c[j]);
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    std::copy(stack, stack + length, out);
+}
@@ -0,0 +1,97 @@
+#ifndef PYTHON_EXPRESSION_H
+#define PYTHON_EXPRESSION_H
+
+/// SYSTEM
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace csapex
+{
+
+/**
+ * @brief The Expression is a restricted, element wise Python expression over the
+ *        inputs a, b, c, ... of a node, e.g. "(a - b) * 0.5 + 10" or "where(a.z > 0, a.z, 0)".
+ *        Every input can also be named in0, in1, in2, ..., which is required beyond z.
+ *
+ * The expression is compiled once into a stack program. Evaluation runs the program
+ * on chunks of elements, so that every instruction is a simple loop over contiguous
+ * floats, and distributes the chunks over multiple threads.
+ */
+class Expression
+{
+public:
+    struct Variable
+    {
+        int input;
+        //! point cloud field, empty for images and scalars
+        std::string field;
+
+        bool operator == (const Variable& other) const;
+    };
+
+    struct Source
+    {
+        enum class Type {
+            SCALAR, UINT8, INT8, UINT16, INT16, INT32, UINT32, FLOAT32, FLOAT64
+        };
+
+        Type type;
+        const std::uint8_t* data;
+        std::ptrdiff_t stride;
+        float value;
+
+        static Source scalar(float value);
+        static Source array(Type type, const void* data, std::ptrdiff_t stride);
+    };
+
+public:
+    Expression();
+
+    //! throws std::runtime_error naming the position of the first error
+    static Expression parse(const std::string& text);
+
+    //! the name an input is reported with, a to z for the first inputs, in26, in27, ... afterwards
+    static std::string inputName(int input);
+    //! the index of the input called name, or -1 if it does not name an input
+    static int inputIndex(const std::string& name);
+
+    bool empty() const;
+    const std::vector<Variable>& getVariables() const;
+
+    //! evaluates the elements [0, n) into out, the sources are ordered like the variables
+    void evaluate(const std::vector<Source>& sources, std::size_t n, float* out) const;
+
+private:
+    enum class Op {
+        LOAD, CONSTANT,
+        NEG, NOT, ABS, SQRT, EXP, LOG, SIN, COS, FLOOR,
+        ADD, SUB, MUL, DIV, POW, MIN, MAX,
+        LT, LE, GT, GE, EQ, NE, AND, OR,
+        WHERE, CLIP
+    };
+
+    struct Instruction
+    {
+        Op op;
+        int argument;
+        float value;
+    };
+
+    class Parser;
+
+    static int arity(Op op);
+
+    void evaluateChunk(const std::vector<Source>& sources, std::size_t begin, std::size_t length,
+                       float* stack, float* out) const;
+
+private:
+    std::vector<Instruction> program_;
+    std::vector<Variable> variables_;
+    std::size_t stack_depth_;
+};
+
+}
+
+#endif // PYTHON_EXPRESSION_H
@@ -0,0 +1,348 @@
+/// HEADER
+#include "python_expression_node.h"
+
+/// PROJECT
+#include <csapex/model/node_handle.h>
+#include <csapex/model/node_modifier.h>
+#include <csapex/msg/any_message.h>
+#include <csapex/msg/generic_value_message.hpp>
+#include <csapex/msg/input.h>
+#include <csapex/msg/io.h>
+#include <csapex/msg/output.h>
+#include <csapex/param/parameter_factory.h>
+#include <csapex/utility/register_apex_plugin.h>
+#include <csapex_opencv/cv_mat_message.h>
+#include <csapex_point_cloud/msg/point_cloud_message.h>
+
+/// COMPONENT
+#include "python_point_fields.h"
+
+/// SYSTEM
+#include <boost/make_shared.hpp>
+#include <boost/variant.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+CSAPEX_REGISTER_CLASS(csapex::PythonExpressionNode, csapex::Node)
+
+using namespace csapex;
+
+namespace
+{
+template <typename PointT>
+using CloudPtr = boost::shared_ptr<pcl::PointCloud<PointT>>;
+
+std::string name(int input)
+{
+    return Expression::inputName(input);
+}
+
+Expression::Source::Type sourceType(PointFieldType type)
+{
+    switch(type) {
+    case PointFieldType::UINT8: return Expression::Source::Type::UINT8;
+    case PointFieldType::UINT32: return Expression::Source::Type::UINT32;
+    default: return Expression::Source::Type::FLOAT32;
+    }
+}
+
+Expression::Source::Type sourceType(int depth)
+{
+    switch(depth) {
+    case CV_8U: return Expression::Source::Type::UINT8;
+    case CV_8S: return Expression::Source::Type::INT8;
+    case CV_16U: return Expression::Source::Type::UINT16;
+    case CV_16S: return Expression::Source::Type::INT16;
+    case CV_32S: return Expression::Source::Type::INT32;
+    case CV_32F: return Expression::Source::Type::FLOAT32;
+    case CV_64F: return Expression::Source::Type::FLOAT64;
+    default: throw std::runtime_error("unsupported image depth");
+    }
+}
+
+template <typename T>
+bool scalar(const TokenDataConstPtr& message, float& value)
+{
+    if(auto generic = std::dynamic_pointer_cast<const connection_types::GenericValueMessage<T>>(message)) {
+        value = static_cast<float>(generic->value);
+        return true;
+    }
+    return false;
+}
+
+template <typename T>
+T saturate(float value, float min, float max)
+{
+    if(!(value > min)) {
+        return static_cast<T>(min);
+    }
+    return static_cast<T>(std::round(std::min(value, max)));
+}
+
+void store(const PointField& field, float value, std::uint8_t* point)
+{
+    std::uint8_t* target = point + field.offset;
+    switch(field.type) {
+    case PointFieldType::UINT8: {
+        std::uint8_t v = saturate<std::uint8_t>(value, 0.f, 255.f);
+        std::memcpy(target, &v, sizeof(v));
+        break;
+    }
+    case PointFieldType::UINT32: {
+        std::uint32_t v = saturate<std::uint32_t>(value, 0.f, 4294967040.f);
+        std::memcpy(target, &v, sizeof(v));
+        break;
+    }
+    default:
+        std::memcpy(target, &value, sizeof(value));
+        break;
+    }
+}
+
+struct CloudSource : public boost::static_visitor<void>
+{
+    CloudSource(const std::string& field, Expression::Source& source, std::size_t& size)
+        : field(field), source(source), size(size)
+    {}
+
+    template <typename PointT>
+    void operator () (const CloudPtr<PointT>& cloud) const
+    {
+        if(!cloud) {
+            throw std::runtime_error("the message does not contain a point cloud");
+        }
+        for(const PointField& f : pointFields<PointT>()) {
+            if(field == f.name) {
+                const std::uint8_t* points = reinterpret_cast<const std::uint8_t*>(cloud->points.data());
+                source = Expression::Source::array(sourceType(f.type), points + f.offset, sizeof(PointT));
+                size = cloud->points.size();
+                return;
+            }
+        }
+        throw std::runtime_error("the point type has no field '" + field + "'");
+    }
+
+    const std::string& field;
+    Expression::Source& source;
+    std::size_t& size;
+};
+
+// keeps the points with a non-zero result, or writes the result into a field of a copy
+struct CloudResult : public boost::static_visitor<void>
+{
+    CloudResult(const std::vector<float>& values, const std::string& field, connection_types::PointCloudMessage::variant& result)
+        : values(values), field(field), result(result)
+    {}
+
+    template <typename PointT>
+    void operator () (const CloudPtr<PointT>& cloud) const
+    {
+        CloudPtr<PointT> res = boost::make_shared<pcl::PointCloud<PointT>>();
+        res->header = cloud->header;
+
+        if(field.empty()) {
+            res->points.reserve(cloud->points.size());
+            for(std::size_t i = 0; i < cloud->points.size(); ++i) {
+                if(values[i] != 0.f) {
+                    res->points.push_back(cloud->points[i]);
+                }
+            }
+            res->width = res->points.size();
+            res->height = 1;
+            res->is_dense = cloud->is_dense;
+
+        } else {
+            const std::vector<PointField> fields = pointFields<PointT>();
+            auto pos = std::find_if(fields.begin(), fields.end(), [this](const PointField& f) { return field == f.name; });
+            if(pos == fields.end()) {
+                throw std::runtime_error("the point type has no field '" + field + "'");
+            }
+
+            *res = *cloud;
+            for(std::size_t i = 0; i < res->points.size(); ++i) {
+                store(*pos, values[i], reinterpret_cast<std::uint8_t*>(&res->points[i]));
+            }
+        }
+
+        result = res;
+    }
+
+    const std::vector<float>& values;
+    const std::string& field;
+    connection_types::PointCloudMessage::variant& result;
+};
+}
+
+PythonExpressionNode::PythonExpressionNode()
+    : out_(nullptr), output_depth_(CV_32F), assign_to_field_(false)
+{
+}
+
+void PythonExpressionNode::setup(NodeModifier& node_modifier)
+{
+    setupVariadic(node_modifier);
+
+    out_ = node_modifier.addOutput(makeEmpty<connection_types::AnyMessage>(), "result");
+}
+
+void PythonExpressionNode::setupParameters(Parameterizable &parameters)
+{
+    setupVariadicParameters(parameters);
+
+    parameters.addParameter(param::factory::declareText("expression", "a"),
+                            [this](param::Parameter* p) {
+        setExpression(p->as<std::string>());
+    });
+    parameters.addParameter(param::factory::declareOutputText("expression/status"));
+
+    parameters.addParameter(param::factory::declareParameterSet("output depth",
+                                                                std::map<std::string, int> {
+                                                                    {"float", CV_32F},
+                                                                    {"8 bit (saturated)", CV_8U},
+                                                                    {"16 bit (saturated)", CV_16U}
+                                                                },
+                                                                static_cast<int>(CV_32F)),
+                            output_depth_);
+
+    parameters.addParameter(param::factory::declareParameterSet("cloud/result",
+                                                                std::map<std::string, int> {{"filter points", 0}, {"assign to field", 1}},
+                                                                0),
+                            [this](param::Parameter* p) {
+        assign_to_field_ = p->as<int>() == 1;
+    });
+    parameters.addConditionalParameter(param::factory::declareText("cloud/field", "intensity"),
+                                       [this]() { return assign_to_field_; },
+                                       [this](param::Parameter* p) {
+        field_ = p->as<std::string>();
+    });
+}
+
+void PythonExpressionNode::setExpression(const std::string& text)
+{
+    std::shared_ptr<const Expression> expression;
+    std::string error;
+    try {
+        expression = std::make_shared<const Expression>(Expression::parse(text));
+    } catch(const std::runtime_error& e) {
+        error = e.what();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(expression_mutex_);
+        expression_ = expression;
+        expression_error_ = error;
+    }
+
+    setParameter("expression/status", error.empty() ? std::string("ok") : error);
+}
+
+void PythonExpressionNode::process()
+{
+    std::shared_ptr<const Expression> expression;
+    {
+        std::unique_lock<std::mutex> lock(expression_mutex_);
+        if(!expression_) {
+            throw std::runtime_error(expression_error_.empty() ? std::string("no expression") : expression_error_);
+        }
+        expression = expression_;
+    }
+
+    std::vector<TokenDataConstPtr> messages;
+    for(const InputPtr& input : variadic_inputs_) {
+        if(node_handle_->isParameterInput(input->getUUID())) {
+            continue;
+        }
+        messages.push_back(msg::hasMessage(input.get()) ? msg::getMessage(input.get()) : TokenDataConstPtr());
+    }
+
+    std::shared_ptr<const connection_types::CvMatMessage> first_image;
+    std::shared_ptr<const connection_types::PointCloudMessage> first_cloud;
+    std::vector<cv::Mat> images;
+    std::vector<Expression::Source> sources;
+    std::size_t n = 1;
+
+    for(const Expression::Variable& variable : expression->getVariables()) {
+        if(variable.input >= static_cast<int>(messages.size()) || !messages[variable.input]) {
+            throw std::runtime_error("input '" + name(variable.input) + "' has no message");
+        }
+        const TokenDataConstPtr& message = messages[variable.input];
+
+        if(auto image = std::dynamic_pointer_cast<const connection_types::CvMatMessage>(message)) {
+            if(!variable.field.empty()) {
+                throw std::runtime_error("input '" + name(variable.input) + "' is an image and has no fields");
+            }
+            if(first_cloud) {
+                throw std::runtime_error("images and point clouds cannot be combined");
+            }
+            cv::Mat mat = image->value.isContinuous() ? image->value : image->value.clone();
+            if(!first_image) {
+                first_image = image;
+                n = mat.total() * mat.channels();
+            } else if(mat.rows != first_image->value.rows || mat.cols != first_image->value.cols ||
+                      mat.channels() != first_image->value.channels()) {
+                throw std::runtime_error("input '" + name(variable.input) + "' does not match the size of the other images");
+            }
+            images.push_back(mat);
+            sources.push_back(Expression::Source::array(sourceType(mat.depth()), mat.data, mat.elemSize1()));
+
+        } else if(auto cloud = std::dynamic_pointer_cast<const connection_types::PointCloudMessage>(message)) {
+            if(variable.field.empty()) {
+                throw std::runtime_error("input '" + name(variable.input) + "' is a point cloud, select a field like "
+                                         + name(variable.input) + ".z");
+            }
+            if(first_image) {
+                throw std::runtime_error("images and point clouds cannot be combined");
+            }
+            Expression::Source source = Expression::Source::scalar(0.f);
+            std::size_t size = 0;
+            CloudSource visitor(variable.field, source, size);
+            boost::apply_visitor(visitor, cloud->value);
+            if(!first_cloud) {
+                first_cloud = cloud;
+                n = size;
+            } else if(size != n) {
+                throw std::runtime_error("input '" + name(variable.input) + "' does not match the size of the other clouds");
+            }
+            sources.push_back(source);
+
+        } else {
+            float value = 0.f;
+            if(!scalar<double>(message, value) && !scalar<float>(message, value) &&
+                    !scalar<int>(message, value) && !scalar<bool>(message, value)) {
+                throw std::runtime_error("input '" + name(variable.input) + "' is neither an image, a point cloud nor a number");
+            }
+            sources.push_back(Expression::Source::scalar(value));
+        }
+    }
+
+    if(first_image) {
+        const cv::Mat& reference = first_image->value;
+        cv::Mat values(reference.rows, reference.cols, CV_32FC(reference.channels()));
+        expression->evaluate(sources, n, values.ptr<float>());
+
+        auto result = std::make_shared<connection_types::CvMatMessage>(first_image->getEncoding(), first_image->frame_id,
+                                                                       first_image->stamp_micro_seconds);
+        if(output_depth_ == CV_32F) {
+            result->value = values;
+        } else {
+            values.convertTo(result->value, output_depth_);
+        }
+        msg::publish(out_, result);
+
+    } else if(first_cloud) {
+        std::vector<float> values(n);
+        expression->evaluate(sources, n, values.data());
+
+        auto result = std::make_shared<connection_types::PointCloudMessage>(first_cloud->frame_id, first_cloud->stamp_micro_seconds);
+        CloudResult visitor(values, assign_to_field_ ? field_ : std::string(), result->value);
+        boost::apply_visitor(visitor, first_cloud->value);
+        msg::publish(out_, result);
+
+    } else {
+        float value = 0.f;
+        expression->evaluate(sources, 1, &value);
+        msg::publish(out_, static_cast<double>(value));
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef PYTHON_EXPRESSION_NODE_H
+#define PYTHON_EXPRESSION_NODE_H
+
+/// PROJECT
+#include <csapex/model/node.h>
+#include <csapex/model/variadic_io.h>
+
+/// COMPONENT
+#include "python_expression.h"
+
+/// SYSTEM
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonExpressionNode evaluates a restricted Python expression element wise
+ *        over the pixels of images or the fields of point clouds, e.g. "(a - b) * 0.5".
+ *        The expression is compiled once, no interpreter is involved per message.
+ */
+class PythonExpressionNode : public Node, public VariadicInputs
+{
+public:
+    PythonExpressionNode();
+
+    virtual void setup(csapex::NodeModifier& node_modifier) override;
+    virtual void setupParameters(Parameterizable &parameters) override;
+
+    virtual void process() override;
+
+private:
+    void setExpression(const std::string& text);
+
+private:
+    Output* out_;
+
+    std::mutex expression_mutex_;
+    std::shared_ptr<const Expression> expression_;
+    std::string expression_error_;
+
+    int output_depth_;
+    bool assign_to_field_;
+    std::string field_;
+};
+
+}
+
+#endif // PYTHON_EXPRESSION_NODE_H
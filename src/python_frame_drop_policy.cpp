@@ -0,0 +1,163 @@
+/// HEADER
+#include "python_frame_drop_policy.h"
+
+/// PROJECT
+#include <csapex/msg/io.h>
+#include <csapex/msg/input.h>
+#include <csapex/msg/message.h>
+
+/// SYSTEM
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+
+using namespace csapex;
+
+namespace
+{
+// weight of the newest sample in the moving average of the processing duration
+const double DURATION_SMOOTHING = 0.1;
+
+connection_types::MessageConstPtr stamped_message(const InputPtr& input)
+{
+    if(!msg::hasMessage(input.get())) {
+        return nullptr;
+    }
+    auto message = std::dynamic_pointer_cast<connection_types::Message const>(msg::getMessage(input.get()));
+    if(!message || message->stamp_micro_seconds == 0) {
+        return nullptr;
+    }
+    return message;
+}
+}
+
+std::map<std::string, int> PythonFrameDropPolicy::policyNames()
+{
+    return {
+        {"keep all", static_cast<int>(Policy::KEEP_ALL)},
+        {"drop older than max age", static_cast<int>(Policy::MAX_AGE)},
+        {"keep newest", static_cast<int>(Policy::KEEP_NEWEST)}
+    };
+}
+
+PythonFrameDropPolicy::PythonFrameDropPolicy()
+    : policy_(static_cast<int>(Policy::KEEP_ALL)), max_age_us_(100000),
+      mean_duration_us_(0.0), frames_(0), dropped_(0), reported_frames_(0)
+{
+}
+
+void PythonFrameDropPolicy::setPolicy(Policy policy)
+{
+    policy_ = static_cast<int>(policy);
+}
+
+void PythonFrameDropPolicy::setMaxAge(std::chrono::milliseconds max_age)
+{
+    max_age_us_ = std::chrono::duration_cast<std::chrono::microseconds>(max_age).count();
+}
+
+bool PythonFrameDropPolicy::shouldDrop(const std::vector<InputPtr> &inputs)
+{
+    ++frames_;
+
+    bool drop = false;
+    switch(static_cast<Policy>(policy_.load())) {
+    case Policy::MAX_AGE:
+        drop = olderThan(inputs, static_cast<double>(max_age_us_));
+        break;
+    case Policy::KEEP_NEWEST:
+        drop = newerWaiting(inputs);
+        break;
+    default:
+        break;
+    }
+
+    if(drop) {
+        ++dropped_;
+    }
+    return drop;
+}
+
+bool PythonFrameDropPolicy::olderThan(const std::vector<InputPtr> &inputs, double max_age_us) const
+{
+    if(max_age_us <= 0.0) {
+        return false;
+    }
+
+    std::int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+
+    for(const InputPtr& input : inputs) {
+        if(auto message = stamped_message(input)) {
+            std::int64_t age_us = now_us - static_cast<std::int64_t>(message->stamp_micro_seconds);
+            if(age_us > max_age_us) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool PythonFrameDropPolicy::newerWaiting(const std::vector<InputPtr> &inputs)
+{
+    std::int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    baseline_delay_us_.resize(inputs.size(), std::numeric_limits<double>::infinity());
+    last_stamp_us_.resize(inputs.size(), 0);
+    interval_us_.resize(inputs.size(), std::numeric_limits<double>::infinity());
+
+    // the arrival time and the stamp come from different clocks, only the delay beyond the
+    // baseline is meaningful: it is the time a message waited in the queue of the input. The
+    // baseline only ever decreases, so that a node that is persistently too slow keeps dropping.
+    // Once the wait exceeds the interval between two messages, a newer one has been stamped.
+    bool waiting = false;
+    for(std::size_t i = 0; i < inputs.size(); ++i) {
+        auto message = stamped_message(inputs[i]);
+        if(!message) {
+            continue;
+        }
+
+        const std::uint64_t stamp_us = message->stamp_micro_seconds;
+        if(stamp_us > last_stamp_us_[i] && last_stamp_us_[i] != 0) {
+            interval_us_[i] = std::min(interval_us_[i], static_cast<double>(stamp_us - last_stamp_us_[i]));
+        }
+        last_stamp_us_[i] = stamp_us;
+
+        double delay_us = static_cast<double>(now_us) - static_cast<double>(stamp_us);
+        double& baseline_us = baseline_delay_us_[i];
+        if(delay_us < baseline_us) {
+            baseline_us = delay_us;
+        } else if(delay_us - baseline_us > interval_us_[i]) {
+            waiting = true;
+        }
+    }
+
+    return waiting;
+}
+
+void PythonFrameDropPolicy::processed(std::chrono::steady_clock::duration duration)
+{
+    double us = std::chrono::duration<double, std::micro>(duration).count();
+    if(mean_duration_us_ <= 0.0) {
+        mean_duration_us_ = us;
+    } else {
+        mean_duration_us_ += DURATION_SMOOTHING * (us - mean_duration_us_);
+    }
+}
+
+bool PythonFrameDropPolicy::pollReport(std::string &report)
+{
+    auto now = std::chrono::steady_clock::now();
+    if(frames_ == reported_frames_ || now - last_report_ < std::chrono::seconds(1)) {
+        return false;
+    }
+    reported_frames_ = frames_;
+    last_report_ = now;
+
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer), "%zu of %zu frames dropped, processing takes %.1f ms",
+                  dropped_, frames_, mean_duration_us_ / 1000.0);
+    report = buffer;
+    return true;
+}
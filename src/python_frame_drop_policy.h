@@ -0,0 +1,78 @@
+#ifndef PYTHON_FRAME_DROP_POLICY_H
+#define PYTHON_FRAME_DROP_POLICY_H
+
+/// PROJECT
+#include <csapex/model/node.h>
+
+/// SYSTEM
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonFrameDropPolicy decides, before the interpreter is entered,
+ *        whether the current inputs are too old to be worth processing.
+ */
+class PythonFrameDropPolicy
+{
+public:
+    enum class Policy {
+        KEEP_ALL = 0,
+        MAX_AGE = 1,
+        KEEP_NEWEST = 2
+    };
+
+    static std::map<std::string, int> policyNames();
+
+public:
+    PythonFrameDropPolicy();
+
+    void setPolicy(Policy policy);
+    void setMaxAge(std::chrono::milliseconds max_age);
+
+    /**
+     * @brief shouldDrop checks the stamps of all messages on the given inputs.
+     *
+     * MAX_AGE compares them to the wall clock. KEEP_NEWEST only looks at how much
+     * later than usual a message arrives, so it works with any clock the stamps are
+     * taken from: if it waited longer than the interval between two messages of its
+     * input, a newer one has been stamped meanwhile and the message is dropped.
+     */
+    bool shouldDrop(const std::vector<InputPtr>& inputs);
+
+    //! updates the estimate of the processing duration
+    void processed(std::chrono::steady_clock::duration duration);
+
+    bool pollReport(std::string& report);
+
+private:
+    bool olderThan(const std::vector<InputPtr>& inputs, double max_age_us) const;
+    bool newerWaiting(const std::vector<InputPtr>& inputs);
+
+private:
+    std::atomic<int> policy_;
+    std::atomic<long> max_age_us_;
+
+    double mean_duration_us_;
+
+    // per input, the smallest difference between arrival time and stamp seen so far
+    std::vector<double> baseline_delay_us_;
+    // per input, the last stamp and the shortest interval between two stamps seen so far
+    std::vector<std::uint64_t> last_stamp_us_;
+    std::vector<double> interval_us_;
+
+    std::size_t frames_;
+    std::size_t dropped_;
+    std::size_t reported_frames_;
+    std::chrono::steady_clock::time_point last_report_;
+};
+
+}
+
+#endif // PYTHON_FRAME_DROP_POLICY_H
@@ -0,0 +1,222 @@
+/// HEADER
+#include "python_gc_policy.h"
+
+/// SYSTEM
+#include <cstdio>
+
+using namespace csapex;
+namespace bp = boost::python;
+
+namespace
+{
+// with collection disabled, memory must not grow without bound if the graph never idles
+const long DEFERRED_COLLECTION_LIMIT = 100;
+}
+
+std::map<std::string, int> PythonGcPolicy::policyNames()
+{
+    return {
+        {"default", static_cast<int>(Policy::DEFAULT)},
+        {"freeze after setup", static_cast<int>(Policy::FREEZE_AFTER_SETUP)},
+        {"disabled during process", static_cast<int>(Policy::DISABLED_DURING_PROCESS)},
+        {"budgeted", static_cast<int>(Policy::BUDGETED)}
+    };
+}
+
+PythonGcPolicy::PythonGcPolicy()
+    : policy_(static_cast<int>(Policy::DEFAULT)), applied_policy_(static_cast<int>(Policy::DEFAULT)),
+      setup_done_(false), frozen_(false),
+      collections_(0), last_pause_ms_(0.0), max_pause_ms_(0.0), total_pause_ms_(0.0),
+      reported_collections_(0)
+{
+}
+
+void PythonGcPolicy::setPolicy(Policy policy)
+{
+    policy_ = static_cast<int>(policy);
+}
+
+PythonGcPolicy::Policy PythonGcPolicy::getPolicy() const
+{
+    return static_cast<Policy>(policy_.load());
+}
+
+void PythonGcPolicy::setErrorReport(const std::function<void()> &report)
+{
+    report_error_ = report;
+}
+
+void PythonGcPolicy::reportError()
+{
+    if(report_error_) {
+        report_error_();
+    } else {
+        PyErr_Print();
+    }
+}
+
+void PythonGcPolicy::ensureModule()
+{
+    if(gc_.is_none()) {
+        gc_ = bp::import("gc");
+    }
+}
+
+void PythonGcPolicy::beforeCall()
+{
+    int policy = policy_;
+    bool freeze_pending = policy == static_cast<int>(Policy::FREEZE_AFTER_SETUP) && setup_done_ && !frozen_;
+    if(policy == applied_policy_ && !freeze_pending) {
+        return;
+    }
+
+    try {
+        ensureModule();
+
+        if(frozen_ && policy != static_cast<int>(Policy::FREEZE_AFTER_SETUP)) {
+            if(PyObject_HasAttrString(gc_.ptr(), "unfreeze")) {
+                gc_.attr("unfreeze")();
+            }
+            frozen_ = false;
+        }
+
+        switch(static_cast<Policy>(policy)) {
+        case Policy::DEFAULT:
+            gc_.attr("enable")();
+            break;
+        case Policy::FREEZE_AFTER_SETUP:
+            gc_.attr("enable")();
+            if(freeze_pending) {
+                freeze();
+            }
+            break;
+        case Policy::DISABLED_DURING_PROCESS:
+        case Policy::BUDGETED:
+            gc_.attr("disable")();
+            break;
+        }
+
+        applied_policy_ = policy;
+
+    } catch(const bp::error_already_set&) {
+        reportError();
+    }
+}
+
+void PythonGcPolicy::afterSetup()
+{
+    setup_done_ = true;
+    beforeCall();
+}
+
+void PythonGcPolicy::afterProcess()
+{
+    if(applied_policy_ != static_cast<int>(Policy::BUDGETED) &&
+            applied_policy_ != static_cast<int>(Policy::DISABLED_DURING_PROCESS)) {
+        return;
+    }
+
+    try {
+        ensureModule();
+
+        bp::object count = gc_.attr("get_count")();
+        bp::object threshold = gc_.attr("get_threshold")();
+
+        if(applied_policy_ == static_cast<int>(Policy::BUDGETED)) {
+            // mimic the interpreter: collect the oldest generation whose threshold is crossed
+            int generation = -1;
+            for(int g = 0; g < 3; ++g) {
+                long t = bp::extract<long>(threshold[g]);
+                long c = bp::extract<long>(count[g]);
+                if(t > 0 && c >= t) {
+                    generation = g;
+                }
+            }
+            if(generation >= 0) {
+                collect(generation);
+            }
+
+        } else {
+            long t = bp::extract<long>(threshold[0]);
+            long c = bp::extract<long>(count[0]);
+            if(t > 0 && c >= DEFERRED_COLLECTION_LIMIT * t) {
+                collect(2);
+            }
+        }
+
+    } catch(const bp::error_already_set&) {
+        reportError();
+    }
+}
+
+void PythonGcPolicy::idle()
+{
+    if(applied_policy_ != static_cast<int>(Policy::DISABLED_DURING_PROCESS)) {
+        return;
+    }
+
+    try {
+        ensureModule();
+        collect(2);
+
+    } catch(const bp::error_already_set&) {
+        reportError();
+    }
+}
+
+void PythonGcPolicy::collectAll()
+{
+    try {
+        ensureModule();
+        collect(2);
+
+    } catch(const bp::error_already_set&) {
+        reportError();
+    }
+}
+
+void PythonGcPolicy::release()
+{
+    gc_ = bp::object();
+}
+
+void PythonGcPolicy::freeze()
+{
+    collect(2);
+    if(PyObject_HasAttrString(gc_.ptr(), "freeze")) {
+        gc_.attr("freeze")();
+    }
+    frozen_ = true;
+}
+
+void PythonGcPolicy::collect(int generation)
+{
+    auto start = std::chrono::steady_clock::now();
+    gc_.attr("collect")(generation);
+    std::chrono::duration<double, std::milli> pause = std::chrono::steady_clock::now() - start;
+
+    double ms = pause.count();
+    last_pause_ms_ = ms;
+    if(ms > max_pause_ms_) {
+        max_pause_ms_ = ms;
+    }
+    total_pause_ms_ = total_pause_ms_ + ms;
+    ++collections_;
+}
+
+bool PythonGcPolicy::pollReport(std::string &report)
+{
+    std::size_t collections = collections_;
+    auto now = std::chrono::steady_clock::now();
+    if(collections == reported_collections_ || now - last_report_ < std::chrono::seconds(1)) {
+        return false;
+    }
+    reported_collections_ = collections;
+    last_report_ = now;
+
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer), "%zu collections, last %.1f ms, max %.1f ms, total %.1f ms",
+                  collections, last_pause_ms_.load(), max_pause_ms_.load(), total_pause_ms_.load());
+    report = buffer;
+    return true;
+}
@@ -0,0 +1,85 @@
+#ifndef PYTHON_GC_POLICY_H
+#define PYTHON_GC_POLICY_H
+
+/// SYSTEM
+#include <boost/python.hpp>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonGcPolicy decides when the cyclic garbage collector of an
+ *        interpreter may run. All methods except setPolicy and pollReport
+ *        require the GIL of the interpreter the policy belongs to.
+ */
+class PythonGcPolicy
+{
+public:
+    enum class Policy {
+        DEFAULT = 0,
+        FREEZE_AFTER_SETUP = 1,
+        DISABLED_DURING_PROCESS = 2,
+        BUDGETED = 3
+    };
+
+    static std::map<std::string, int> policyNames();
+
+public:
+    PythonGcPolicy();
+
+    void setPolicy(Policy policy);
+    Policy getPolicy() const;
+
+    //! called with the python error set if the gc module fails, the error is printed otherwise
+    void setErrorReport(const std::function<void()>& report);
+
+    //! applies policy changes, called before entering the script
+    void beforeCall();
+    //! marks the script as set up, freezes all objects that exist up to now if requested
+    void afterSetup();
+    //! collects if a generation threshold was crossed during the last message (budgeted)
+    void afterProcess();
+    //! collects everything that was deferred (disabled during process)
+    void idle();
+    //! collects all generations regardless of the policy, to get back below a memory budget
+    void collectAll();
+
+    void release();
+
+    /**
+     * @brief pollReport formats the pause statistics, at most once per second and only if they changed
+     */
+    bool pollReport(std::string& report);
+
+private:
+    void ensureModule();
+    void freeze();
+    void collect(int generation);
+    void reportError();
+
+private:
+    std::atomic<int> policy_;
+    int applied_policy_;
+    bool setup_done_;
+    bool frozen_;
+
+    boost::python::object gc_;
+    std::function<void()> report_error_;
+
+    std::atomic<std::size_t> collections_;
+    std::atomic<double> last_pause_ms_;
+    std::atomic<double> max_pause_ms_;
+    std::atomic<double> total_pause_ms_;
+
+    std::size_t reported_collections_;
+    std::chrono::steady_clock::time_point last_report_;
+};
+
+}
+
+#endif // PYTHON_GC_POLICY_H
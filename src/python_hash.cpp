@@ -0,0 +1,102 @@
+/// HEADER
+#include "python_hash.h"
+
+/// SYSTEM
+#include <cstring>
+
+namespace
+{
+const std::uint64_t PRIME1 = 11400714785074694791ull;
+const std::uint64_t PRIME2 = 14029467366897019727ull;
+const std::uint64_t PRIME3 = 1609587929392839161ull;
+const std::uint64_t PRIME4 = 9650029242287828579ull;
+const std::uint64_t PRIME5 = 2870177450012600261ull;
+
+inline std::uint64_t rotl(std::uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline std::uint64_t read64(const std::uint8_t* p)
+{
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint32_t read32(const std::uint8_t* p)
+{
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint64_t xxh_round(std::uint64_t acc, std::uint64_t input)
+{
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+inline std::uint64_t merge(std::uint64_t acc, std::uint64_t value)
+{
+    acc ^= xxh_round(0, value);
+    return acc * PRIME1 + PRIME4;
+}
+}
+
+namespace csapex
+{
+std::uint64_t xxh64(const void* data, std::size_t length, std::uint64_t seed)
+{
+    const std::uint8_t* p = static_cast<const std::uint8_t*>(data);
+    const std::uint8_t* end = p + length;
+    std::uint64_t h;
+
+    if(length >= 32) {
+        std::uint64_t v1 = seed + PRIME1 + PRIME2;
+        std::uint64_t v2 = seed + PRIME2;
+        std::uint64_t v3 = seed;
+        std::uint64_t v4 = seed - PRIME1;
+        const std::uint8_t* limit = end - 32;
+        do {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+            p += 32;
+        } while(p <= limit);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge(h, v1);
+        h = merge(h, v2);
+        h = merge(h, v3);
+        h = merge(h, v4);
+    } else {
+        h = seed + PRIME5;
+    }
+
+    h += static_cast<std::uint64_t>(length);
+
+    for(; p + 8 <= end; p += 8) {
+        h ^= xxh_round(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+    }
+    if(p + 4 <= end) {
+        h ^= static_cast<std::uint64_t>(read32(p)) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for(; p < end; ++p) {
+        h ^= (*p) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+}
@@ -0,0 +1,19 @@
+#ifndef PYTHON_HASH_H
+#define PYTHON_HASH_H
+
+/// SYSTEM
+#include <cstddef>
+#include <cstdint>
+
+namespace csapex
+{
+
+/**
+ * @brief xxh64 computes the XXH64 hash of a buffer, chaining is done by passing
+ *        the previous hash as seed
+ */
+std::uint64_t xxh64(const void* data, std::size_t length, std::uint64_t seed);
+
+}
+
+#endif // PYTHON_HASH_H
@@ -0,0 +1,245 @@
+/// HEADER
+#include "python_history.h"
+
+/// PROJECT
+#include <csapex/msg/input.h>
+#include <csapex/msg/io.h>
+
+/// COMPONENT
+#include "python_input_arrays.h"
+
+/// SYSTEM
+#include <algorithm>
+#include <cstring>
+
+using namespace csapex;
+namespace bp = boost::python;
+
+namespace
+{
+thread_local PythonHistory* g_current_history = nullptr;
+
+// number of bytes the dimensions from dim onwards span, if they are stored without gaps, 0 otherwise
+std::size_t contiguous_bytes(const ArrayView& view, std::size_t dim, std::size_t item_size)
+{
+    std::size_t bytes = item_size;
+    for(std::size_t d = view.shape.size(); d > dim; --d) {
+        if(!view.strides.empty() && view.strides[d - 1] != static_cast<Py_ssize_t>(bytes)) {
+            return 0;
+        }
+        bytes *= view.shape[d - 1];
+    }
+    return bytes;
+}
+
+void copy_strided(const std::uint8_t* src, const ArrayView& view, std::size_t dim, std::size_t item_size, std::uint8_t*& dst)
+{
+    std::size_t bytes = contiguous_bytes(view, dim, item_size);
+    if(bytes > 0) {
+        std::memcpy(dst, src, bytes);
+        dst += bytes;
+        return;
+    }
+
+    for(Py_ssize_t i = 0; i < view.shape[dim]; ++i) {
+        copy_strided(src + i * view.strides[dim], view, dim + 1, item_size, dst);
+    }
+}
+
+bp::object history(Input* input, std::size_t n)
+{
+    PythonHistory* history = PythonHistory::current();
+    if(!history) {
+        PyErr_SetString(PyExc_RuntimeError, "csapex.history can only be used while a node is executing");
+        bp::throw_error_already_set();
+    }
+    if(n == 0) {
+        PyErr_SetString(PyExc_ValueError, "the history length has to be positive");
+        bp::throw_error_already_set();
+    }
+
+    return history->record(input, n);
+}
+}
+
+PythonHistory::Scope::Scope(PythonHistory *history)
+    : previous_(g_current_history)
+{
+    g_current_history = history;
+}
+
+PythonHistory::Scope::~Scope()
+{
+    g_current_history = previous_;
+}
+
+PythonHistory* PythonHistory::current()
+{
+    return g_current_history;
+}
+
+PythonHistory::Ring::Ring()
+    : item_size(0), frame_bytes(0), capacity(0), count(0), next(0), ragged(false)
+{
+}
+
+bp::object PythonHistory::record(Input *input, std::size_t n)
+{
+    Ring& ring = rings_[input];
+
+    if(msg::hasMessage(input)) {
+        TokenDataConstPtr message = msg::getMessage(input);
+        ArrayView frame;
+        if(message != ring.last && PythonInputArrays::convert(message, frame)) {
+            if(ring.count == 0 || ring.type != frame.type || ring.fields != frame.fields) {
+                reset(ring, frame, std::max(n, ring.capacity));
+            } else if(!ring.ragged && ring.frame_shape != frame.shape) {
+                makeRagged(ring);
+            }
+            append(ring, frame);
+            ring.last = message;
+        }
+    }
+
+    // the ring is sized for the largest request, smaller ones get the newest frames
+    if(n > ring.capacity && ring.count > 0) {
+        grow(ring, n);
+    }
+
+    const std::size_t frames = std::min(n, ring.count);
+    if(frames == 0) {
+        return bp::object();
+    }
+
+    if(ring.ragged) {
+        bp::list res;
+        for(std::size_t i = ring.frames.size() - frames; i < ring.frames.size(); ++i) {
+            const Frame& stored = ring.frames[i];
+            ArrayView view(stored.data, stored.data->data(), stored.shape, ring.type, true);
+            view.fields = ring.fields;
+            res.append(view.toNumpy());
+        }
+        return res;
+    }
+
+    // the newest frame is at next + capacity - 1, all older ones directly precede it
+    std::size_t first = ring.next + ring.capacity - frames;
+
+    std::vector<Py_ssize_t> shape { static_cast<Py_ssize_t>(frames) };
+    shape.insert(shape.end(), ring.frame_shape.begin(), ring.frame_shape.end());
+
+    ArrayView view(ring.storage, ring.storage->data() + first * ring.frame_bytes, shape, ring.type, true);
+    view.fields = ring.fields;
+    return view.toNumpy();
+}
+
+void PythonHistory::prune(const std::vector<InputPtr> &inputs)
+{
+    for(auto it = rings_.begin(); it != rings_.end();) {
+        bool exists = std::any_of(inputs.begin(), inputs.end(), [it](const InputPtr& input) {
+            return input.get() == it->first;
+        });
+        if(exists) {
+            ++it;
+        } else {
+            it = rings_.erase(it);
+        }
+    }
+}
+
+void PythonHistory::clear()
+{
+    rings_.clear();
+}
+
+void PythonHistory::reset(Ring &ring, const ArrayView &frame, std::size_t capacity)
+{
+    ring.frame_shape = frame.shape;
+    ring.type = frame.type;
+    ring.fields = frame.fields;
+    ring.item_size = std::stoul(frame.type.substr(2));
+    ring.frame_bytes = ring.item_size;
+    for(Py_ssize_t s : frame.shape) {
+        ring.frame_bytes *= s;
+    }
+    ring.capacity = capacity;
+    ring.count = 0;
+    ring.next = 0;
+    ring.last.reset();
+    ring.ragged = false;
+    ring.frames.clear();
+
+    // views handed out before keep the old storage alive
+    ring.storage = std::make_shared<std::vector<std::uint8_t>>(2 * capacity * ring.frame_bytes);
+}
+
+void PythonHistory::grow(Ring &ring, std::size_t capacity)
+{
+    if(!ring.ragged) {
+        // the frames are moved to the start of a new ring, oldest first
+        auto storage = std::make_shared<std::vector<std::uint8_t>>(2 * capacity * ring.frame_bytes);
+        const std::uint8_t* src = ring.storage->data() + (ring.next + ring.capacity - ring.count) * ring.frame_bytes;
+        std::uint8_t* dst = storage->data();
+        std::memcpy(dst, src, ring.count * ring.frame_bytes);
+        std::memcpy(dst + capacity * ring.frame_bytes, src, ring.count * ring.frame_bytes);
+
+        ring.storage = storage;
+        ring.next = ring.count % capacity;
+    }
+    ring.capacity = capacity;
+}
+
+void PythonHistory::makeRagged(Ring &ring)
+{
+    const std::uint8_t* oldest = ring.storage->data() + (ring.next + ring.capacity - ring.count) * ring.frame_bytes;
+    for(std::size_t i = 0; i < ring.count; ++i) {
+        const std::uint8_t* src = oldest + i * ring.frame_bytes;
+        auto data = std::make_shared<std::vector<std::uint8_t>>(src, src + ring.frame_bytes);
+        ring.frames.push_back(Frame { data, ring.frame_shape });
+    }
+
+    ring.ragged = true;
+    ring.storage.reset();
+}
+
+void PythonHistory::append(Ring &ring, const ArrayView &frame)
+{
+    if(ring.ragged) {
+        std::size_t bytes = ring.item_size;
+        for(Py_ssize_t s : frame.shape) {
+            bytes *= s;
+        }
+        auto data = std::make_shared<std::vector<std::uint8_t>>(bytes);
+        copyFrame(frame, ring.item_size, data->data());
+        ring.frames.push_back(Frame { data, frame.shape });
+        while(ring.frames.size() > ring.capacity) {
+            ring.frames.pop_front();
+        }
+        ring.count = ring.frames.size();
+        return;
+    }
+
+    std::uint8_t* data = ring.storage->data();
+    copyFrame(frame, ring.item_size, data + ring.next * ring.frame_bytes);
+    std::memcpy(data + (ring.next + ring.capacity) * ring.frame_bytes,
+                data + ring.next * ring.frame_bytes, ring.frame_bytes);
+
+    ring.next = (ring.next + 1) % ring.capacity;
+    ring.count = std::min(ring.count + 1, ring.capacity);
+}
+
+void PythonHistory::copyFrame(const ArrayView &frame, std::size_t item_size, std::uint8_t *dst)
+{
+    copy_strided(static_cast<const std::uint8_t*>(frame.data), frame, 0, item_size, dst);
+}
+
+namespace csapex
+{
+void registerHistory()
+{
+    bp::def("history", &history, bp::args("input", "n"),
+            "Returns the last n frames of the input, stacked into one read-only array.\n"
+            "The array aliases the history of the node and changes with the next frame,\n"
+            "copy it to keep it. Frames of differing shape are returned as a list.");
+}
+}
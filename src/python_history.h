@@ -0,0 +1,104 @@
+#ifndef PYTHON_HISTORY_H
+#define PYTHON_HISTORY_H
+
+/// PROJECT
+#include <csapex/model/node.h>
+
+/// COMPONENT
+#include "python_array_view.h"
+
+/// SYSTEM
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonHistory keeps the last messages of the inputs of one node
+ *        for csapex.history(input, n).
+ *
+ * Every frame is copied once into a ring buffer per input, sized for twice the
+ * largest n requested for it, which stores each frame at slot i and i + capacity.
+ * The last frames are therefore always contiguous and can be returned as a
+ * single stacked numpy view, sliced to the n frames asked for.
+ *
+ * Frames whose shape differs, e.g. clouds with a changing number of points,
+ * cannot be stacked. Once that happens, the input keeps each frame in its own
+ * buffer and history returns a list of arrays instead.
+ */
+class PythonHistory
+{
+public:
+    class Scope
+    {
+    public:
+        Scope(PythonHistory* history);
+        ~Scope();
+
+    private:
+        PythonHistory* previous_;
+    };
+
+public:
+    static PythonHistory* current();
+
+    /**
+     * @brief record appends the current message of the input, if it has not been
+     *        recorded yet, and returns the last (up to) n frames, None if there are none.
+     *        A stacked view aliases the ring, later frames overwrite it, so it has to be
+     *        copied to be kept beyond the current call.
+     */
+    boost::python::object record(Input* input, std::size_t n);
+
+    //! drops the rings of inputs that are not in the list anymore, e.g. removed variadic ports
+    void prune(const std::vector<InputPtr>& inputs);
+
+    //! drops all rings, the frames of the previous code are not relevant to new code
+    void clear();
+
+private:
+    struct Frame
+    {
+        std::shared_ptr<std::vector<std::uint8_t>> data;
+        std::vector<Py_ssize_t> shape;
+    };
+
+    struct Ring
+    {
+        Ring();
+
+        std::shared_ptr<std::vector<std::uint8_t>> storage;
+        std::vector<Py_ssize_t> frame_shape;
+        std::string type;
+        std::vector<std::pair<std::string, std::string>> fields;
+        std::size_t item_size;
+        std::size_t frame_bytes;
+        std::size_t capacity;
+        std::size_t count;
+        std::size_t next;
+        TokenDataConstPtr last;
+
+        //! set once the frame shape changed, the frames are then kept separately
+        bool ragged;
+        std::deque<Frame> frames;
+    };
+
+    static void reset(Ring& ring, const ArrayView& frame, std::size_t capacity);
+    static void grow(Ring& ring, std::size_t capacity);
+    static void makeRagged(Ring& ring);
+    static void append(Ring& ring, const ArrayView& frame);
+    static void copyFrame(const ArrayView& frame, std::size_t item_size, std::uint8_t* dst);
+
+private:
+    std::map<const Input*, Ring> rings_;
+};
+
+void registerHistory();
+
+}
+
+#endif // PYTHON_HISTORY_H
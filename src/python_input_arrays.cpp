@@ -0,0 +1,124 @@
+/// HEADER
+#include "python_input_arrays.h"
+
+/// PROJECT
+#include <csapex_opencv/cv_mat_message.h>
+#include <csapex_point_cloud/msg/point_cloud_message.h>
+#include <csapex/msg/input.h>
+#include <csapex/msg/io.h>
+
+/// COMPONENT
+#include "python_point_fields.h"
+
+/// SYSTEM
+#include <algorithm>
+#include <boost/variant.hpp>
+
+using namespace csapex;
+namespace bp = boost::python;
+
+namespace
+{
+// the gaps between the fields are described as unnamed void entries, as numpy expects
+std::vector<std::pair<std::string, std::string>> structured_fields(std::vector<PointField> fields, std::size_t point_size)
+{
+    std::sort(fields.begin(), fields.end(), [](const PointField& a, const PointField& b) {
+        return a.offset < b.offset;
+    });
+
+    std::vector<std::pair<std::string, std::string>> descr;
+    std::size_t offset = 0;
+    for(const PointField& field : fields) {
+        if(field.offset < offset) {
+            // numpy does not allow overlapping fields
+            continue;
+        }
+        if(field.offset > offset) {
+            descr.emplace_back("", "|V" + std::to_string(field.offset - offset));
+        }
+        descr.emplace_back(field.name, field.typestr());
+        offset = field.offset + field.size();
+    }
+    if(point_size > offset) {
+        descr.emplace_back("", "|V" + std::to_string(point_size - offset));
+    }
+    return descr;
+}
+
+struct CloudToView : boost::static_visitor<bool>
+{
+    CloudToView(const TokenDataConstPtr& owner, ArrayView& view)
+        : owner(owner), view(view)
+    {}
+
+    template <typename PointT>
+    bool operator () (const boost::shared_ptr<pcl::PointCloud<PointT>>& cloud) const
+    {
+        if(!cloud) {
+            return false;
+        }
+
+        const std::vector<PointField> fields = pointFields<PointT>();
+        const Py_ssize_t n = static_cast<Py_ssize_t>(cloud->points.size());
+        const bool all_float = std::all_of(fields.begin(), fields.end(), [](const PointField& field) {
+            return field.type == PointFieldType::FLOAT32;
+        });
+
+        if(all_float) {
+            static_assert(sizeof(PointT) % sizeof(float) == 0, "point type is not made of 4 byte words");
+            view = ArrayView(owner, cloud->points.data(),
+                             { n, static_cast<Py_ssize_t>(sizeof(PointT) / sizeof(float)) },
+                             { static_cast<Py_ssize_t>(sizeof(PointT)), static_cast<Py_ssize_t>(sizeof(float)) },
+                             ArrayView::typestr<float>(), true);
+        } else {
+            view = ArrayView(owner, cloud->points.data(), { n }, "|V" + std::to_string(sizeof(PointT)), true);
+            view.fields = structured_fields(fields, sizeof(PointT));
+        }
+        return true;
+    }
+
+    const TokenDataConstPtr& owner;
+    ArrayView& view;
+};
+
+bp::object get_array(Input* input)
+{
+    ArrayView view;
+    if(msg::hasMessage(input) && PythonInputArrays::convert(msg::getMessage(input), view)) {
+        return view.toNumpy();
+    }
+    return bp::object();
+}
+}
+
+bool PythonInputArrays::convert(const TokenDataConstPtr &message, ArrayView &view)
+{
+    if(auto cvmat = std::dynamic_pointer_cast<const connection_types::CvMatMessage>(message)) {
+        const cv::Mat& mat = cvmat->value;
+        std::string typestr;
+        if(mat.empty() || mat.dims != 2 || !ArrayView::depthTypestr(mat.depth(), typestr)) {
+            return false;
+        }
+        std::vector<Py_ssize_t> shape { mat.rows, mat.cols };
+        std::vector<Py_ssize_t> strides { static_cast<Py_ssize_t>(mat.step[0]), static_cast<Py_ssize_t>(mat.step[1]) };
+        if(mat.channels() > 1) {
+            shape.push_back(mat.channels());
+            strides.push_back(static_cast<Py_ssize_t>(mat.elemSize1()));
+        }
+        view = ArrayView(message, mat.data, shape, strides, typestr, true);
+        return true;
+
+    } else if(auto cloud = std::dynamic_pointer_cast<const connection_types::PointCloudMessage>(message)) {
+        return boost::apply_visitor(CloudToView(message, view), cloud->value);
+    }
+
+    return false;
+}
+
+namespace csapex
+{
+void registerInputArrays()
+{
+    bp::def("getArray", &get_array, bp::args("input"));
+}
+}
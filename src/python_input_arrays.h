@@ -0,0 +1,37 @@
+#ifndef PYTHON_INPUT_ARRAYS_H
+#define PYTHON_INPUT_ARRAYS_H
+
+/// PROJECT
+#include <csapex/model/node.h>
+
+/// COMPONENT
+#include "python_array_view.h"
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonInputArrays describe image and point cloud messages as array views,
+ *        so csapex.getArray(input) hands them to numpy without copying.
+ *
+ * Clouds whose fields are all float32 become an (n, k) float32 array, all other
+ * point types a structured array with one named field per entry of the point
+ * field table.
+ *
+ * The views are built synchronously when the script asks for them. Inputs are not
+ * prefetched: csapex hands over message N+1 only after process() returned for
+ * message N, and building a view is O(1) without a copy, so there is no conversion
+ * left that could overlap with the script or the wait for the GIL.
+ */
+class PythonInputArrays
+{
+public:
+    //! returns false if the message cannot be viewed as an array
+    static bool convert(const TokenDataConstPtr& message, ArrayView& view);
+};
+
+void registerInputArrays();
+
+}
+
+#endif // PYTHON_INPUT_ARRAYS_H
@@ -0,0 +1,255 @@
+/// HEADER
+#include "python_memory_arena.h"
+
+/// SYSTEM
+#include <Python.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+using namespace csapex;
+
+namespace
+{
+thread_local PythonMemoryArena* g_current_arena = nullptr;
+bool g_active = false;
+
+#if PY_VERSION_HEX >= 0x03040000
+
+struct alignas(16) AllocationHeader
+{
+    PythonMemoryArena* arena;
+    std::size_t size;
+};
+
+PyMemAllocatorEx g_original;
+
+void* allocate(void* raw, std::size_t size)
+{
+    if(raw == nullptr) {
+        return nullptr;
+    }
+    AllocationHeader* header = static_cast<AllocationHeader*>(raw);
+    header->arena = g_current_arena;
+    header->size = size;
+    if(header->arena) {
+        header->arena->allocated(size);
+    }
+    return header + 1;
+}
+
+void release(AllocationHeader* header)
+{
+    if(header->arena) {
+        header->arena->freed(header->size);
+    }
+}
+
+void* arena_malloc(void* /*ctx*/, std::size_t size)
+{
+    if(size > std::numeric_limits<std::size_t>::max() - sizeof(AllocationHeader)) {
+        return nullptr;
+    }
+    return allocate(g_original.malloc(g_original.ctx, size + sizeof(AllocationHeader)), size);
+}
+
+void* arena_calloc(void* /*ctx*/, std::size_t nelem, std::size_t elsize)
+{
+    if(elsize != 0 && nelem > (std::numeric_limits<std::size_t>::max() - sizeof(AllocationHeader)) / elsize) {
+        return nullptr;
+    }
+    std::size_t size = nelem * elsize;
+    return allocate(g_original.calloc(g_original.ctx, 1, size + sizeof(AllocationHeader)), size);
+}
+
+void* arena_realloc(void* ctx, void* ptr, std::size_t new_size)
+{
+    if(ptr == nullptr) {
+        return arena_malloc(ctx, new_size);
+    }
+    if(new_size > std::numeric_limits<std::size_t>::max() - sizeof(AllocationHeader)) {
+        return nullptr;
+    }
+
+    AllocationHeader* header = static_cast<AllocationHeader*>(ptr) - 1;
+    PythonMemoryArena* arena = header->arena;
+    std::size_t old_size = header->size;
+
+    void* raw = g_original.realloc(g_original.ctx, header, new_size + sizeof(AllocationHeader));
+    if(raw == nullptr) {
+        return nullptr;
+    }
+
+    // the memory stays with the arena that made the original allocation
+    header = static_cast<AllocationHeader*>(raw);
+    header->size = new_size;
+    if(arena) {
+        arena->freed(old_size);
+        arena->allocated(new_size);
+    }
+    return header + 1;
+}
+
+void arena_free(void* /*ctx*/, void* ptr)
+{
+    if(ptr == nullptr) {
+        return;
+    }
+    AllocationHeader* header = static_cast<AllocationHeader*>(ptr) - 1;
+    release(header);
+    g_original.free(g_original.ctx, header);
+}
+
+#endif
+}
+
+PythonMemoryArena::Scope::Scope(PythonMemoryArena *arena)
+    : previous_(g_current_arena)
+{
+    g_current_arena = arena;
+}
+
+PythonMemoryArena::Scope::~Scope()
+{
+    g_current_arena = previous_;
+}
+
+void PythonMemoryArena::installAllocator()
+{
+    static bool installed = false;
+    if(installed) {
+        return;
+    }
+    installed = true;
+
+    const char* env = std::getenv("CSAPEX_PYTHON_MEMORY_ACCOUNTING");
+    if(env == nullptr || std::strcmp(env, "1") != 0) {
+        return;
+    }
+
+#if PY_VERSION_HEX >= 0x03040000
+    if(Py_IsInitialized()) {
+        std::cerr << "[Python] memory accounting has to be enabled before the interpreter is initialized" << std::endl;
+        return;
+    }
+
+    PyMem_GetAllocator(PYMEM_DOMAIN_OBJ, &g_original);
+
+    PyMemAllocatorEx allocator;
+    allocator.ctx = nullptr;
+    allocator.malloc = &arena_malloc;
+    allocator.calloc = &arena_calloc;
+    allocator.realloc = &arena_realloc;
+    allocator.free = &arena_free;
+    PyMem_SetAllocator(PYMEM_DOMAIN_OBJ, &allocator);
+
+    g_active = true;
+#else
+    std::cerr << "[Python] memory accounting requires Python 3.4 or newer" << std::endl;
+#endif
+}
+
+bool PythonMemoryArena::isActive()
+{
+    return g_active;
+}
+
+PythonMemoryArena* PythonMemoryArena::create()
+{
+    return new PythonMemoryArena;
+}
+
+PythonMemoryArena::PythonMemoryArena()
+    : live_(0), peak_(0), allocated_(0)
+{
+}
+
+void PythonMemoryArena::allocated(std::size_t bytes)
+{
+    std::size_t live = live_.load(std::memory_order_relaxed) + bytes;
+    live_.store(live, std::memory_order_relaxed);
+    if(live > peak_.load(std::memory_order_relaxed)) {
+        peak_.store(live, std::memory_order_relaxed);
+    }
+    allocated_.store(allocated_.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+}
+
+void PythonMemoryArena::freed(std::size_t bytes)
+{
+    live_.store(live_.load(std::memory_order_relaxed) - bytes, std::memory_order_relaxed);
+}
+
+std::size_t PythonMemoryArena::liveBytes() const
+{
+    return live_.load(std::memory_order_relaxed);
+}
+
+std::size_t PythonMemoryArena::peakBytes() const
+{
+    return peak_.load(std::memory_order_relaxed);
+}
+
+std::size_t PythonMemoryArena::allocatedBytes() const
+{
+    return allocated_.load(std::memory_order_relaxed);
+}
+
+
+PythonMemoryBudget::PythonMemoryBudget()
+    : arena_(PythonMemoryArena::create()), soft_limit_(0), drop_when_exceeded_(false),
+      reported_allocated_(0), last_report_(std::chrono::steady_clock::now())
+{
+}
+
+PythonMemoryArena* PythonMemoryBudget::getArena() const
+{
+    return arena_;
+}
+
+void PythonMemoryBudget::setSoftLimit(std::size_t bytes)
+{
+    soft_limit_ = bytes;
+}
+
+void PythonMemoryBudget::setDropWhenExceeded(bool drop)
+{
+    drop_when_exceeded_ = drop;
+}
+
+bool PythonMemoryBudget::isExceeded() const
+{
+    std::size_t limit = soft_limit_;
+    return limit > 0 && arena_->liveBytes() > limit;
+}
+
+bool PythonMemoryBudget::dropsFrames() const
+{
+    return drop_when_exceeded_ && isExceeded();
+}
+
+bool PythonMemoryBudget::pollReport(std::string &report)
+{
+    if(!PythonMemoryArena::isActive()) {
+        return false;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> dt = now - last_report_;
+    if(dt.count() < 1.0) {
+        return false;
+    }
+
+    std::size_t allocated = arena_->allocatedBytes();
+    double rate = (allocated - reported_allocated_) / dt.count();
+    reported_allocated_ = allocated;
+    last_report_ = now;
+
+    const double MiB = 1024.0 * 1024.0;
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer), "python objects: live %.1f MiB, peak %.1f MiB, allocating %.1f MiB/s",
+                  arena_->liveBytes() / MiB, arena_->peakBytes() / MiB, rate / MiB);
+    report = buffer;
+    return true;
+}
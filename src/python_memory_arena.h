@@ -0,0 +1,101 @@
+#ifndef PYTHON_MEMORY_ARENA_H
+#define PYTHON_MEMORY_ARENA_H
+
+/// SYSTEM
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonMemoryArena accounts the python object allocations of one node.
+ *
+ * Accounting is process wide and has to be enabled before the first interpreter
+ * is created by setting the environment variable CSAPEX_PYTHON_MEMORY_ACCOUNTING=1.
+ * All object allocations then carry a small header naming the arena that was
+ * current when they were made, so that frees are attributed correctly, even
+ * when they happen outside of the owning node. Buffers that numpy allocates for
+ * array data do not go through the object allocator and are not accounted.
+ */
+class PythonMemoryArena
+{
+public:
+    class Scope
+    {
+    public:
+        Scope(PythonMemoryArena* arena);
+        ~Scope();
+
+    private:
+        PythonMemoryArena* previous_;
+    };
+
+public:
+    /**
+     * @brief installAllocator has to be called before Py_Initialize
+     */
+    static void installAllocator();
+    static bool isActive();
+
+    /**
+     * @brief create returns a new arena. Arenas are never destroyed, since objects
+     *        allocated in them can outlive the owning node.
+     */
+    static PythonMemoryArena* create();
+
+    std::size_t liveBytes() const;
+    std::size_t peakBytes() const;
+    std::size_t allocatedBytes() const;
+
+    void allocated(std::size_t bytes);
+    void freed(std::size_t bytes);
+
+private:
+    PythonMemoryArena();
+
+private:
+    // allocations in the object domain are serialized by the GIL, so relaxed loads and stores suffice
+    std::atomic<std::size_t> live_;
+    std::atomic<std::size_t> peak_;
+    std::atomic<std::size_t> allocated_;
+};
+
+/**
+ * @brief The PythonMemoryBudget compares the usage of an arena with a soft limit.
+ */
+class PythonMemoryBudget
+{
+public:
+    PythonMemoryBudget();
+
+    PythonMemoryArena* getArena() const;
+
+    //! a limit of 0 disables the check
+    void setSoftLimit(std::size_t bytes);
+    void setDropWhenExceeded(bool drop);
+
+    bool isExceeded() const;
+    //! frames are dropped while the limit is exceeded, if requested
+    bool dropsFrames() const;
+
+    /**
+     * @brief pollReport formats live bytes, peak bytes and allocation rate, at most once per second
+     */
+    bool pollReport(std::string& report);
+
+private:
+    PythonMemoryArena* arena_;
+
+    std::atomic<std::size_t> soft_limit_;
+    std::atomic<bool> drop_when_exceeded_;
+
+    std::size_t reported_allocated_;
+    std::chrono::steady_clock::time_point last_report_;
+};
+
+}
+
+#endif // PYTHON_MEMORY_ARENA_H
@@ -0,0 +1,511 @@
+/// HEADER
+#include "python_native.h"
+
+/// COMPONENT
+#include "python_cache_directory.h"
+#include "python_parallel.h"
+
+/// SYSTEM
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace csapex;
+namespace bp = boost::python;
+
+namespace
+{
+const char* ENTRY_SYMBOL = "csapex_native_entry";
+const std::vector<std::string> COMPILER_FLAGS { "-std=c++14", "-O3", "-march=native", "-fPIC", "-shared" };
+
+struct TypeInfo
+{
+    const char* name;
+    NativeFunction::Type type;
+    const char* cpp;
+    std::size_t size;
+    // 'b'ool, signed 'i'nteger, 'u'nsigned integer or 'f'loating point
+    char kind;
+};
+
+const std::vector<TypeInfo>& types()
+{
+    typedef NativeFunction::Type T;
+    static std::vector<TypeInfo> table {
+        { "void", T::VOID, "void", 0, 'v' },
+        { "bool", T::BOOL, "bool", sizeof(bool), 'b' },
+        { "int8_t", T::INT8, "std::int8_t", 1, 'i' },
+        { "uint8_t", T::UINT8, "std::uint8_t", 1, 'u' },
+        { "int16_t", T::INT16, "std::int16_t", 2, 'i' },
+        { "uint16_t", T::UINT16, "std::uint16_t", 2, 'u' },
+        { "int32_t", T::INT32, "std::int32_t", 4, 'i' },
+        { "int", T::INT32, "std::int32_t", 4, 'i' },
+        { "uint32_t", T::UINT32, "std::uint32_t", 4, 'u' },
+        { "unsigned", T::UINT32, "std::uint32_t", 4, 'u' },
+        { "int64_t", T::INT64, "std::int64_t", 8, 'i' },
+        { "long", T::INT64, "std::int64_t", 8, 'i' },
+        { "uint64_t", T::UINT64, "std::uint64_t", 8, 'u' },
+        { "size_t", T::UINT64, "std::uint64_t", 8, 'u' },
+        { "float", T::FLOAT32, "float", 4, 'f' },
+        { "double", T::FLOAT64, "double", 8, 'f' }
+    };
+    return table;
+}
+
+const TypeInfo* find_type(std::string name)
+{
+    if(name.compare(0, 5, "std::") == 0) {
+        name = name.substr(5);
+    }
+    for(const TypeInfo& info : types()) {
+        if(name == info.name) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+const TypeInfo& info(NativeFunction::Type type)
+{
+    for(const TypeInfo& info : types()) {
+        if(info.type == type) {
+            return info;
+        }
+    }
+    throw std::logic_error("unknown native type");
+}
+
+std::vector<std::string> tokenize(const std::string& signature)
+{
+    std::string spaced;
+    for(char c : signature) {
+        if(c == '*' || c == '(' || c == ')' || c == ',') {
+            spaced += ' ';
+            spaced += c;
+            spaced += ' ';
+        } else {
+            spaced += c;
+        }
+    }
+
+    std::vector<std::string> tokens;
+    std::istringstream stream(spaced);
+    std::string token;
+    while(stream >> token) {
+        tokens.push_back(token);
+    }
+    return tokens;
+}
+
+// the kind of a buffer format character, see the struct module
+char format_kind(const char* format)
+{
+    if(!format || !*format) {
+        return 'u';
+    }
+    switch(format[std::strlen(format) - 1]) {
+    case 'f': case 'd': case 'e': return 'f';
+    case 'b': case 'h': case 'i': case 'l': case 'q': case 'n': return 'i';
+    case 'B': case 'H': case 'I': case 'L': case 'Q': case 'N': return 'u';
+    case '?': return 'b';
+    default: return '?';
+    }
+}
+
+/*
+ * CACHE
+ */
+
+std::uint64_t fnv1a(const std::string& data)
+{
+    std::uint64_t hash = 14695981039346656037ull;
+    for(unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// -march=native code must only be loaded on the CPU it was built for, the cache may be shared between hosts
+std::string host_cpu()
+{
+    std::ifstream in("/proc/cpuinfo");
+    std::string line, model, flags;
+    while(std::getline(in, line) && (model.empty() || flags.empty())) {
+        if(model.empty() && line.compare(0, 10, "model name") == 0) {
+            model = line;
+        } else if(flags.empty() && (line.compare(0, 5, "flags") == 0 || line.compare(0, 8, "Features") == 0)) {
+            flags = line;
+        }
+    }
+    return model + '\n' + flags;
+}
+
+// runs the compiler without a shell, its error output is written to log
+int run_compiler(const std::string& compiler, const std::vector<std::string>& arguments, const std::string& log)
+{
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(compiler.c_str()));
+    for(const std::string& argument : arguments) {
+        argv.push_back(const_cast<char*>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if(pid < 0) {
+        return -1;
+    }
+    if(pid == 0) {
+        int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd >= 0) {
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        // only async-signal-safe calls are allowed between fork and exec
+        execvp(argv[0], argv.data());
+        const char message[] = "cannot run the compiler, set CXX to its path\n";
+        ssize_t written = write(STDERR_FILENO, message, sizeof(message) - 1);
+        (void) written;
+        _exit(127);
+    }
+
+    int status = 0;
+    while(waitpid(pid, &status, 0) < 0) {
+        if(errno != EINTR) {
+            return -1;
+        }
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+std::string read_file(const std::string& path)
+{
+    std::ifstream in(path);
+    std::stringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+// compiles into a temporary file first, so that concurrent loads never see a partial shared object
+std::string build(const std::string& source)
+{
+    const char* env_compiler = std::getenv("CXX");
+    const std::string compiler = env_compiler ? env_compiler : "c++";
+
+    std::string flags;
+    for(const std::string& flag : COMPILER_FLAGS) {
+        flags += flag + ' ';
+    }
+
+    std::ostringstream hash;
+    hash << std::hex << fnv1a(compiler + '\n' + flags + '\n' + host_cpu() + '\n' + source);
+
+    const std::string dir = cacheDirectory("native", "CSAPEX_PYTHON_NATIVE_CACHE");
+    const std::string stem = dir + "/native_" + hash.str();
+    const std::string library = stem + ".so";
+    if(access(library.c_str(), R_OK) == 0) {
+        return library;
+    }
+
+    static std::atomic<int> counter(0);
+    const std::string unique = "." + std::to_string(getpid()) + "_" + std::to_string(counter++);
+    const std::string code = stem + unique + ".cpp";
+    const std::string tmp = stem + unique + ".so";
+    const std::string log = stem + unique + ".log";
+
+    {
+        std::ofstream out(code);
+        out << source;
+        if(!out) {
+            throw std::runtime_error("cannot write " + code);
+        }
+    }
+
+    std::vector<std::string> arguments = COMPILER_FLAGS;
+    arguments.insert(arguments.end(), { "-o", tmp, code });
+    int status = run_compiler(compiler, arguments, log);
+
+    std::string output = read_file(log);
+    std::remove(code.c_str());
+    std::remove(log.c_str());
+
+    if(status != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("cannot compile native function:\n" + output);
+    }
+    if(std::rename(tmp.c_str(), library.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("cannot store " + library + ": " + std::strerror(errno));
+    }
+    return library;
+}
+
+/*
+ * ARGUMENTS
+ */
+
+template <typename T>
+void store(std::uint64_t& slot, T value)
+{
+    std::memcpy(&slot, &value, sizeof(T));
+}
+
+template <typename T>
+T load(const std::uint64_t& slot)
+{
+    T value;
+    std::memcpy(&value, &slot, sizeof(T));
+    return value;
+}
+
+void convert_scalar(const bp::object& value, NativeFunction::Type type, std::uint64_t& slot)
+{
+    typedef NativeFunction::Type T;
+    switch(type) {
+    case T::BOOL: store<bool>(slot, bp::extract<bool>(value)); break;
+    case T::INT8: store<std::int8_t>(slot, bp::extract<long long>(value)); break;
+    case T::UINT8: store<std::uint8_t>(slot, bp::extract<unsigned long long>(value)); break;
+    case T::INT16: store<std::int16_t>(slot, bp::extract<long long>(value)); break;
+    case T::UINT16: store<std::uint16_t>(slot, bp::extract<unsigned long long>(value)); break;
+    case T::INT32: store<std::int32_t>(slot, bp::extract<long long>(value)); break;
+    case T::UINT32: store<std::uint32_t>(slot, bp::extract<unsigned long long>(value)); break;
+    case T::INT64: store<std::int64_t>(slot, bp::extract<long long>(value)); break;
+    case T::UINT64: store<std::uint64_t>(slot, bp::extract<unsigned long long>(value)); break;
+    case T::FLOAT32: store<float>(slot, bp::extract<double>(value)); break;
+    case T::FLOAT64: store<double>(slot, bp::extract<double>(value)); break;
+    default: throw std::logic_error("void argument");
+    }
+}
+
+bp::object convert_result(NativeFunction::Type type, const std::uint64_t& slot)
+{
+    typedef NativeFunction::Type T;
+    switch(type) {
+    case T::VOID: return bp::object();
+    case T::BOOL: return bp::object(load<bool>(slot));
+    case T::INT8: return bp::object(load<std::int8_t>(slot));
+    case T::UINT8: return bp::object(load<std::uint8_t>(slot));
+    case T::INT16: return bp::object(load<std::int16_t>(slot));
+    case T::UINT16: return bp::object(load<std::uint16_t>(slot));
+    case T::INT32: return bp::object(load<std::int32_t>(slot));
+    case T::UINT32: return bp::object(load<std::uint32_t>(slot));
+    case T::INT64: return bp::object(static_cast<long long>(load<std::int64_t>(slot)));
+    case T::UINT64: return bp::object(static_cast<unsigned long long>(load<std::uint64_t>(slot)));
+    case T::FLOAT32: return bp::object(load<float>(slot));
+    case T::FLOAT64: return bp::object(load<double>(slot));
+    }
+    return bp::object();
+}
+
+struct BufferGuard
+{
+    ~BufferGuard()
+    {
+        for(Py_buffer& buffer : buffers) {
+            PyBuffer_Release(&buffer);
+        }
+    }
+
+    std::vector<Py_buffer> buffers;
+};
+}
+
+NativeFunction::NativeFunction()
+    : result_(Type::VOID), entry_(nullptr)
+{
+}
+
+std::shared_ptr<NativeFunction> NativeFunction::compile(const std::string &source, const std::string &signature)
+{
+    std::shared_ptr<NativeFunction> res(new NativeFunction);
+    res->parseSignature(signature);
+
+    std::string code = "#include <cstddef>\n"
+                       "#include <cstdint>\n"
+                       "#line 1 \"native\"\n"
+                       + source + "\n"
+                       + res->generateGlue();
+
+    ScopedGilRelease nogil;
+    std::string library = build(code);
+
+    // handles are never closed, the function may still be referenced from other interpreters
+    void* handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if(!handle) {
+        throw std::runtime_error(std::string("cannot load native function: ") + dlerror());
+    }
+    res->entry_ = reinterpret_cast<Entry>(dlsym(handle, ENTRY_SYMBOL));
+    if(!res->entry_) {
+        throw std::runtime_error(std::string("cannot find native function: ") + dlerror());
+    }
+    return res;
+}
+
+void NativeFunction::parseSignature(const std::string &signature)
+{
+    signature_ = signature;
+
+    std::vector<std::string> tokens = tokenize(signature);
+    if(tokens.size() < 4 || tokens[2] != "(" || tokens.back() != ")") {
+        throw std::invalid_argument("the signature has to look like 'double name(const float* values, int64_t n)'");
+    }
+
+    const TypeInfo* result = find_type(tokens[0]);
+    if(!result) {
+        throw std::invalid_argument("unsupported return type '" + tokens[0] + "'");
+    }
+    result_ = result->type;
+    name_ = tokens[1];
+
+    std::vector<std::vector<std::string>> groups(1);
+    for(std::size_t i = 3; i + 1 < tokens.size(); ++i) {
+        if(tokens[i] == ",") {
+            groups.emplace_back();
+        } else {
+            groups.back().push_back(tokens[i]);
+        }
+    }
+    if(groups.size() == 1 && (groups[0].empty() || (groups[0].size() == 1 && groups[0][0] == "void"))) {
+        return;
+    }
+
+    for(const std::vector<std::string>& group : groups) {
+        const TypeInfo* type = nullptr;
+        bool is_const = false;
+        int pointers = 0;
+        for(const std::string& token : group) {
+            if(token == "const") {
+                is_const = true;
+            } else if(token == "*") {
+                ++pointers;
+            } else if(!type) {
+                type = find_type(token);
+            }
+        }
+        if(!type || type->type == Type::VOID || pointers > 1) {
+            throw std::invalid_argument("unsupported argument type in '" + signature + "'");
+        }
+        arguments_.push_back(Argument { type->type, pointers == 1, pointers == 1 && !is_const });
+    }
+}
+
+std::string NativeFunction::generateGlue() const
+{
+    std::ostringstream glue;
+    glue << "extern \"C\" void " << ENTRY_SYMBOL << "(void** arguments, void* result)\n{\n    ";
+    if(result_ != Type::VOID) {
+        glue << "*static_cast<" << info(result_).cpp << "*>(result) = ";
+    } else {
+        glue << "(void) result;\n    ";
+    }
+    glue << name_ << "(";
+    for(std::size_t i = 0; i < arguments_.size(); ++i) {
+        const Argument& arg = arguments_[i];
+        const char* cpp = info(arg.type).cpp;
+        if(i > 0) {
+            glue << ", ";
+        }
+        if(arg.pointer) {
+            glue << "static_cast<" << (arg.writable ? "" : "const ") << cpp << "*>(arguments[" << i << "])";
+        } else {
+            glue << "*static_cast<" << cpp << "*>(arguments[" << i << "])";
+        }
+    }
+    glue << ");\n}\n";
+    return glue.str();
+}
+
+const std::string& NativeFunction::getName() const
+{
+    return name_;
+}
+
+const std::string& NativeFunction::getSignature() const
+{
+    return signature_;
+}
+
+bp::object NativeFunction::call(const bp::tuple &args) const
+{
+    if(bp::len(args) != static_cast<long>(arguments_.size())) {
+        PyErr_Format(PyExc_TypeError, "%s expects %d arguments", name_.c_str(), static_cast<int>(arguments_.size()));
+        bp::throw_error_already_set();
+    }
+
+    BufferGuard guard;
+    guard.buffers.reserve(arguments_.size());
+    std::vector<std::uint64_t> scalars(arguments_.size());
+    std::vector<void*> pointers(arguments_.size());
+
+    for(std::size_t i = 0; i < arguments_.size(); ++i) {
+        const Argument& arg = arguments_[i];
+        bp::object value = args[i];
+        if(!arg.pointer) {
+            convert_scalar(value, arg.type, scalars[i]);
+            pointers[i] = &scalars[i];
+            continue;
+        }
+
+        int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (arg.writable ? PyBUF_WRITABLE : 0);
+        Py_buffer buffer;
+        if(PyObject_GetBuffer(value.ptr(), &buffer, flags) != 0) {
+            bp::throw_error_already_set();
+        }
+        guard.buffers.push_back(buffer);
+
+        const TypeInfo& type = info(arg.type);
+        if(static_cast<std::size_t>(buffer.itemsize) != type.size || format_kind(buffer.format) != type.kind) {
+            PyErr_Format(PyExc_TypeError, "argument %d of %s has to be an array of %s",
+                         static_cast<int>(i + 1), name_.c_str(), type.cpp);
+            bp::throw_error_already_set();
+        }
+        pointers[i] = buffer.buf;
+    }
+
+    std::uint64_t result = 0;
+    {
+        ScopedGilRelease nogil;
+        entry_(pointers.data(), &result);
+    }
+    return convert_result(result_, result);
+}
+
+namespace
+{
+std::shared_ptr<NativeFunction> native(const std::string& source, const std::string& signature)
+{
+    return NativeFunction::compile(source, signature);
+}
+
+bp::object call(bp::tuple args, bp::dict kwargs)
+{
+    if(bp::len(kwargs) > 0) {
+        PyErr_SetString(PyExc_TypeError, "native functions take positional arguments only");
+        bp::throw_error_already_set();
+    }
+    const NativeFunction& self = bp::extract<const NativeFunction&>(args[0]);
+    return self.call(bp::tuple(args.slice(1, bp::_)));
+}
+}
+
+namespace csapex
+{
+void registerNative()
+{
+    bp::class_<NativeFunction, std::shared_ptr<NativeFunction>, boost::noncopyable>("NativeFunction", bp::no_init)
+            .def("__call__", bp::raw_function(&call, 1))
+            .add_property("name", bp::make_function(&NativeFunction::getName, bp::return_value_policy<bp::copy_const_reference>()))
+            .add_property("signature", bp::make_function(&NativeFunction::getSignature, bp::return_value_policy<bp::copy_const_reference>()));
+
+    bp::def("native", &native, (bp::arg("source"), bp::arg("signature")));
+}
+}
@@ -0,0 +1,65 @@
+#ifndef PYTHON_NATIVE_H
+#define PYTHON_NATIVE_H
+
+/// SYSTEM
+#include <boost/python.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace csapex
+{
+
+/**
+ * @brief The NativeFunction is a C++ function that a script compiles at load time, e.g.
+ *
+ *          scale = csapex.native(source, "void scale(float* values, int64_t n, double factor)")
+ *
+ *        Pointer arguments take contiguous arrays of the matching dtype, the other arguments
+ *        take numbers. Shared objects are cached by the hash of their source, so only the
+ *        first load of a script runs the compiler. Calls release the GIL.
+ */
+class NativeFunction
+{
+public:
+    enum class Type {
+        VOID, BOOL, INT8, UINT8, INT16, UINT16, INT32, UINT32, INT64, UINT64, FLOAT32, FLOAT64
+    };
+
+    struct Argument
+    {
+        Type type;
+        bool pointer;
+        bool writable;
+    };
+
+public:
+    //! throws std::runtime_error with the compiler output if the source does not compile
+    static std::shared_ptr<NativeFunction> compile(const std::string& source, const std::string& signature);
+
+    const std::string& getName() const;
+    const std::string& getSignature() const;
+
+    boost::python::object call(const boost::python::tuple& args) const;
+
+private:
+    typedef void (*Entry)(void** arguments, void* result);
+
+    NativeFunction();
+
+    void parseSignature(const std::string& signature);
+    std::string generateGlue() const;
+
+private:
+    std::string name_;
+    std::string signature_;
+    Type result_;
+    std::vector<Argument> arguments_;
+    Entry entry_;
+};
+
+void registerNative();
+
+}
+
+#endif // PYTHON_NATIVE_H
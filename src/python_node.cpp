@@ -10,11 +10,17 @@
 #include <csapex/msg/end_of_sequence_message.h>
 #include <csapex/msg/end_of_program_message.h>
 #include <csapex/msg/input.h>
+#include <csapex/msg/io.h>
 #include <csapex/msg/output.h>
+#include <csapex/param/parameter_factory.h>
+#include <csapex_opencv/cv_mat_message.h>
 
 /// SYSTEM
 #include <yaml-cpp/yaml.h>
+#include <algorithm>
 #include <iostream>
+#include <sstream>
+#include <chrono>
 
 CSAPEX_REGISTER_CLASS(csapex::PythonNode, csapex::Node)
 
@@ -23,50 +29,43 @@ namespace bp = boost::python;
 
 namespace
 {
-std::string parse_python_exception(){
-    PyObject *type_ptr = NULL, *value_ptr = NULL, *traceback_ptr = NULL;
-    PyErr_Fetch(&type_ptr, &value_ptr, &traceback_ptr);
-    std::string ret("Unfetchable Python error");
-
-    if(type_ptr != NULL){
-        bp::handle<> h_type(type_ptr);
-        bp::str type_pstr(h_type);
-        bp::extract<std::string> e_type_pstr(type_pstr);
-        if(e_type_pstr.check())
-            ret = e_type_pstr();
-        else
-            ret = "Unknown exception type";
-    }
-
-    if(value_ptr != NULL){
-            bp::handle<> h_val(value_ptr);
-            bp::str a(h_val);
-            bp::extract<std::string> returned(a);
-            if(returned.check())
-                ret +=  ": " + returned();
-            else
-                ret += std::string(": Unparseable Python error: ");
+void assign_in_place(bp::object& globals, const char* name, const bp::list& items)
+{
+    PyObject* existing = PyDict_GetItemString(globals.ptr(), name);
+    if(existing != NULL && PyList_Check(existing)) {
+        // keep the list object alive so that references held by the script stay valid
+        if(PyList_SetSlice(existing, 0, PyList_GET_SIZE(existing), items.ptr()) != 0) {
+            bp::throw_error_already_set();
         }
+    } else {
+        globals[name] = items;
+    }
+}
 
-    if(traceback_ptr != NULL){
-            bp::handle<> h_tb(traceback_ptr);
-            bp::object tb(bp::import("traceback"));
-            bp::object fmt_tb(tb.attr("format_tb"));
-            bp::object tb_list(fmt_tb(h_tb));
-            bp::object tb_str(bp::str("\n").join(tb_list));
-            bp::extract<std::string> returned(tb_str);
-            if(returned.check())
-                ret += ": " + returned();
-            else
-                ret += std::string(": Unparseable Python traceback");
-        }
-        return ret;
+std::string milliseconds_since(const std::chrono::steady_clock::time_point& start)
+{
+    std::chrono::duration<double, std::milli> dt = std::chrono::steady_clock::now() - start;
+    std::stringstream ss;
+    ss.precision(1);
+    ss << std::fixed << dt.count() << " ms";
+    return ss.str();
 }
 }
 
 PythonNode::PythonNode()
-    : is_setup_(false), python_is_initialized_(false)
+    : is_setup_(false), python_is_initialized_(false),
+      controls_(this, &thread_states_, &error_handler_), script_parameters_(this),
+      tile_mode_(false), tile_processor_(controls_.memoryBudget().getArena(), &controls_.schedulingPolicy()),
+      state_changed_(true), compile_running_(false), has_compile_request_(false), has_pending_code_(false)
 {
+    controls_.gcPolicy().setErrorReport([this]() {
+        reportError();
+    });
+    // cached results were computed with the old parameter values
+    script_parameters_.setChangeCallback([this]() {
+        controls_.resultCache().clear();
+    });
+
     std::string def_code = "def setup(): \n"
                            "  print(inputs)\n"
                            "  print(outputs)\n"
@@ -82,16 +81,62 @@ PythonNode::PythonNode()
 
 PythonNode::~PythonNode()
 {
-    PyEval_AcquireThread(thread_state);
+    // requests queued on the execution thread must not run after this point
+    requests_.close();
+
+    {
+        std::unique_lock<std::mutex> lock(compile_mutex_);
+        compile_running_ = false;
+        compile_changed_.notify_all();
+    }
+    if(compile_thread_.joinable()) {
+        compile_thread_.join();
+    }
+
+    controls_.deadline().close();
 
-    Py_EndInterpreter(thread_state);
+    thread_states_.acquire();
+
+    tile_processor_.release();
+    error_handler_.release();
+    controls_.release();
+    script_parameters_.release();
+    pending_code_ = bp::object();
+    pending_callback_ = nullptr;
+    // saved_state_ is not released, the saved graph may still refer to its sidecar
+
+    thread_states_.end();
 
     PyEval_ReleaseLock();
 }
 
 void PythonNode::portCountChanged()
 {
-    refreshCode();
+    if(!is_setup_) {
+        refreshCode();
+        return;
+    }
+
+    PythonMemoryArena::Scope memory_scope(controls_.memoryBudget().getArena());
+
+    thread_states_.acquire();
+
+    try {
+        updatePorts();
+
+        if(PyDict_GetItemString(globals.ptr(), "on_ports_changed") != NULL) {
+            globals["on_ports_changed"]();
+        }
+
+        flush();
+
+    } catch( bp::error_already_set ) {
+        reportError();
+    }
+
+    thread_states_.release();
+
+    state_changed_ = true;
 }
 
 std::string PythonNode::getCode() const
@@ -101,23 +146,27 @@ std::string PythonNode::getCode() const
 
 void PythonNode::setCode(const std::string &code)
 {
+    PythonMemoryArena::Scope memory_scope(controls_.memoryBudget().getArena());
+    // the script may declare parameters at the top level
+    PythonParameters::Scope parameters_scope(&script_parameters_);
+
     code_ = code;
 
     static bool init = false;
     if(!init) {
         init = true;
+        PythonMemoryArena::installAllocator();
         Py_Initialize();
         PyEval_InitThreads();
     }
 
     if(!python_is_initialized_) {
-        thread_state = nullptr;
         PyThreadState *current_state = PyThreadState_Swap(nullptr);
         if (current_state == nullptr) {
             PyEval_AcquireLock();
         }
 
-        thread_state = Py_NewInterpreter();
+        thread_states_.adopt(Py_NewInterpreter());
 
         bp::object main = bp::import("__main__");
         globals = main.attr("__dict__");
@@ -125,58 +174,207 @@ void PythonNode::setCode(const std::string &code)
         try {
             globals["csapex"] = bp::import("csapex");
         }catch(boost::python::error_already_set const &){
-            std::string perror_str = parse_python_exception();
+            std::string perror_str = error_handler_.describe();
             std::cout << "Error in Python: " << perror_str << std::endl;
         }
 
         python_is_initialized_ = true;
 
     } else {
-        PyEval_AcquireThread(thread_state);
+        thread_states_.acquire();
     }
 
     if(node_handle_) {
         try {
-            bp::list inputs;
-            for(const InputPtr& i : variadic_inputs_) {
-                if(!node_handle_->isParameterInput(i->getUUID())) {
-                    inputs.append(i);
-                }
-            }
-            globals["inputs"] = inputs;
+            updatePorts();
 
-            bp::list outputs;
-            for(const OutputPtr& o : variadic_outputs_) {
-                if(!node_handle_->isParameterOutput(o->getUUID())) {
-                    outputs.append(o);
-                }
+            if(!is_setup_ || executed_code_ != code_) {
+                bp::exec(code_.c_str(), globals, globals);
+                codeExecuted(code_);
             }
-            globals["outputs"] = outputs;
 
-            bp::list slot;
-            for(const SlotPtr& i : variadic_slots_) {
-                slot.append(i);
+            is_setup_ = true;
+
+            applyPendingState();
+
+            flush();
+
+        } catch( bp::error_already_set ) {
+            reportError();
+        }
+    }
+
+    thread_states_.release();
+}
+
+void PythonNode::compileAsync(const std::string &code, CompileCallback callback)
+{
+    std::unique_lock<std::mutex> lock(compile_mutex_);
+    compile_request_ = code;
+    compile_callback_ = callback;
+    has_compile_request_ = true;
+
+    if(!compile_running_) {
+        compile_running_ = true;
+        compile_thread_ = std::thread([this]() {
+            compileLoop();
+        });
+    }
+    compile_changed_.notify_all();
+}
+
+void PythonNode::compileLoop()
+{
+    std::unique_lock<std::mutex> lock(compile_mutex_);
+    while(compile_running_) {
+        compile_changed_.wait(lock, [this]() {
+            return has_compile_request_ || !compile_running_;
+        });
+        if(!compile_running_) {
+            break;
+        }
+
+        std::string code = compile_request_;
+        CompileCallback callback = compile_callback_;
+        has_compile_request_ = false;
+        lock.unlock();
+
+        callback(CompileState::COMPILING, "compiling");
+
+        auto start = std::chrono::steady_clock::now();
+
+        thread_states_.acquire();
+
+        std::string error;
+        PyObject* compiled = Py_CompileString(code.c_str(), "<script>", Py_file_input);
+        bool success = compiled != NULL;
+        if(success) {
+            // the pending code is only accessed while holding the GIL
+            pending_code_ = bp::object(bp::handle<>(compiled));
+            pending_source_ = code;
+            pending_callback_ = callback;
+            has_pending_code_ = true;
+        } else {
+            error = error_handler_.describe();
+        }
+
+        thread_states_.release();
+
+        if(success) {
+            callback(CompileState::QUEUED, "compiled in " + milliseconds_since(start) + ", waiting for the node");
+            if(node_handle_) {
+                node_handle_->execution_requested(requests_.wrap([this]() {
+                    installPendingCode();
+                }));
             }
-            globals["slots"] = slot;
+        } else {
+            callback(CompileState::FAILED, error);
+        }
+
+        lock.lock();
+    }
+}
+
+void PythonNode::installPendingCode()
+{
+    if(!has_pending_code_) {
+        return;
+    }
+
+    PythonMemoryArena::Scope memory_scope(controls_.memoryBudget().getArena());
+    PythonParameters::Scope parameters_scope(&script_parameters_);
+
+    thread_states_.acquire();
+
+    {
+        bp::object code = pending_code_;
+        std::string source = pending_source_;
+        CompileCallback callback = pending_callback_;
+        pending_code_ = bp::object();
+        pending_callback_ = nullptr;
+        has_pending_code_ = false;
+
+        if(!code.is_none()) {
+            auto start = std::chrono::steady_clock::now();
+            try {
+                if(node_handle_) {
+                    updatePorts();
+                }
+
+#if PY_MAJOR_VERSION >= 3
+                PyObject* res = PyEval_EvalCode(code.ptr(), globals.ptr(), globals.ptr());
+#else
+                PyObject* res = PyEval_EvalCode(reinterpret_cast<PyCodeObject*>(code.ptr()), globals.ptr(), globals.ptr());
+#endif
+                if(res == NULL) {
+                    bp::throw_error_already_set();
+                }
+                Py_DECREF(res);
 
-            bp::list events;
-            for(const EventPtr& o : variadic_events_) {
-                events.append(o);
+                code_ = source;
+                codeExecuted(source);
+                is_setup_ = true;
+
+                flush();
+
+                callback(CompileState::INSTALLED, "installed in " + milliseconds_since(start));
+
+            } catch( bp::error_already_set ) {
+                callback(CompileState::FAILED, error_handler_.describe());
             }
-            globals["events"] = events;
+        }
+    }
 
-            bp::exec(code_.c_str(), globals, globals);
+    thread_states_.release();
+}
 
-            flush();
+void PythonNode::codeExecuted(const std::string &code)
+{
+    executed_code_ = code;
+    state_changed_ = true;
 
-            is_setup_ = true;
+    // results and frames of the previous code must not be replayed
+    controls_.resultCache().clear();
+    history_.clear();
+}
 
-        } catch( bp::error_already_set ) {
-            PyErr_Print();
+void PythonNode::updatePorts()
+{
+    controls_.resultCache().clear();
+
+    message_inputs_.clear();
+    message_outputs_.clear();
+
+    bp::list inputs;
+    for(const InputPtr& i : variadic_inputs_) {
+        if(!node_handle_->isParameterInput(i->getUUID())) {
+            inputs.append(i);
+            message_inputs_.push_back(i);
+        }
+    }
+    assign_in_place(globals, "inputs", inputs);
+    history_.prune(message_inputs_);
+
+    bp::list outputs;
+    for(const OutputPtr& o : variadic_outputs_) {
+        if(!node_handle_->isParameterOutput(o->getUUID())) {
+            outputs.append(o);
+            message_outputs_.push_back(o);
         }
     }
+    assign_in_place(globals, "outputs", outputs);
+
+    bp::list slot;
+    for(const SlotPtr& i : variadic_slots_) {
+        slot.append(i);
+    }
+    assign_in_place(globals, "slots", slot);
 
-    PyEval_ReleaseThread(thread_state);
+    bp::list events;
+    for(const EventPtr& o : variadic_events_) {
+        events.append(o);
+    }
+    assign_in_place(globals, "events", events);
 }
 
 void PythonNode::refreshCode()
@@ -187,17 +385,27 @@ void PythonNode::refreshCode()
 void PythonNode::setup(NodeModifier& node_modifier)
 {
     setupVariadic(node_modifier);
+    controls_.setNodeModifier(&node_modifier);
 
     if(exists("setup")) {
         call("setup");
     }
 
     refreshCode();
+
+    thread_states_.acquire();
+    controls_.gcPolicy().afterSetup();
+    thread_states_.release();
 }
 
 void PythonNode::setupParameters(Parameterizable &parameters)
 {
     setupVariadicParameters(parameters);
+
+    controls_.setNodeModifier(node_modifier_);
+    controls_.setupParameters(parameters);
+
+    setupTileParameters(parameters);
 }
 
 bool PythonNode::canProcess() const
@@ -205,63 +413,307 @@ bool PythonNode::canProcess() const
     return is_setup_;
 }
 
-void PythonNode::flush()
+bool PythonNode::reportError()
 {
-    bp::exec("import sys\n"
-             "sys.stdout.flush()\n", globals, globals);
+    std::string report;
+    if(error_handler_.handle(report)) {
+        std::cerr << "Error in Python: " << report << std::endl;
+        return true;
+    }
+    return false;
+}
+
+bool PythonNode::saveState(PythonStatePersistence::Snapshot &snapshot)
+{
+    std::unique_lock<std::mutex> lock(state_mutex_);
+
+    // the flag is only set after the script has run, so a capture never misses a change
+    if(state_changed_.exchange(false)) {
+        PythonStatePersistence::Snapshot captured;
+        if(!is_setup_ || !captureState(captured)) {
+            state_changed_ = true;
+            return false;
+        }
+        keepState(captured);
+        PythonStatePersistence::release(captured);
+    }
+
+    snapshot = saved_state_;
+    return !snapshot.empty();
+}
+
+void PythonNode::keepState(const PythonStatePersistence::Snapshot &snapshot)
+{
+    PythonStatePersistence::retain(snapshot);
+    PythonStatePersistence::release(saved_state_);
+    saved_state_ = snapshot;
 }
 
-void PythonNode::call(const std::string& method)
+bool PythonNode::captureState(PythonStatePersistence::Snapshot &snapshot)
 {
-    PyEval_AcquireThread(thread_state);
+    PythonMemoryArena::Scope memory_scope(controls_.memoryBudget().getArena());
 
+    thread_states_.acquire();
+
+    // a script without __getstate__ leaves the snapshot empty
+    bool captured = false;
     try {
-        globals[method]();
+        PythonStatePersistence::capture(globals, snapshot);
+        captured = true;
 
-        flush();
+    } catch( bp::error_already_set ) {
+        reportError();
+    } catch(const std::exception& e) {
+        std::cerr << "Cannot save the python state: " << e.what() << std::endl;
+    }
+
+    thread_states_.release();
+
+    return captured;
+}
+
+void PythonNode::restoreState(const PythonStatePersistence::Snapshot &snapshot)
+{
+    {
+        // until the script runs, its state is the restored one
+        std::unique_lock<std::mutex> lock(state_mutex_);
+        keepState(snapshot);
+        state_changed_ = false;
+    }
+
+    pending_state_ = snapshot;
 
-        std::cout << std::flush;
-        std::cerr << std::flush;
-        std::clog << std::flush;
+    if(is_setup_) {
+        PythonMemoryArena::Scope memory_scope(controls_.memoryBudget().getArena());
+
+        thread_states_.acquire();
+        applyPendingState();
+        thread_states_.release();
+    }
+}
+
+void PythonNode::applyPendingState()
+{
+    if(pending_state_.empty()) {
+        return;
+    }
+
+    PythonStatePersistence::Snapshot snapshot;
+    std::swap(snapshot, pending_state_);
+
+    try {
+        PythonStatePersistence::restore(globals, snapshot);
 
     } catch( bp::error_already_set ) {
-        PyErr_Print();
+        reportError();
+    } catch(const std::exception& e) {
+        std::cerr << "Cannot restore the python state: " << e.what() << std::endl;
+    }
+}
+
+void PythonNode::setupTileParameters(Parameterizable &parameters)
+{
+    // the workers share the GIL with all other interpreters, pure python code does not scale with them
+    parameters.addParameter(param::factory::declareBool("tiles/enabled",
+                                                        param::ParameterDescription("Calls process_tile(tile, info) on tiles of the first input "
+                                                                                    "in parallel. Only code that releases the GIL, like numpy "
+                                                                                    "and OpenCV kernels, runs concurrently, pure Python code "
+                                                                                    "is executed one tile at a time."),
+                                                        false),
+                            tile_mode_);
+
+    auto enabled = [this]() {
+        return tile_mode_;
+    };
+    parameters.addConditionalParameter(param::factory::declareRange("tiles/size", 32, 4096, 512, 32), enabled,
+                                       [this](param::Parameter* p) {
+        tile_processor_.setTileSize(p->as<int>());
+    });
+    parameters.addConditionalParameter(param::factory::declareRange("tiles/overlap", 0, 512, 16, 1), enabled,
+                                       [this](param::Parameter* p) {
+        tile_processor_.setOverlap(p->as<int>());
+    });
+    int workers = std::max(1, std::min(16, static_cast<int>(std::thread::hardware_concurrency())));
+    parameters.addConditionalParameter(param::factory::declareRange("tiles/workers",
+                                                                    param::ParameterDescription("Threads processing tiles, they only help while "
+                                                                                                "process_tile is in code that releases the GIL."),
+                                                                    1, 64, workers, 1), enabled,
+                                       [this](param::Parameter* p) {
+        tile_processor_.setWorkerCount(p->as<int>());
+    });
+}
+
+bool PythonNode::processTiles()
+{
+    if(message_inputs_.empty() || message_outputs_.empty()) {
+        throw std::runtime_error("tile mode requires an input and an output");
+    }
+    auto image = std::dynamic_pointer_cast<connection_types::CvMatMessage const>(msg::getMessage(message_inputs_.front().get()));
+    if(!image) {
+        throw std::runtime_error("tile mode requires an image on the first input");
+    }
+    if(image->value.empty()) {
+        // nothing to split, and an empty result is not worth publishing
+        return true;
+    }
+
+    PythonMemoryArena::Scope memory_scope(controls_.memoryBudget().getArena());
+
+    std::string error;
+    thread_states_.acquire();
+    bool prepared = tile_processor_.prepare(executed_code_, error);
+    thread_states_.release();
+
+    cv::Mat result;
+    if(!prepared || !tile_processor_.process(image->value, result, error)) {
+        std::cerr << "Error in Python: " << error << std::endl;
         node_handle_->setError("Error in Python script.");
+        controls_.errorShown();
+        return false;
+    }
+
+    const Encoding& encoding = result.channels() == image->value.channels() ? image->getEncoding()
+                                                                              : (result.channels() == 1 ? enc::mono : enc::unknown);
+    auto res = std::make_shared<connection_types::CvMatMessage>(encoding, image->frame_id, image->stamp_micro_seconds);
+    res->value = result;
+    PythonResultCache::publish(message_outputs_.front().get(), res);
+
+    controls_.updateStatistics();
+    return true;
+}
+
+void PythonNode::flush()
+{
+    bp::exec("import sys\n"
+             "sys.stdout.flush()\n", globals, globals);
+}
+
+bool PythonNode::call(const std::string& method)
+{
+    PythonMemoryArena::Scope memory_scope(controls_.memoryBudget().getArena());
+    PythonHistory::Scope history_scope(&history_);
+    PythonSignals::Scope signals_scope(&controls_.signals());
+    PythonParameters::Scope parameters_scope(&script_parameters_);
+
+    thread_states_.acquire();
+
+    bool success = false;
+    {
+        // the settings apply once the GIL is held, so that waiting for it is not affected by them
+        PythonSchedulingPolicy::Scope scheduling_scope(&controls_.schedulingPolicy());
+        try {
+            controls_.gcPolicy().beforeCall();
+            script_parameters_.notify(globals);
+
+            if(method != "setup") {
+                controls_.deadline().begin();
+            }
+            globals[method]();
+            controls_.finishDeadline(controls_.deadline().end());
+
+            if(method == "process") {
+                controls_.gcPolicy().afterProcess();
+            }
+
+            flush();
+
+            std::cout << std::flush;
+            std::cerr << std::flush;
+            std::clog << std::flush;
+
+            success = true;
+
+        } catch( bp::error_already_set ) {
+            if(controls_.finishDeadline(controls_.deadline().end())) {
+                // interrupted by the watchdog, the rest of the call is skipped,
+                // messages published before the interrupt are still sent
+                PyErr_Clear();
+            } else {
+                // repeated errors are only logged once per interval, but the node shows each of them
+                reportError();
+                node_handle_->setError("Error in Python script.");
+                controls_.errorShown();
+            }
+        }
     }
 
-    PyEval_ReleaseThread(thread_state);
+    thread_states_.release();
+
+    state_changed_ = true;
+
+    controls_.signals().flushEvents();
+
+    controls_.updateStatistics();
+
+    return success;
 }
 
 bool PythonNode::exists(const std::string &method)
 {
-    PyEval_AcquireThread(thread_state);
+    thread_states_.acquire();
 
     bool res = false;
     try {
         res = is_setup_ && globals.contains(method) != bp::object();
     } catch( bp::error_already_set ) {
-        PyErr_Print();
+        reportError();
     }
 
-    PyEval_ReleaseThread(thread_state);
+    thread_states_.release();
 
     return res;
 }
 
 void PythonNode::process()
 {
-    if(exists("process")) {
-        call("process");
+    installPendingCode();
+
+    if(controls_.frameDropPolicy().shouldDrop(message_inputs_)) {
+        controls_.updateStatistics();
+        return;
+    }
+
+    if(!controls_.admitFrame()) {
+        return;
+    }
+
+    // identical inputs are answered from the cache without entering the interpreter
+    std::uint64_t cache_key = 0;
+    std::uint64_t cache_stamp = 0;
+    bool cacheable = controls_.resultCache().isEnabled() && controls_.resultCache().hash(message_inputs_, cache_key, cache_stamp);
+    if(cacheable && controls_.resultCache().replay(cache_key, cache_stamp)) {
+        controls_.updateStatistics();
+        return;
     }
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        PythonResultCache::Recording recording(cacheable);
+        bool success = false;
+        if(tile_mode_ && exists("process_tile")) {
+            success = processTiles();
+        } else if(exists("process")) {
+            success = call("process");
+        }
+        if(cacheable && success) {
+            controls_.resultCache().store(cache_key, cache_stamp, recording.getOutputs());
+        }
+    }
+    controls_.frameDropPolicy().processed(std::chrono::steady_clock::now() - start);
+
+    controls_.updateStatistics();
 }
 
 
 void PythonNode::processMarker(const connection_types::MessageConstPtr &marker)
 {
+    installPendingCode();
+
     if(std::dynamic_pointer_cast<connection_types::NoMessage const>(marker)) {
         if(exists("processNoMessage")) {
             call("processNoMessage");
         }
+        controls_.collectDeferredGarbage();
 
     } else if(std::dynamic_pointer_cast<connection_types::EndOfProgramMessage const>(marker)) {
         if(exists("processEndOfProgram")) {
@@ -272,6 +724,7 @@ void PythonNode::processMarker(const connection_types::MessageConstPtr &marker)
         if(exists("processEndOfSequence")) {
             call("processEndOfSequence");
         }
+        controls_.collectDeferredGarbage();
     }
 }
 
@@ -284,6 +737,14 @@ public:
     static void serialize(const PythonNode& node, YAML::Node& doc)
     {
         doc["code"] = node.getCode();
+
+        // saving runs __getstate__ in the interpreter of the node
+        PythonStatePersistence::Snapshot state;
+        if(const_cast<PythonNode&>(node).saveState(state)) {
+            YAML::Node state_doc;
+            PythonStatePersistence::write(state, state_doc);
+            doc["state"] = state_doc;
+        }
     }
 
     static void deserialize(PythonNode& node, const YAML::Node& doc)
@@ -291,6 +752,11 @@ public:
         if(doc["code"].IsDefined()) {
             node.setCode(doc["code"].as<std::string>());
         }
+
+        PythonStatePersistence::Snapshot state;
+        if(doc["state"].IsDefined() && PythonStatePersistence::read(doc["state"], state)) {
+            node.restoreState(state);
+        }
     }
 };
 }
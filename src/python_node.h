@@ -5,14 +5,38 @@
 #include <csapex/model/node.h>
 #include <csapex/model/variadic_io.h>
 
+/// COMPONENT
+#include "python_error_handler.h"
+#include "python_history.h"
+#include "python_parameters.h"
+#include "python_request_guard.h"
+#include "python_runtime_controls.h"
+#include "python_state_persistence.h"
+#include "python_thread_states.h"
+#include "python_tile_processor.h"
+
 /// SYSTEM
 #include <boost/python.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 namespace csapex
 {
 
 class PythonNode : public Node, public Variadic
 {
+public:
+    enum class CompileState {
+        COMPILING,
+        QUEUED,
+        INSTALLED,
+        FAILED
+    };
+    typedef std::function<void(CompileState, const std::string&)> CompileCallback;
+
 public:
     PythonNode();
     ~PythonNode();
@@ -20,6 +44,22 @@ public:
     std::string getCode() const;
     void setCode(const std::string& code);
 
+    /**
+     * @brief saveState captures what the script returns from __getstate__, the capture is
+     *        reused until the script has run again, e.g. for copies and undo steps
+     * @return false, iff there is no state to save
+     */
+    bool saveState(PythonStatePersistence::Snapshot& snapshot);
+
+    //! passes the state to __setstate__, once the code has been executed
+    void restoreState(const PythonStatePersistence::Snapshot& snapshot);
+
+    /**
+     * @brief compileAsync checks the code on a background thread and installs it
+     *        on the execution thread of the node, progress is reported via callback
+     */
+    void compileAsync(const std::string& code, CompileCallback callback);
+
     virtual void setup(csapex::NodeModifier& node_modifier) override;
     virtual void setupParameters(Parameterizable &parameters) override;
 
@@ -32,19 +72,62 @@ public:
 
 private:
     void refreshCode();
+    void updatePorts();
+    void codeExecuted(const std::string& code);
+
+    void compileLoop();
+    void installPendingCode();
+    void applyPendingState();
+    bool captureState(PythonStatePersistence::Snapshot& snapshot);
+    void keepState(const PythonStatePersistence::Snapshot& snapshot);
+
+    bool reportError();
+
+    void setupTileParameters(Parameterizable& parameters);
+    bool processTiles();
 
     void flush();
     bool exists(const std::string& method);
-    void call(const std::string& method);
+    bool call(const std::string& method);
 
 private:
     std::string code_;
+    std::string executed_code_;
     bool is_setup_;
     bool python_is_initialized_;
 
-    PyThreadState* thread_state;
+    PythonThreadStates thread_states_;
     boost::python::object globals;
     boost::python::dict locals;
+
+    PythonErrorHandler error_handler_;
+    PythonRuntimeControls controls_;
+    PythonParameters script_parameters_;
+    std::vector<InputPtr> message_inputs_;
+    std::vector<OutputPtr> message_outputs_;
+    PythonHistory history_;
+    bool tile_mode_;
+    PythonTileProcessor tile_processor_;
+    PythonStatePersistence::Snapshot pending_state_;
+
+    std::mutex state_mutex_;
+    PythonStatePersistence::Snapshot saved_state_;
+    std::atomic<bool> state_changed_;
+
+    std::thread compile_thread_;
+    std::mutex compile_mutex_;
+    std::condition_variable compile_changed_;
+    bool compile_running_;
+    bool has_compile_request_;
+    std::string compile_request_;
+    CompileCallback compile_callback_;
+
+    std::atomic<bool> has_pending_code_;
+    std::string pending_source_;
+    boost::python::object pending_code_;
+    CompileCallback pending_callback_;
+
+    PythonRequestGuard requests_;
 };
 
 }
@@ -13,14 +13,25 @@
 #include <QEvent>
 #include <QResizeEvent>
 #include <QString>
+#include <QMetaObject>
+#include <algorithm>
 
 using namespace csapex;
 
 CSAPEX_REGISTER_LOCAL_NODE_ADAPTER(PythonNodeAdapter, csapex::PythonNode)
 
 PythonNodeAdapter::PythonNodeAdapter(NodeFacadeImplementationPtr node, NodeBox* parent, std::weak_ptr<PythonNode> instance)
-    : ResizableNodeAdapter(node, parent), instance_(instance)
+    : ResizableNodeAdapter(node, parent), instance_(instance),
+      compile_receiver_(std::make_shared<CompileReceiver>())
 {
+    compile_receiver_->adapter = this;
+}
+
+PythonNodeAdapter::~PythonNodeAdapter()
+{
+    // results that are already posted are discarded together with the adapter
+    std::unique_lock<std::mutex> lock(compile_receiver_->mutex);
+    compile_receiver_->adapter = nullptr;
 }
 
 void PythonNodeAdapter::setupUi(QBoxLayout* layout)
@@ -38,8 +49,13 @@ void PythonNodeAdapter::setupUi(QBoxLayout* layout)
 
     QPushButton* submit = new QPushButton("submit");
 
+    status = new QLabel;
+    status->setWordWrap(true);
+    status->setTextInteractionFlags(Qt::TextSelectableByMouse);
+
     layout->addWidget(editor);
     layout->addWidget(submit);
+    layout->addWidget(status);
 
     QObject::connect(submit, SIGNAL(clicked()), this, SLOT(compile()));
 
@@ -92,7 +108,34 @@ void PythonNodeAdapter::compile()
     if(!node) {
         return;
     }
-    node->setCode(editor->toPlainText().toStdString());
+
+    // compilation and installation happen off the GUI thread, results are reported back queued
+    std::shared_ptr<CompileReceiver> receiver = compile_receiver_;
+    node->compileAsync(editor->toPlainText().toStdString(), [receiver](PythonNode::CompileState state, const std::string& message) {
+        std::unique_lock<std::mutex> lock(receiver->mutex);
+        if(receiver->adapter) {
+            QMetaObject::invokeMethod(receiver->adapter, "showCompileState", Qt::QueuedConnection,
+                                      Q_ARG(int, static_cast<int>(state)),
+                                      Q_ARG(QString, QString::fromStdString(message)));
+        }
+    });
+}
+
+void PythonNodeAdapter::showCompileState(int state, const QString& message)
+{
+    switch(static_cast<PythonNode::CompileState>(state)) {
+    case PythonNode::CompileState::COMPILING:
+    case PythonNode::CompileState::QUEUED:
+        status->setStyleSheet("color: gray");
+        break;
+    case PythonNode::CompileState::INSTALLED:
+        status->setStyleSheet("color: darkgreen");
+        break;
+    case PythonNode::CompileState::FAILED:
+        status->setStyleSheet("color: red");
+        break;
+    }
+    status->setText(message);
 }
 
 
@@ -100,148 +143,205 @@ void PythonNodeAdapter::compile()
 PythonSyntaxHighlighter::PythonSyntaxHighlighter(QTextDocument *parent)
     : QSyntaxHighlighter(parent)
 {
-    keywords = QStringList() << "and" << "assert" << "break" << "class" << "continue" << "def" <<
-                                "del" << "elif" << "else" << "except" << "exec" << "finally" <<
-                                "for" << "from" << "global" << "if" << "import" << "in" <<
-                                "is" << "lambda" << "not" << "or" << "pass" << "print" <<
-                                "raise" << "return" << "try" << "while" << "yield" <<
-                                "None" << "True" << "False";
-
-    operators = QStringList() << "=" <<
-                                 // Comparison
-                                 "==" << "!=" << "<" << "<=" << ">" << ">=" <<
-                                 // Arithmetic
-                                 "\\+" << "-" << "\\*" << "/" << "//" << "%" << "\\*\\*" <<
-                                 // In-place
-                                 "\\+=" << "-=" << "\\*=" << "/=" << "%=" <<
-                                 // Bitwise
-                                 "\\^" << "\\|" << "&" << "~" << ">>" << "<<";
-
-    braces = QStringList() << "{" << "}" << "\\(" << "\\)" << "\\[" << "]";
-
-    basicStyles.insert("keyword", getTextCharFormat("blue"));
-    basicStyles.insert("operator", getTextCharFormat("red"));
-    basicStyles.insert("brace", getTextCharFormat("darkGray"));
-    basicStyles.insert("defclass", getTextCharFormat("black", "bold"));
-    basicStyles.insert("brace", getTextCharFormat("darkGray"));
-    basicStyles.insert("string", getTextCharFormat("magenta"));
-    basicStyles.insert("string2", getTextCharFormat("darkMagenta"));
-    basicStyles.insert("comment", getTextCharFormat("darkGreen", "italic"));
-    basicStyles.insert("self", getTextCharFormat("black", "italic"));
-    basicStyles.insert("numbers", getTextCharFormat("brown"));
-
-    triSingleQuote.setPattern("'''");
-    triDoubleQuote.setPattern("\"\"\"");
-
-    initializeRules();
+    keywords << "and" << "as" << "assert" << "async" << "await" << "break" << "class" << "continue" << "def" <<
+                "del" << "elif" << "else" << "except" << "exec" << "finally" <<
+                "for" << "from" << "global" << "if" << "import" << "in" <<
+                "is" << "lambda" << "nonlocal" << "not" << "or" << "pass" << "print" <<
+                "raise" << "return" << "try" << "while" << "with" << "yield" <<
+                "None" << "True" << "False";
+
+    operators = "=!<>+-*/%^|&~@";
+    opening_braces = "([{";
+    closing_braces = ")]}";
+
+    keyword_format = getTextCharFormat("blue");
+    operator_format = getTextCharFormat("red");
+    brace_format = getTextCharFormat("darkGray");
+    unmatched_brace_format = getTextCharFormat("red", "bold");
+    defclass_format = getTextCharFormat("black", "bold");
+    string_format = getTextCharFormat("magenta");
+    multiline_string_format = getTextCharFormat("darkMagenta");
+    comment_format = getTextCharFormat("darkGreen", "italic");
+    self_format = getTextCharFormat("black", "italic");
+    number_format = getTextCharFormat("brown");
 }
 
-void PythonSyntaxHighlighter::initializeRules()
+void PythonSyntaxHighlighter::highlightBlock(const QString &text)
 {
-    for(const auto& currKeyword: keywords)
-    {
-        rules.append(HighlightingRule(QString("\\b%1\\b").arg(currKeyword), 0, basicStyles.value("keyword")));
-    }
-    for(const auto& currOperator: operators)
-    {
-        rules.append(HighlightingRule(QString("%1").arg(currOperator), 0, basicStyles.value("operator")));
-    }
-    for(const auto& currBrace: braces)
-    {
-        rules.append(HighlightingRule(QString("%1").arg(currBrace), 0, basicStyles.value("brace")));
+    int previous = previousBlockState();
+    int string_state = previous < 0 ? NO_STRING : previous;
+
+    // braces opened in this block, closing braces of earlier blocks continue a statement
+    QString open_braces;
+
+    const int n = text.length();
+    int i = 0;
+
+    // continue a multi-line string from the previous block
+    if(string_state != NO_STRING) {
+        QChar quote = string_state == TRIPLE_SINGLE_QUOTE ? QChar('\'') : QChar('"');
+        int end = findTripleQuoteEnd(text, 0, quote);
+        if(end < 0) {
+            setFormat(0, n, multiline_string_format);
+            setCurrentBlockState(string_state);
+            return;
+        }
+        setFormat(0, end, multiline_string_format);
+        string_state = NO_STRING;
+        i = end;
     }
-    // 'self'
-    rules.append(HighlightingRule("\\bself\\b", 0, basicStyles.value("self")));
-
-    // Double-quoted string, possibly containing escape sequences
-    // FF: originally in python : r'"[^"\\]*(\\.[^"\\]*)*"'
-    rules.append(HighlightingRule("\"[^\"\\\\]*(\\\\.[^\"\\\\]*)*\"", 0, basicStyles.value("string")));
-    // Single-quoted string, possibly containing escape sequences
-    // FF: originally in python : r"'[^'\\]*(\\.[^'\\]*)*'"
-    rules.append(HighlightingRule("'[^'\\\\]*(\\\\.[^'\\\\]*)*'", 0, basicStyles.value("string")));
-
-    // 'def' followed by an identifier
-    // FF: originally: r'\bdef\b\s*(\w+)'
-    rules.append(HighlightingRule("\\bdef\\b\\s*(\\w+)", 1, basicStyles.value("defclass")));
-    //  'class' followed by an identifier
-    // FF: originally: r'\bclass\b\s*(\w+)'
-    rules.append(HighlightingRule("\\bclass\\b\\s*(\\w+)", 1, basicStyles.value("defclass")));
-
-    // From '#' until a newline
-    // FF: originally: r'#[^\\n]*'
-    rules.append(HighlightingRule("#[^\\n]*", 0, basicStyles.value("comment")));
-
-    // Numeric literals
-    rules.append(HighlightingRule("\\b[+-]?[0-9]+[lL]?\\b", 0, basicStyles.value("numbers"))); // r'\b[+-]?[0-9]+[lL]?\b'
-    rules.append(HighlightingRule("\\b[+-]?0[xX][0-9A-Fa-f]+[lL]?\\b", 0, basicStyles.value("numbers"))); // r'\b[+-]?0[xX][0-9A-Fa-f]+[lL]?\b'
-    rules.append(HighlightingRule("\\b[+-]?[0-9]+(?:\\.[0-9]+)?(?:[eE][+-]?[0-9]+)?\\b", 0, basicStyles.value("numbers"))); // r'\b[+-]?[0-9]+(?:\.[0-9]+)?(?:[eE][+-]?[0-9]+)?\b'
-}
 
-void PythonSyntaxHighlighter::highlightBlock(const QString &text)
-{
-    for (const auto currRule: rules)
-    {
-        int idx = currRule.pattern.indexIn(text, 0);
-        while (idx >= 0)
-        {
-            // Get index of Nth match
-            idx = currRule.pattern.pos(currRule.nth);
-            int length = currRule.pattern.cap(currRule.nth).length();
-            setFormat(idx, length, currRule.format);
-            idx = currRule.pattern.indexIn(text, idx + length);
+    bool expect_name = false;
+
+    while(i < n) {
+        const QChar c = text.at(i);
+
+        if(c.isSpace()) {
+            ++i;
+
+        } else if(c == '#') {
+            setFormat(i, n - i, comment_format);
+            break;
+
+        } else if(c == '\'' || c == '"') {
+            if(i + 2 < n && text.at(i + 1) == c && text.at(i + 2) == c) {
+                int end = findTripleQuoteEnd(text, i + 3, c);
+                if(end < 0) {
+                    setFormat(i, n - i, multiline_string_format);
+                    string_state = c == '\'' ? TRIPLE_SINGLE_QUOTE : TRIPLE_DOUBLE_QUOTE;
+                    break;
+                }
+                setFormat(i, end - i, multiline_string_format);
+                i = end;
+
+            } else {
+                int j = i + 1;
+                while(j < n && text.at(j) != c) {
+                    j += text.at(j) == '\\' ? 2 : 1;
+                }
+                int end = std::min(j + 1, n);
+                setFormat(i, end - i, string_format);
+                i = end;
+            }
+
+        } else if(c.isLetter() || c == '_') {
+            int j = i + 1;
+            while(j < n && (text.at(j).isLetterOrNumber() || text.at(j) == '_')) {
+                ++j;
+            }
+
+            QString word = text.mid(i, j - i);
+
+            // string prefixes like r'', b"" or f''
+            if(j < n && (text.at(j) == '\'' || text.at(j) == '"') && isStringPrefix(word)) {
+                setFormat(i, j - i, string_format);
+                i = j;
+                continue;
+            }
+
+            if(expect_name) {
+                setFormat(i, j - i, defclass_format);
+                expect_name = false;
+            } else if(keywords.contains(word)) {
+                setFormat(i, j - i, keyword_format);
+                expect_name = word == "def" || word == "class";
+            } else if(word == "self") {
+                setFormat(i, j - i, self_format);
+            }
+            i = j;
+
+        } else if(c.isDigit() || (c == '.' && i + 1 < n && text.at(i + 1).isDigit())) {
+            int end = scanNumber(text, i);
+            setFormat(i, end - i, number_format);
+            i = end;
+
+        } else if(opening_braces.contains(c)) {
+            setFormat(i, 1, brace_format);
+            open_braces.append(c);
+            ++i;
+
+        } else if(closing_braces.contains(c)) {
+            if(open_braces.isEmpty()) {
+                setFormat(i, 1, brace_format);
+            } else if(opening_braces.indexOf(open_braces.at(open_braces.size() - 1)) == closing_braces.indexOf(c)) {
+                setFormat(i, 1, brace_format);
+                open_braces.chop(1);
+            } else {
+                setFormat(i, 1, unmatched_brace_format);
+            }
+            ++i;
+
+        } else if(operators.contains(c)) {
+            int j = i + 1;
+            while(j < n && operators.contains(text.at(j))) {
+                ++j;
+            }
+            setFormat(i, j - i, operator_format);
+            i = j;
+
+        } else {
+            ++i;
         }
     }
 
-    setCurrentBlockState(0);
+    setCurrentBlockState(string_state);
+}
 
-    // Do multi-line strings
-    bool isInMultilne = matchMultiline(text, triSingleQuote, 1, basicStyles.value("string2"));
-    if (!isInMultilne)
-        isInMultilne = matchMultiline(text, triDoubleQuote, 2, basicStyles.value("string2"));
+bool PythonSyntaxHighlighter::isStringPrefix(const QString &word) const
+{
+    static const QSet<QString> prefixes {
+        "r", "u", "b", "f", "br", "rb", "fr", "rf"
+    };
+    return prefixes.contains(word.toLower());
 }
 
-bool PythonSyntaxHighlighter::matchMultiline(const QString &text, const QRegExp &delimiter, const int inState, const QTextCharFormat &style)
+int PythonSyntaxHighlighter::findTripleQuoteEnd(const QString &text, int start, QChar quote) const
 {
-    int start = -1;
-    int add = -1;
-    int end = -1;
-    int length = 0;
-
-    // If inside triple-single quotes, start at 0
-    if (previousBlockState() == inState) {
-        start = 0;
-        add = 0;
-    }
-    // Otherwise, look for the delimiter on this line
-    else {
-        start = delimiter.indexIn(text);
-        // Move past this match
-        add = delimiter.matchedLength();
+    const int n = text.length();
+    for(int i = start; i < n; ++i) {
+        const QChar c = text.at(i);
+        if(c == '\\') {
+            ++i;
+        } else if(c == quote && i + 2 < n && text.at(i + 1) == quote && text.at(i + 2) == quote) {
+            return i + 3;
+        }
     }
+    return -1;
+}
 
-    // As long as there's a delimiter match on this line...
-    while (start >= 0) {
-        // Look for the ending delimiter
-        end = delimiter.indexIn(text, start + add);
-        // Ending delimiter on this line?
-        if (end >= add) {
-            length = end - start + add + delimiter.matchedLength();
-            setCurrentBlockState(0);
+int PythonSyntaxHighlighter::scanNumber(const QString &text, int start) const
+{
+    const int n = text.length();
+    int i = start;
+
+    if(text.at(i) == '0' && i + 1 < n && (text.at(i + 1) == 'x' || text.at(i + 1) == 'X')) {
+        i += 2;
+        while(i < n && (text.at(i).isDigit() || text.at(i) == '_' ||
+                        (text.at(i).toLower() >= 'a' && text.at(i).toLower() <= 'f'))) {
+            ++i;
+        }
+    } else {
+        while(i < n && (text.at(i).isDigit() || text.at(i) == '.' || text.at(i) == '_')) {
+            ++i;
         }
-        // No; multi-line string
-        else {
-            setCurrentBlockState(inState);
-            length = text.length() - start + add;
+        if(i < n && (text.at(i) == 'e' || text.at(i) == 'E')) {
+            int j = i + 1;
+            if(j < n && (text.at(j) == '+' || text.at(j) == '-')) {
+                ++j;
+            }
+            if(j < n && text.at(j).isDigit()) {
+                i = j;
+                while(i < n && text.at(i).isDigit()) {
+                    ++i;
+                }
+            }
         }
-        // Apply formatting and look for next
-        setFormat(start, length, style);
-        start = delimiter.indexIn(text, start + length);
     }
-    // Return True if still inside a multi-line string, False otherwise
-    if (currentBlockState() == inState)
-        return true;
-    else
-        return false;
+
+    if(i < n && (text.at(i).toLower() == 'l' || text.at(i).toLower() == 'j')) {
+        ++i;
+    }
+    return i;
 }
 
 const QTextCharFormat PythonSyntaxHighlighter::getTextCharFormat(const QString &colorName, const QString &style)
@@ -11,28 +11,22 @@
 /// SYSTEM
 #include <QGraphicsView>
 #include <QTextEdit>
+#include <QLabel>
 #include <QSyntaxHighlighter>
+#include <QSet>
+#include <memory>
+#include <mutex>
 #include <yaml-cpp/yaml.h>
 
 namespace csapex {
 
 
-class HighlightingRule
-{
-public:
-    HighlightingRule(const QString &patternStr, int n, const QTextCharFormat &matchingFormat)
-    {
-        originalRuleStr = patternStr;
-        pattern = QRegExp(patternStr);
-        nth = n;
-        format = matchingFormat;
-    }
-    QString originalRuleStr;
-    QRegExp pattern;
-    int nth;
-    QTextCharFormat format;
-};
-
+/**
+ * @brief The PythonSyntaxHighlighter classifies a block in a single left-to-right scan.
+ *        Only open triple quoted strings are carried over to the next block via the
+ *        block state, so that typing rehighlights the following blocks only when a
+ *        string is opened or closed. Braces are therefore matched within a block.
+ */
 class PythonSyntaxHighlighter : public QSyntaxHighlighter
 {
     Q_OBJECT
@@ -41,21 +35,34 @@ public:
 protected:
     void highlightBlock(const QString &text);
 private:
-    QStringList keywords;
-    QStringList operators;
-    QStringList braces;
-
-    QHash<QString, QTextCharFormat> basicStyles;
-
-    void initializeRules();
+    enum StringState {
+        NO_STRING = 0,
+        TRIPLE_SINGLE_QUOTE = 1,
+        TRIPLE_DOUBLE_QUOTE = 2
+    };
 
-    //! Highlights multi-line strings, returns true if after processing we are still within the multi-line section.
-    bool matchMultiline(const QString &text, const QRegExp &delimiter, const int inState, const QTextCharFormat &style);
+    //! Returns the index after the closing triple quote, or -1 if the string does not end in this block.
+    int findTripleQuoteEnd(const QString &text, int start, QChar quote) const;
+    //! Returns true if the word is a valid combination of the string prefixes r, b, u and f.
+    bool isStringPrefix(const QString &word) const;
+    int scanNumber(const QString &text, int start) const;
     const QTextCharFormat getTextCharFormat(const QString &colorName, const QString &style = QString());
 
-    QList<HighlightingRule> rules;
-    QRegExp triSingleQuote;
-    QRegExp triDoubleQuote;
+    QSet<QString> keywords;
+    QString operators;
+    QString opening_braces;
+    QString closing_braces;
+
+    QTextCharFormat keyword_format;
+    QTextCharFormat operator_format;
+    QTextCharFormat brace_format;
+    QTextCharFormat unmatched_brace_format;
+    QTextCharFormat defclass_format;
+    QTextCharFormat string_format;
+    QTextCharFormat multiline_string_format;
+    QTextCharFormat comment_format;
+    QTextCharFormat self_format;
+    QTextCharFormat number_format;
 };
 
 class PythonNodeAdapter : public QObject, public ResizableNodeAdapter
@@ -64,6 +71,7 @@ class PythonNodeAdapter : public QObject, public ResizableNodeAdapter
 
 public:
     PythonNodeAdapter(NodeFacadeImplementationPtr node, NodeBox* parent, std::weak_ptr<PythonNode> instance);
+    ~PythonNodeAdapter();
 
     virtual void setupUi(QBoxLayout* layout) override;
 
@@ -76,6 +84,7 @@ public:
 
 private Q_SLOTS:
     void compile();
+    void showCompileState(int state, const QString& message);
 
     void resize(const QSize& size) override;
 
@@ -105,6 +114,15 @@ private:
 
     QTextEdit* editor;
     PythonSyntaxHighlighter* highlighter;
+    QLabel* status;
+
+    //! compile results are posted to the adapter only as long as it exists
+    struct CompileReceiver
+    {
+        std::mutex mutex;
+        PythonNodeAdapter* adapter;
+    };
+    std::shared_ptr<CompileReceiver> compile_receiver_;
 };
 
 }
@@ -0,0 +1,68 @@
+/// HEADER
+#include "python_parallel.h"
+
+/// SYSTEM
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace csapex;
+
+ScopedGilRelease::ScopedGilRelease()
+    : state_(PyEval_SaveThread())
+{
+}
+
+ScopedGilRelease::~ScopedGilRelease()
+{
+    PyEval_RestoreThread(state_);
+}
+
+namespace csapex
+{
+void parallelFor(std::size_t n, std::size_t min_chunk, const std::function<void(std::size_t, std::size_t)>& fn)
+{
+    if(n == 0) {
+        return;
+    }
+
+    std::size_t hardware = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    std::size_t threads = std::min(hardware, (n + min_chunk - 1) / std::max<std::size_t>(1, min_chunk));
+    if(threads <= 1) {
+        fn(0, n);
+        return;
+    }
+
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto run = [&](std::size_t begin, std::size_t end) {
+        try {
+            fn(begin, end);
+        } catch(...) {
+            std::unique_lock<std::mutex> lock(error_mutex);
+            if(!error) {
+                error = std::current_exception();
+            }
+        }
+    };
+
+    std::size_t chunk = (n + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for(std::size_t begin = chunk; begin < n; begin += chunk) {
+        workers.emplace_back(run, begin, std::min(n, begin + chunk));
+    }
+    // the calling thread takes the first chunk itself
+    run(0, std::min(n, chunk));
+
+    for(std::thread& worker : workers) {
+        worker.join();
+    }
+
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+}
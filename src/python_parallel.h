@@ -0,0 +1,37 @@
+#ifndef PYTHON_PARALLEL_H
+#define PYTHON_PARALLEL_H
+
+/// SYSTEM
+#include <Python.h>
+#include <cstddef>
+#include <functional>
+
+namespace csapex
+{
+
+/**
+ * @brief The ScopedGilRelease releases the GIL of the calling thread for its lifetime.
+ */
+class ScopedGilRelease
+{
+public:
+    ScopedGilRelease();
+    ~ScopedGilRelease();
+
+    ScopedGilRelease(const ScopedGilRelease&) = delete;
+    ScopedGilRelease& operator = (const ScopedGilRelease&) = delete;
+
+private:
+    PyThreadState* state_;
+};
+
+/**
+ * @brief parallelFor splits [0, n) into chunks of at least min_chunk elements
+ *        and calls fn(begin, end) for each of them on multiple threads.
+ *        The first exception thrown by fn is rethrown on the calling thread.
+ */
+void parallelFor(std::size_t n, std::size_t min_chunk, const std::function<void(std::size_t, std::size_t)>& fn);
+
+}
+
+#endif // PYTHON_PARALLEL_H
@@ -0,0 +1,261 @@
+/// HEADER
+#include "python_parameters.h"
+
+/// PROJECT
+#include <csapex/param/parameter_factory.h>
+
+/// SYSTEM
+#include <type_traits>
+
+using namespace csapex;
+namespace bp = boost::python;
+
+namespace
+{
+thread_local PythonParameters* g_current_parameters = nullptr;
+
+void raise(PyObject* type, const std::string& message)
+{
+    PyErr_SetString(type, message.c_str());
+    bp::throw_error_already_set();
+}
+
+bool is_int(PyObject* object)
+{
+#if PY_MAJOR_VERSION >= 3
+    return PyLong_Check(object);
+#else
+    return PyInt_Check(object) || PyLong_Check(object);
+#endif
+}
+
+bool is_text(PyObject* object)
+{
+#if PY_MAJOR_VERSION >= 3
+    return PyUnicode_Check(object);
+#else
+    return PyString_Check(object) || PyUnicode_Check(object);
+#endif
+}
+
+template <typename T>
+param::ParameterPtr declare_number(const std::string& name, const bp::object& def, const bp::object& range)
+{
+    T value = bp::extract<T>(def);
+    if(range.is_none()) {
+        return param::factory::declareValue<T>(name, value);
+    }
+
+    long n = bp::len(range);
+    if(n != 2 && n != 3) {
+        raise(PyExc_ValueError, "the range of " + name + " has to be (min, max) or (min, max, step)");
+    }
+    T min = bp::extract<T>(range[0]);
+    T max = bp::extract<T>(range[1]);
+    T step = n == 3 ? static_cast<T>(bp::extract<T>(range[2])) : std::is_integral<T>::value ? T(1) : (max - min) / T(100);
+    return param::factory::declareRange<T>(name, min, max, value, step);
+}
+
+std::shared_ptr<PythonParameter> declare_param(const std::string& name, const bp::object& def, const bp::object& range)
+{
+    PythonParameters* parameters = PythonParameters::current();
+    if(!parameters) {
+        raise(PyExc_RuntimeError, "parameters can only be declared from the setup of a python node");
+    }
+    return parameters->declare(name, def, range);
+}
+}
+
+PythonParameter::PythonParameter(const std::string &name, Type type)
+    : name_(name), type_(type), version_(0), number_(0.0), cached_version_(0), notified_version_(0)
+{
+}
+
+const std::string& PythonParameter::getName() const
+{
+    return name_;
+}
+
+void PythonParameter::update(param::Parameter *parameter)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    switch(type_) {
+    case Type::BOOL:
+        number_ = parameter->as<bool>() ? 1.0 : 0.0;
+        break;
+    case Type::INT:
+        number_ = parameter->as<int>();
+        break;
+    case Type::DOUBLE:
+        number_ = parameter->as<double>();
+        break;
+    case Type::TEXT:
+        text_ = parameter->as<std::string>();
+        break;
+    }
+    version_.fetch_add(1, std::memory_order_release);
+}
+
+bp::object PythonParameter::value()
+{
+    if(version_.load(std::memory_order_acquire) != cached_version_) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        switch(type_) {
+        case Type::BOOL:
+            cached_ = bp::object(number_ != 0.0);
+            break;
+        case Type::INT:
+            cached_ = bp::object(static_cast<long>(number_));
+            break;
+        case Type::DOUBLE:
+            cached_ = bp::object(number_);
+            break;
+        case Type::TEXT:
+            cached_ = bp::object(text_);
+            break;
+        }
+        cached_version_ = version_;
+    }
+    return cached_;
+}
+
+bool PythonParameter::consumeChange()
+{
+    std::uint64_t version = version_;
+    if(version == notified_version_) {
+        return false;
+    }
+    notified_version_ = version;
+    return true;
+}
+
+void PythonParameter::release()
+{
+    cached_ = bp::object();
+    cached_version_ = 0;
+}
+
+
+PythonParameters::Scope::Scope(PythonParameters *parameters)
+    : previous_(g_current_parameters)
+{
+    g_current_parameters = parameters;
+}
+
+PythonParameters::Scope::~Scope()
+{
+    g_current_parameters = previous_;
+}
+
+PythonParameters* PythonParameters::current()
+{
+    return g_current_parameters;
+}
+
+PythonParameters::PythonParameters(Parameterizable *owner)
+    : owner_(owner), changed_(false)
+{
+}
+
+std::shared_ptr<PythonParameter> PythonParameters::declare(const std::string &name, const bp::object &def,
+                                                           const bp::object &range)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto pos = handles_.find(name);
+        if(pos != handles_.end()) {
+            return pos->second;
+        }
+    }
+
+    PyObject* object = def.ptr();
+
+    std::shared_ptr<PythonParameter> handle;
+    param::ParameterPtr parameter;
+    if(PyBool_Check(object)) {
+        handle = std::make_shared<PythonParameter>(name, PythonParameter::Type::BOOL);
+        parameter = param::factory::declareBool(name, bp::extract<bool>(def));
+    } else if(is_int(object)) {
+        handle = std::make_shared<PythonParameter>(name, PythonParameter::Type::INT);
+        parameter = declare_number<int>(name, def, range);
+    } else if(PyFloat_Check(object)) {
+        handle = std::make_shared<PythonParameter>(name, PythonParameter::Type::DOUBLE);
+        parameter = declare_number<double>(name, def, range);
+    } else if(is_text(object)) {
+        handle = std::make_shared<PythonParameter>(name, PythonParameter::Type::TEXT);
+        parameter = param::factory::declareText(name, bp::extract<std::string>(def));
+    } else {
+        raise(PyExc_TypeError, "the default of " + name + " has to be a bool, int, float or str");
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        handles_[name] = handle;
+    }
+
+    owner_->addParameter(parameter, [this, handle](param::Parameter* p) {
+        handle->update(p);
+        changed_ = true;
+        if(change_callback_) {
+            change_callback_();
+        }
+    });
+
+    // the initial or restored value does not count as a change
+    handle->update(parameter.get());
+    handle->consumeChange();
+
+    return handle;
+}
+
+void PythonParameters::setChangeCallback(const std::function<void()> &callback)
+{
+    change_callback_ = callback;
+}
+
+void PythonParameters::notify(const bp::object &globals)
+{
+    if(!changed_.exchange(false)) {
+        return;
+    }
+
+    std::vector<std::shared_ptr<PythonParameter>> handles;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for(const auto& entry : handles_) {
+            handles.push_back(entry.second);
+        }
+    }
+
+    bp::object callback;
+    if(PyObject* existing = PyDict_GetItemString(globals.ptr(), "on_param_changed")) {
+        callback = bp::object(bp::handle<>(bp::borrowed(existing)));
+    }
+    for(const std::shared_ptr<PythonParameter>& handle : handles) {
+        if(handle->consumeChange() && !callback.is_none()) {
+            callback(handle->getName(), handle->value());
+        }
+    }
+}
+
+void PythonParameters::release()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(const auto& entry : handles_) {
+        entry.second->release();
+    }
+}
+
+namespace csapex
+{
+void registerParameters()
+{
+    bp::class_<PythonParameter, std::shared_ptr<PythonParameter>, boost::noncopyable>("Param", bp::no_init)
+            .add_property("name", bp::make_function(&PythonParameter::getName, bp::return_value_policy<bp::copy_const_reference>()))
+            .add_property("value", &PythonParameter::value)
+            .def("__call__", &PythonParameter::value)
+            ;
+
+    bp::def("param", &declare_param, (bp::arg("name"), bp::arg("default"), bp::arg("range") = bp::object()));
+}
+}
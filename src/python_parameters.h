@@ -0,0 +1,122 @@
+#ifndef PYTHON_PARAMETERS_H
+#define PYTHON_PARAMETERS_H
+
+/// PROJECT
+#include <csapex/model/node.h>
+
+/// SYSTEM
+#include <boost/python.hpp>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonParameter is the handle returned by csapex.param(...).
+ *
+ * Parameter changes are pushed into the handle and only bump its version. Reading
+ * the value compares the version with the one of the cached python object, the
+ * object is only converted again after a change.
+ */
+class PythonParameter
+{
+public:
+    enum class Type {
+        BOOL,
+        INT,
+        DOUBLE,
+        TEXT
+    };
+
+public:
+    PythonParameter(const std::string& name, Type type);
+
+    const std::string& getName() const;
+
+    //! copies the value of the parameter, can be called from any thread
+    void update(param::Parameter* parameter);
+
+    //! requires the GIL
+    boost::python::object value();
+
+    //! returns true once for each change that has not been passed to on_param_changed, requires the GIL
+    bool consumeChange();
+
+    //! drops the cached value, requires the GIL
+    void release();
+
+private:
+    std::string name_;
+    Type type_;
+
+    std::mutex mutex_;
+    std::atomic<std::uint64_t> version_;
+    double number_;
+    std::string text_;
+
+    std::uint64_t cached_version_;
+    std::uint64_t notified_version_;
+    boost::python::object cached_;
+};
+
+/**
+ * @brief The PythonParameters declare the parameters a script requests with
+ *        csapex.param(name, default, range) as parameters of its node. They are
+ *        saved with the graph like any other parameter of the node.
+ */
+class PythonParameters
+{
+public:
+    class Scope
+    {
+    public:
+        Scope(PythonParameters* parameters);
+        ~Scope();
+
+    private:
+        PythonParameters* previous_;
+    };
+
+public:
+    static PythonParameters* current();
+
+public:
+    PythonParameters(Parameterizable* owner);
+
+    /**
+     * @brief declare adds a parameter to the node, or returns the existing handle
+     *        if the script has declared the name before, requires the GIL
+     */
+    std::shared_ptr<PythonParameter> declare(const std::string& name, const boost::python::object& def,
+                                             const boost::python::object& range);
+
+    //! called on the thread that changes a parameter, after the handle has been updated
+    void setChangeCallback(const std::function<void()>& callback);
+
+    //! calls on_param_changed(name, value) for each changed parameter, requires the GIL
+    void notify(const boost::python::object& globals);
+
+    //! requires the GIL
+    void release();
+
+private:
+    Parameterizable* owner_;
+
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<PythonParameter>> handles_;
+    std::atomic<bool> changed_;
+    std::function<void()> change_callback_;
+};
+
+void registerParameters();
+
+}
+
+#endif // PYTHON_PARAMETERS_H
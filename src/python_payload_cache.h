@@ -0,0 +1,65 @@
+#ifndef PYTHON_PAYLOAD_CACHE_H
+#define PYTHON_PAYLOAD_CACHE_H
+
+/// SYSTEM
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace csapex
+{
+
+/**
+ * @brief The PayloadCache attaches one T to each message payload, e.g. a point cloud,
+ *        and shares it between all nodes and interpreters. An entry lives as long as
+ *        its payload, T has to be default constructible.
+ */
+template <typename T>
+class PayloadCache
+{
+public:
+    static PayloadCache& instance()
+    {
+        static PayloadCache cache;
+        return cache;
+    }
+
+    std::shared_ptr<T> get(const boost::shared_ptr<const void>& payload)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        for(auto it = entries_.begin(); it != entries_.end();) {
+            if(it->second.payload.expired()) {
+                it = entries_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        Entry& entry = entries_[payload.get()];
+        if(!entry.value) {
+            entry.payload = payload;
+            entry.value = std::make_shared<T>();
+        }
+        return entry.value;
+    }
+
+private:
+    PayloadCache() = default;
+
+private:
+    struct Entry
+    {
+        boost::weak_ptr<const void> payload;
+        std::shared_ptr<T> value;
+    };
+
+    std::mutex mutex_;
+    std::map<const void*, Entry> entries_;
+};
+
+}
+
+#endif // PYTHON_PAYLOAD_CACHE_H
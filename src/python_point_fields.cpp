@@ -0,0 +1,67 @@
+/// HEADER
+#include "python_point_fields.h"
+
+/// COMPONENT
+#include "python_array_view.h"
+
+/// SYSTEM
+#include <cstdint>
+
+using namespace csapex;
+
+std::size_t PointField::size() const
+{
+    return type == PointFieldType::UINT8 ? 1 : 4;
+}
+
+std::string PointField::typestr() const
+{
+    switch(type) {
+    case PointFieldType::UINT8: return ArrayView::typestr<std::uint8_t>();
+    case PointFieldType::UINT32: return ArrayView::typestr<std::uint32_t>();
+    default: return ArrayView::typestr<float>();
+    }
+}
+
+namespace csapex
+{
+template <> std::vector<PointField> extraPointFields<pcl::PointXYZ>()
+{
+    return {};
+}
+template <> std::vector<PointField> extraPointFields<pcl::PointXYZI>()
+{
+    return { {"intensity", offsetof(pcl::PointXYZI, intensity), PointFieldType::FLOAT32} };
+}
+template <> std::vector<PointField> extraPointFields<pcl::PointXYZRGB>()
+{
+    return { {"r", offsetof(pcl::PointXYZRGB, r), PointFieldType::UINT8},
+             {"g", offsetof(pcl::PointXYZRGB, g), PointFieldType::UINT8},
+             {"b", offsetof(pcl::PointXYZRGB, b), PointFieldType::UINT8} };
+}
+template <> std::vector<PointField> extraPointFields<pcl::PointXYZRGBA>()
+{
+    return { {"r", offsetof(pcl::PointXYZRGBA, r), PointFieldType::UINT8},
+             {"g", offsetof(pcl::PointXYZRGBA, g), PointFieldType::UINT8},
+             {"b", offsetof(pcl::PointXYZRGBA, b), PointFieldType::UINT8},
+             {"a", offsetof(pcl::PointXYZRGBA, a), PointFieldType::UINT8} };
+}
+template <> std::vector<PointField> extraPointFields<pcl::PointXYZRGBL>()
+{
+    return { {"r", offsetof(pcl::PointXYZRGBL, r), PointFieldType::UINT8},
+             {"g", offsetof(pcl::PointXYZRGBL, g), PointFieldType::UINT8},
+             {"b", offsetof(pcl::PointXYZRGBL, b), PointFieldType::UINT8},
+             {"label", offsetof(pcl::PointXYZRGBL, label), PointFieldType::UINT32} };
+}
+template <> std::vector<PointField> extraPointFields<pcl::PointXYZL>()
+{
+    return { {"label", offsetof(pcl::PointXYZL, label), PointFieldType::UINT32} };
+}
+template <> std::vector<PointField> extraPointFields<pcl::PointNormal>()
+{
+    return { {"normal_x", offsetof(pcl::PointNormal, normal_x), PointFieldType::FLOAT32},
+             {"normal_y", offsetof(pcl::PointNormal, normal_y), PointFieldType::FLOAT32},
+             {"normal_z", offsetof(pcl::PointNormal, normal_z), PointFieldType::FLOAT32},
+             {"curvature", offsetof(pcl::PointNormal, curvature), PointFieldType::FLOAT32} };
+}
+}
@@ -0,0 +1,66 @@
+#ifndef PYTHON_POINT_FIELDS_H
+#define PYTHON_POINT_FIELDS_H
+
+/// SYSTEM
+#include <pcl/point_types.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace csapex
+{
+
+enum class PointFieldType
+{
+    FLOAT32,
+    UINT8,
+    UINT32
+};
+
+/**
+ * @brief The PointField describes where a field is stored in a PCL point.
+ */
+struct PointField
+{
+    const char* name;
+    std::size_t offset;
+    PointFieldType type;
+
+    std::size_t size() const;
+    //! the numpy array interface typestr of the field
+    std::string typestr() const;
+};
+
+/**
+ * @brief extraPointFields lists the fields of a point type besides x, y and z,
+ *        which all point types start with.
+ */
+template <typename PointT>
+std::vector<PointField> extraPointFields();
+
+//! all fields, starting with x, y and z
+template <typename PointT>
+std::vector<PointField> pointFields()
+{
+    std::vector<PointField> fields {
+        { "x", offsetof(PointT, x), PointFieldType::FLOAT32 },
+        { "y", offsetof(PointT, y), PointFieldType::FLOAT32 },
+        { "z", offsetof(PointT, z), PointFieldType::FLOAT32 }
+    };
+    for(const PointField& field : extraPointFields<PointT>()) {
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+template <> std::vector<PointField> extraPointFields<pcl::PointXYZ>();
+template <> std::vector<PointField> extraPointFields<pcl::PointXYZI>();
+template <> std::vector<PointField> extraPointFields<pcl::PointXYZRGB>();
+template <> std::vector<PointField> extraPointFields<pcl::PointXYZRGBA>();
+template <> std::vector<PointField> extraPointFields<pcl::PointXYZRGBL>();
+template <> std::vector<PointField> extraPointFields<pcl::PointXYZL>();
+template <> std::vector<PointField> extraPointFields<pcl::PointNormal>();
+
+}
+
+#endif // PYTHON_POINT_FIELDS_H
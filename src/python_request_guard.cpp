@@ -0,0 +1,28 @@
+/// HEADER
+#include "python_request_guard.h"
+
+using namespace csapex;
+
+PythonRequestGuard::PythonRequestGuard()
+    : state_(std::make_shared<State>())
+{
+}
+
+std::function<bool()> PythonRequestGuard::wrap(const std::function<void()> &callback) const
+{
+    std::shared_ptr<State> state = state_;
+    return [state, callback]() {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        if(!state->open) {
+            return false;
+        }
+        callback();
+        return true;
+    };
+}
+
+void PythonRequestGuard::close()
+{
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    state_->open = false;
+}
@@ -0,0 +1,42 @@
+#ifndef PYTHON_REQUEST_GUARD_H
+#define PYTHON_REQUEST_GUARD_H
+
+/// SYSTEM
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonRequestGuard wraps callbacks that are queued on the execution thread
+ *        of a node, so that they do nothing once the node has been closed.
+ *
+ * The wrapped callbacks only share the guard state, not the node. close() waits for a
+ * callback that is running, so the node can be destroyed safely afterwards.
+ */
+class PythonRequestGuard
+{
+public:
+    PythonRequestGuard();
+
+    //! the wrapped callback returns false, iff the guard has been closed and nothing was called
+    std::function<bool()> wrap(const std::function<void()>& callback) const;
+
+    //! has to be called before anything used by the callbacks is destroyed
+    void close();
+
+private:
+    struct State
+    {
+        std::mutex mutex;
+        bool open = true;
+    };
+
+    std::shared_ptr<State> state_;
+};
+
+}
+
+#endif // PYTHON_REQUEST_GUARD_H
@@ -0,0 +1,412 @@
+/// HEADER
+#include "python_result_cache.h"
+
+/// PROJECT
+#include <csapex/msg/generic_value_message.hpp>
+#include <csapex/msg/input.h>
+#include <csapex/msg/io.h>
+#include <csapex/msg/output.h>
+#include <csapex_opencv/cv_mat_message.h>
+#include <csapex_point_cloud/msg/point_cloud_message.h>
+
+/// COMPONENT
+#include "python_hash.h"
+
+/// SYSTEM
+#include <boost/make_shared.hpp>
+#include <boost/variant.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace csapex;
+
+namespace
+{
+thread_local PythonResultCache::Recording* g_current_recording = nullptr;
+
+// rough size of the bookkeeping of one cached message
+const std::size_t MESSAGE_OVERHEAD = 128;
+
+// chains the hashes of all parts, each part seeds the next one
+struct Hasher
+{
+    Hasher()
+        : value(0)
+    {}
+
+    void add(const void* data, std::size_t length)
+    {
+        value = xxh64(data, length, value);
+    }
+
+    template <typename T>
+    void add(const T& v)
+    {
+        add(&v, sizeof(T));
+    }
+
+    void add(const std::string& text)
+    {
+        add(text.size());
+        add(text.data(), text.size());
+    }
+
+    std::uint64_t value;
+};
+
+enum class Tag : std::uint8_t {
+    NONE, IMAGE, CLOUD, INT, DOUBLE, STRING
+};
+
+// padding bytes of points are hashed as well, differing padding only leads to a miss
+struct CloudHash : public boost::static_visitor<bool>
+{
+    CloudHash(Hasher& hasher)
+        : hasher(hasher)
+    {}
+
+    template <typename PointT>
+    bool operator () (const boost::shared_ptr<pcl::PointCloud<PointT>>& cloud) const
+    {
+        if(!cloud) {
+            return false;
+        }
+        hasher.add(sizeof(PointT));
+        hasher.add(cloud->width);
+        hasher.add(cloud->height);
+        hasher.add(cloud->points.data(), cloud->points.size() * sizeof(PointT));
+        return true;
+    }
+
+    Hasher& hasher;
+};
+
+struct CloudSize : public boost::static_visitor<std::size_t>
+{
+    template <typename PointT>
+    std::size_t operator () (const boost::shared_ptr<pcl::PointCloud<PointT>>& cloud) const
+    {
+        return cloud ? cloud->points.size() * sizeof(PointT) : 0;
+    }
+};
+
+template <typename T>
+bool hash_value(const TokenDataConstPtr& message, Tag tag, Hasher& hasher)
+{
+    if(auto generic = std::dynamic_pointer_cast<connection_types::GenericValueMessage<T> const>(message)) {
+        hasher.add(tag);
+        hasher.add(generic->value);
+        return true;
+    }
+    return false;
+}
+
+bool hash_message(const TokenDataConstPtr& message, Hasher& hasher)
+{
+    if(auto image = std::dynamic_pointer_cast<connection_types::CvMatMessage const>(message)) {
+        const cv::Mat& mat = image->value;
+        hasher.add(Tag::IMAGE);
+        hasher.add(image->getEncoding().getName());
+        hasher.add(mat.rows);
+        hasher.add(mat.cols);
+        hasher.add(mat.type());
+        const std::size_t row_bytes = mat.cols * mat.elemSize();
+        if(mat.isContinuous()) {
+            hasher.add(mat.data, mat.rows * row_bytes);
+        } else {
+            for(int row = 0; row < mat.rows; ++row) {
+                hasher.add(mat.ptr<std::uint8_t>(row), row_bytes);
+            }
+        }
+        return true;
+
+    } else if(auto cloud = std::dynamic_pointer_cast<connection_types::PointCloudMessage const>(message)) {
+        hasher.add(Tag::CLOUD);
+        hasher.add(cloud->value.which());
+        return boost::apply_visitor(CloudHash(hasher), cloud->value);
+    }
+
+    return hash_value<int>(message, Tag::INT, hasher) ||
+            hash_value<double>(message, Tag::DOUBLE, hasher) ||
+            hash_value<std::string>(message, Tag::STRING, hasher);
+}
+
+std::size_t estimate_size(const TokenDataConstPtr& message)
+{
+    if(auto image = std::dynamic_pointer_cast<connection_types::CvMatMessage const>(message)) {
+        return MESSAGE_OVERHEAD + image->value.total() * image->value.elemSize();
+    } else if(auto cloud = std::dynamic_pointer_cast<connection_types::PointCloudMessage const>(message)) {
+        return MESSAGE_OVERHEAD + boost::apply_visitor(CloudSize(), cloud->value);
+    } else if(auto text = std::dynamic_pointer_cast<connection_types::GenericValueMessage<std::string> const>(message)) {
+        return MESSAGE_OVERHEAD + text->value.size();
+    }
+    return MESSAGE_OVERHEAD;
+}
+
+/*
+ * Restamping
+ */
+
+struct CloudRestamp : public boost::static_visitor<void>
+{
+    CloudRestamp(connection_types::PointCloudMessage& result)
+        : result(result)
+    {}
+
+    // pcl keeps the stamp next to the points, so a cloud cannot be shared with a new stamp
+    template <typename PointT>
+    void operator () (const boost::shared_ptr<pcl::PointCloud<PointT>>& cloud) const
+    {
+        if(cloud) {
+            auto copy = boost::make_shared<pcl::PointCloud<PointT>>(*cloud);
+            copy->header.stamp = result.stamp_micro_seconds;
+            result.value = copy;
+        }
+    }
+
+    connection_types::PointCloudMessage& result;
+};
+
+template <typename T>
+bool restamp_value(const TokenDataConstPtr& message, std::uint64_t stamp, TokenDataConstPtr& result)
+{
+    if(auto generic = std::dynamic_pointer_cast<connection_types::GenericValueMessage<T> const>(message)) {
+        auto copy = makeEmpty<connection_types::GenericValueMessage<T>>();
+        copy->frame_id = generic->frame_id;
+        copy->stamp_micro_seconds = stamp;
+        copy->value = generic->value;
+        result = copy;
+        return true;
+    }
+    return false;
+}
+
+bool restampable(const TokenDataConstPtr& message)
+{
+    return std::dynamic_pointer_cast<connection_types::CvMatMessage const>(message) ||
+            std::dynamic_pointer_cast<connection_types::PointCloudMessage const>(message) ||
+            !std::dynamic_pointer_cast<connection_types::Message const>(message) ||
+            std::dynamic_pointer_cast<connection_types::GenericValueMessage<int> const>(message) ||
+            std::dynamic_pointer_cast<connection_types::GenericValueMessage<double> const>(message) ||
+            std::dynamic_pointer_cast<connection_types::GenericValueMessage<std::string> const>(message);
+}
+
+// returns a copy of the message with the given stamp, which shares the payload where possible
+TokenDataConstPtr restamp(const TokenDataConstPtr& message, std::uint64_t stamp)
+{
+    TokenDataConstPtr result;
+    if(auto image = std::dynamic_pointer_cast<connection_types::CvMatMessage const>(message)) {
+        auto copy = std::make_shared<connection_types::CvMatMessage>(image->getEncoding(), image->frame_id, stamp);
+        copy->value = image->value;
+        result = copy;
+
+    } else if(auto cloud = std::dynamic_pointer_cast<connection_types::PointCloudMessage const>(message)) {
+        auto copy = std::make_shared<connection_types::PointCloudMessage>(cloud->frame_id, stamp);
+        copy->value = cloud->value;
+        boost::apply_visitor(CloudRestamp(*copy), cloud->value);
+        result = copy;
+
+    } else if(!std::dynamic_pointer_cast<connection_types::Message const>(message)) {
+        // tokens without a header are published unchanged
+        result = message;
+
+    } else {
+        restamp_value<int>(message, stamp, result) ||
+                restamp_value<double>(message, stamp, result) ||
+                restamp_value<std::string>(message, stamp, result);
+    }
+    return result;
+}
+}
+
+PythonResultCache::Recording::Recording(bool active)
+    : active_(active), previous_(g_current_recording)
+{
+    if(active_) {
+        g_current_recording = this;
+    }
+}
+
+PythonResultCache::Recording::~Recording()
+{
+    if(active_) {
+        g_current_recording = previous_;
+    }
+}
+
+const PythonResultCache::Outputs& PythonResultCache::Recording::getOutputs() const
+{
+    return outputs_;
+}
+
+void PythonResultCache::publish(Output *output, const TokenDataConstPtr &message)
+{
+    if(g_current_recording) {
+        g_current_recording->outputs_.emplace_back(output, message);
+    }
+    msg::publish(output, message);
+}
+
+PythonResultCache::PythonResultCache()
+    : enabled_(false), include_stamps_(false), capacity_(256 * 1024 * 1024),
+      bytes_(0), hits_(0), misses_(0), uncacheable_(0), reported_lookups_(0)
+{
+}
+
+void PythonResultCache::setEnabled(bool enabled)
+{
+    enabled_ = enabled;
+    if(!enabled) {
+        clear();
+    }
+}
+
+bool PythonResultCache::isEnabled() const
+{
+    return enabled_;
+}
+
+void PythonResultCache::setIncludeStamps(bool include)
+{
+    include_stamps_ = include;
+    clear();
+}
+
+void PythonResultCache::setCapacity(std::size_t bytes)
+{
+    capacity_ = bytes;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    evict(bytes);
+}
+
+void PythonResultCache::clear()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    entries_.clear();
+    index_.clear();
+    bytes_ = 0;
+}
+
+bool PythonResultCache::hash(const std::vector<InputPtr> &inputs, std::uint64_t &key, std::uint64_t &stamp)
+{
+    const bool include_stamps = include_stamps_;
+
+    stamp = 0;
+    Hasher hasher;
+    for(const InputPtr& input : inputs) {
+        if(!msg::hasMessage(input.get())) {
+            hasher.add(Tag::NONE);
+            continue;
+        }
+
+        TokenDataConstPtr message = msg::getMessage(input.get());
+        if(auto header = std::dynamic_pointer_cast<connection_types::Message const>(message)) {
+            hasher.add(header->frame_id);
+            stamp = std::max<std::uint64_t>(stamp, header->stamp_micro_seconds);
+            if(include_stamps) {
+                hasher.add(header->stamp_micro_seconds);
+            }
+        }
+
+        if(!hash_message(message, hasher)) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ++uncacheable_;
+            return false;
+        }
+    }
+
+    key = hasher.value;
+    return true;
+}
+
+bool PythonResultCache::replay(std::uint64_t key, std::uint64_t stamp)
+{
+    Outputs outputs;
+    std::uint64_t stored_stamp = 0;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto pos = index_.find(key);
+        if(pos == index_.end()) {
+            ++misses_;
+            return false;
+        }
+        ++hits_;
+        entries_.splice(entries_.begin(), entries_, pos->second);
+        outputs = pos->second->outputs;
+        stored_stamp = pos->second->stamp;
+    }
+
+    // the outputs are shifted in time like the inputs, so that the script's choice of stamp is kept
+    for(const auto& output : outputs) {
+        TokenDataConstPtr message = output.second;
+        if(stamp != stored_stamp) {
+            if(auto header = std::dynamic_pointer_cast<connection_types::Message const>(message)) {
+                message = restamp(message, header->stamp_micro_seconds + (stamp - stored_stamp));
+            }
+        }
+        msg::publish(output.first, message);
+    }
+    return true;
+}
+
+void PythonResultCache::store(std::uint64_t key, std::uint64_t stamp, const Outputs &outputs)
+{
+    std::size_t bytes = MESSAGE_OVERHEAD;
+    for(const auto& output : outputs) {
+        // a replay could not carry the stamp of its inputs
+        if(!restampable(output.second)) {
+            return;
+        }
+        bytes += estimate_size(output.second);
+    }
+
+    const std::size_t capacity = capacity_;
+    if(bytes > capacity) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto pos = index_.find(key);
+    if(pos != index_.end()) {
+        bytes_ -= pos->second->bytes;
+        entries_.erase(pos->second);
+        index_.erase(pos);
+    }
+
+    entries_.push_front(Entry { key, stamp, outputs, bytes });
+    index_[key] = entries_.begin();
+    bytes_ += bytes;
+
+    evict(capacity);
+}
+
+void PythonResultCache::evict(std::size_t capacity)
+{
+    while(bytes_ > capacity && !entries_.empty()) {
+        const Entry& oldest = entries_.back();
+        bytes_ -= oldest.bytes;
+        index_.erase(oldest.key);
+        entries_.pop_back();
+    }
+}
+
+bool PythonResultCache::pollReport(std::string &report)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    const std::size_t lookups = hits_ + misses_ + uncacheable_;
+    auto now = std::chrono::steady_clock::now();
+    if(lookups == reported_lookups_ || now - last_report_ < std::chrono::seconds(1)) {
+        return false;
+    }
+    reported_lookups_ = lookups;
+    last_report_ = now;
+
+    char buffer[160];
+    std::snprintf(buffer, sizeof(buffer), "%zu hits, %zu misses, %zu uncacheable, %zu entries using %.1f MiB",
+                  hits_, misses_, uncacheable_, entries_.size(), bytes_ / (1024.0 * 1024.0));
+    report = buffer;
+    return true;
+}
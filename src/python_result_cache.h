@@ -0,0 +1,112 @@
+#ifndef PYTHON_RESULT_CACHE_H
+#define PYTHON_RESULT_CACHE_H
+
+/// PROJECT
+#include <csapex/model/node.h>
+
+/// SYSTEM
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonResultCache remembers what a deterministic script published for
+ *        a given set of inputs, so that repeated inputs are answered without entering
+ *        the interpreter.
+ *
+ * Inputs are identified by an XXH64 hash over their payloads and frames, and
+ * optionally their stamps. Only images, point clouds and numbers are hashed,
+ * other messages make a frame uncacheable. Replayed messages are copies carrying
+ * stamps shifted by the difference between the current and the cached inputs. Entries are evicted least recently
+ * used first, once the estimated size of the cached messages exceeds the capacity.
+ */
+class PythonResultCache
+{
+public:
+    typedef std::vector<std::pair<Output*, TokenDataConstPtr>> Outputs;
+
+    /**
+     * @brief The Recording collects the messages published from python on this thread
+     *        for its lifetime
+     */
+    class Recording
+    {
+    public:
+        Recording(bool active);
+        ~Recording();
+
+        const Outputs& getOutputs() const;
+
+    private:
+        friend class PythonResultCache;
+
+        bool active_;
+        Recording* previous_;
+        Outputs outputs_;
+    };
+
+    //! publishes the message and adds it to the current recording, used by all python bindings
+    static void publish(Output* output, const TokenDataConstPtr& message);
+
+public:
+    PythonResultCache();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+    void setIncludeStamps(bool include);
+    void setCapacity(std::size_t bytes);
+
+    //! drops all entries, has to be called whenever the code or the ports change
+    void clear();
+
+    //! returns false, if one of the inputs carries a message that cannot be hashed, stamp is the newest input stamp
+    bool hash(const std::vector<InputPtr>& inputs, std::uint64_t& key, std::uint64_t& stamp);
+
+    //! publishes the outputs stored for key again, restamped for inputs with the given stamp, returns false on a miss
+    bool replay(std::uint64_t key, std::uint64_t stamp);
+
+    //! outputs of types that cannot be restamped are not stored
+    void store(std::uint64_t key, std::uint64_t stamp, const Outputs& outputs);
+
+    bool pollReport(std::string& report);
+
+private:
+    struct Entry
+    {
+        std::uint64_t key;
+        std::uint64_t stamp;
+        Outputs outputs;
+        std::size_t bytes;
+    };
+
+    void evict(std::size_t capacity);
+
+private:
+    std::atomic<bool> enabled_;
+    std::atomic<bool> include_stamps_;
+    std::atomic<std::size_t> capacity_;
+
+    std::mutex mutex_;
+    std::list<Entry> entries_;
+    std::unordered_map<std::uint64_t, std::list<Entry>::iterator> index_;
+    std::size_t bytes_;
+
+    std::size_t hits_;
+    std::size_t misses_;
+    std::size_t uncacheable_;
+    std::size_t reported_lookups_;
+    std::chrono::steady_clock::time_point last_report_;
+};
+
+}
+
+#endif // PYTHON_RESULT_CACHE_H
@@ -0,0 +1,265 @@
+/// HEADER
+#include "python_runtime_controls.h"
+
+/// PROJECT
+#include <csapex/model/node_modifier.h>
+#include <csapex/param/parameter_factory.h>
+
+/// SYSTEM
+#include <map>
+
+using namespace csapex;
+
+namespace
+{
+const char* MEMORY_WARNING = "Python objects exceed the memory limit";
+const char* DEADLINE_WARNING = "Python call exceeded its deadline in native code";
+}
+
+PythonRuntimeControls::PythonRuntimeControls(Parameterizable *owner, PythonThreadStates *thread_states, PythonErrorHandler *error_handler)
+    : owner_(owner), thread_states_(thread_states), error_handler_(error_handler), modifier_(nullptr),
+      deadline_(PythonDeadline::create()), memory_warning_(false)
+{
+}
+
+void PythonRuntimeControls::setNodeModifier(NodeModifier *modifier)
+{
+    modifier_ = modifier;
+}
+
+void PythonRuntimeControls::setupParameters(Parameterizable &parameters)
+{
+    parameters.addParameter(param::factory::declareParameterSet("gc/policy",
+                                                                PythonGcPolicy::policyNames(),
+                                                                static_cast<int>(PythonGcPolicy::Policy::DEFAULT)),
+                            [this](param::Parameter* p) {
+        gc_policy_.setPolicy(static_cast<PythonGcPolicy::Policy>(p->as<int>()));
+    });
+    parameters.addParameter(param::factory::declareOutputText("gc/pauses"));
+
+    // only python objects are accounted, numpy array data is allocated outside of the interpreter
+    parameters.addParameter(param::factory::declareRange("memory/python object limit [MiB]", 0, 65536, 0, 16),
+                            [this](param::Parameter* p) {
+        memory_budget_.setSoftLimit(static_cast<std::size_t>(p->as<int>()) * 1024 * 1024);
+        updateStatistics();
+    });
+    parameters.addParameter(param::factory::declareParameterSet("memory/when exceeded",
+                                                                std::map<std::string, int> {{"warn", 0}, {"drop frames", 1}},
+                                                                0),
+                            [this](param::Parameter* p) {
+        memory_budget_.setDropWhenExceeded(p->as<int>() == 1);
+    });
+    parameters.addParameter(param::factory::declareOutputText("memory/usage"));
+
+    parameters.addParameter(param::factory::declareRange("deadline [ms]", 0, 60000, 0, 1),
+                            [this](param::Parameter* p) {
+        deadline_->setTimeout(std::chrono::milliseconds(p->as<int>()));
+    });
+    parameters.addParameter(param::factory::declareOutputText("deadline/overruns"));
+
+    parameters.addParameter(param::factory::declareParameterSet("frame drop/policy",
+                                                                PythonFrameDropPolicy::policyNames(),
+                                                                static_cast<int>(PythonFrameDropPolicy::Policy::KEEP_ALL)),
+                            [this](param::Parameter* p) {
+        frame_drop_policy_.setPolicy(static_cast<PythonFrameDropPolicy::Policy>(p->as<int>()));
+    });
+    parameters.addParameter(param::factory::declareRange("frame drop/max age [ms]", 1, 10000, 100, 1),
+                            [this](param::Parameter* p) {
+        frame_drop_policy_.setMaxAge(std::chrono::milliseconds(p->as<int>()));
+    });
+    parameters.addParameter(param::factory::declareOutputText("frame drop/dropped"));
+
+    parameters.addParameter(param::factory::declareText("scheduling/cpus", ""),
+                            [this](param::Parameter* p) {
+        std::string error;
+        if(!scheduling_policy_.setCpus(p->as<std::string>(), error)) {
+            owner_->setParameter("scheduling/status", error);
+        }
+    });
+    parameters.addParameter(param::factory::declareBool("scheduling/change nice", false),
+                            [this](param::Parameter* p) {
+        scheduling_policy_.setNiceEnabled(p->as<bool>());
+    });
+    parameters.addConditionalParameter(param::factory::declareRange("scheduling/nice", -20, 19, 10, 1),
+                                       [this]() {
+        return scheduling_policy_.isNiceEnabled();
+    },
+                                       [this](param::Parameter* p) {
+        scheduling_policy_.setNice(p->as<int>());
+    });
+    parameters.addParameter(param::factory::declareParameterSet("scheduling/class",
+                                                                PythonSchedulingPolicy::classNames(),
+                                                                static_cast<int>(PythonSchedulingPolicy::SchedulingClass::INHERIT)),
+                            [this](param::Parameter* p) {
+        scheduling_policy_.setSchedulingClass(static_cast<PythonSchedulingPolicy::SchedulingClass>(p->as<int>()));
+    });
+    parameters.addConditionalParameter(param::factory::declareRange("scheduling/fifo priority", 1, 99, 10, 1),
+                                       [this]() {
+        return scheduling_policy_.getSchedulingClass() == PythonSchedulingPolicy::SchedulingClass::FIFO;
+    },
+                                       [this](param::Parameter* p) {
+        scheduling_policy_.setFifoPriority(p->as<int>());
+    });
+    parameters.addParameter(param::factory::declareOutputText("scheduling/status"));
+
+    parameters.addParameter(param::factory::declareOutputText("signals/statistics"));
+
+    parameters.addParameter(param::factory::declareBool("cacheable", false),
+                            [this](param::Parameter* p) {
+        result_cache_.setEnabled(p->as<bool>());
+    });
+    auto cache_enabled = [this]() {
+        return result_cache_.isEnabled();
+    };
+    parameters.addConditionalParameter(param::factory::declareBool("cache/include stamps", false), cache_enabled,
+                                       [this](param::Parameter* p) {
+        result_cache_.setIncludeStamps(p->as<bool>());
+    });
+    parameters.addConditionalParameter(param::factory::declareRange("cache/capacity [MiB]", 1, 16384, 256, 1), cache_enabled,
+                                       [this](param::Parameter* p) {
+        result_cache_.setCapacity(static_cast<std::size_t>(p->as<int>()) * 1024 * 1024);
+    });
+    parameters.addParameter(param::factory::declareOutputText("cache/statistics"));
+
+    parameters.addParameter(param::factory::declareOutputText("errors"));
+}
+
+void PythonRuntimeControls::updateStatistics()
+{
+    std::string report;
+    if(gc_policy_.pollReport(report)) {
+        owner_->setParameter("gc/pauses", report);
+    }
+    if(memory_budget_.pollReport(report)) {
+        owner_->setParameter("memory/usage", report);
+    }
+    if(deadline_->pollReport(report)) {
+        owner_->setParameter("deadline/overruns", report);
+    }
+    if(frame_drop_policy_.pollReport(report)) {
+        owner_->setParameter("frame drop/dropped", report);
+    }
+    if(scheduling_policy_.pollReport(report)) {
+        owner_->setParameter("scheduling/status", report);
+    }
+    if(signals_.pollReport(report)) {
+        owner_->setParameter("signals/statistics", report);
+    }
+    if(result_cache_.pollReport(report)) {
+        owner_->setParameter("cache/statistics", report);
+    }
+    if(error_handler_->pollReport(report)) {
+        owner_->setParameter("errors", report);
+    }
+
+    bool exceeded = memory_budget_.isExceeded();
+    if(exceeded != memory_warning_ && modifier_) {
+        memory_warning_ = exceeded;
+        if(exceeded) {
+            showWarning(MEMORY_WARNING);
+        } else {
+            clearWarning(MEMORY_WARNING);
+        }
+    }
+}
+
+void PythonRuntimeControls::errorShown()
+{
+    shown_warning_.clear();
+}
+
+bool PythonRuntimeControls::finishDeadline(PythonDeadline::Outcome outcome)
+{
+    if(modifier_) {
+        if(outcome == PythonDeadline::Outcome::OVERRUN) {
+            showWarning(DEADLINE_WARNING);
+        } else {
+            clearWarning(DEADLINE_WARNING);
+        }
+    }
+    return outcome == PythonDeadline::Outcome::INTERRUPTED;
+}
+
+bool PythonRuntimeControls::admitFrame()
+{
+    if(!memory_budget_.dropsFrames()) {
+        return true;
+    }
+
+    // a full collection may get the script back below its budget, otherwise the frame is dropped
+    thread_states_->acquire();
+    gc_policy_.collectAll();
+    thread_states_->release();
+
+    updateStatistics();
+    return !memory_budget_.isExceeded();
+}
+
+void PythonRuntimeControls::collectDeferredGarbage()
+{
+    if(gc_policy_.getPolicy() != PythonGcPolicy::Policy::DISABLED_DURING_PROCESS) {
+        return;
+    }
+
+    thread_states_->acquire();
+    gc_policy_.idle();
+    thread_states_->release();
+
+    updateStatistics();
+}
+
+void PythonRuntimeControls::release()
+{
+    gc_policy_.release();
+    signals_.release();
+}
+
+PythonGcPolicy& PythonRuntimeControls::gcPolicy()
+{
+    return gc_policy_;
+}
+
+PythonMemoryBudget& PythonRuntimeControls::memoryBudget()
+{
+    return memory_budget_;
+}
+
+PythonDeadline& PythonRuntimeControls::deadline()
+{
+    return *deadline_;
+}
+
+PythonFrameDropPolicy& PythonRuntimeControls::frameDropPolicy()
+{
+    return frame_drop_policy_;
+}
+
+PythonSchedulingPolicy& PythonRuntimeControls::schedulingPolicy()
+{
+    return scheduling_policy_;
+}
+
+PythonSignals& PythonRuntimeControls::signals()
+{
+    return signals_;
+}
+
+PythonResultCache& PythonRuntimeControls::resultCache()
+{
+    return result_cache_;
+}
+
+void PythonRuntimeControls::showWarning(const std::string &warning)
+{
+    modifier_->setWarning(warning);
+    shown_warning_ = warning;
+}
+
+void PythonRuntimeControls::clearWarning(const std::string &warning)
+{
+    // errors and other warnings set in the meantime stay visible
+    if(shown_warning_ == warning) {
+        modifier_->setNoError();
+        shown_warning_.clear();
+    }
+}
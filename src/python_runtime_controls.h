@@ -0,0 +1,90 @@
+#ifndef PYTHON_RUNTIME_CONTROLS_H
+#define PYTHON_RUNTIME_CONTROLS_H
+
+/// PROJECT
+#include <csapex/model/node.h>
+
+/// COMPONENT
+#include "python_error_handler.h"
+#include "python_frame_drop_policy.h"
+#include "python_gc_policy.h"
+#include "python_memory_arena.h"
+#include "python_result_cache.h"
+#include "python_scheduling_policy.h"
+#include "python_signals.h"
+#include "python_thread_states.h"
+#include "python_watchdog.h"
+
+/// SYSTEM
+#include <memory>
+#include <string>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonRuntimeControls hold the policies that decide how a node enters its
+ *        interpreter, declare their parameters and write their statistics to the node.
+ *        They are shared by the python node and the python wrapper.
+ */
+class PythonRuntimeControls
+{
+public:
+    PythonRuntimeControls(Parameterizable* owner, PythonThreadStates* thread_states, PythonErrorHandler* error_handler);
+
+    //! warnings are only shown once the modifier is known
+    void setNodeModifier(NodeModifier* modifier);
+
+    void setupParameters(Parameterizable& parameters);
+
+    //! writes the reports of all policies to their outputs and updates the memory warning
+    void updateStatistics();
+
+    //! has to be called whenever the node shows an error, which replaces the current warning
+    void errorShown();
+
+    //! warns about overruns in native code, returns true iff the call was interrupted
+    bool finishDeadline(PythonDeadline::Outcome outcome);
+
+    //! collects garbage while the memory budget is exceeded, returns false iff the frame has to be dropped
+    bool admitFrame();
+
+    //! collects what was deferred while processing, when the node is idle
+    void collectDeferredGarbage();
+
+    //! releases the python objects of the policies, requires the GIL
+    void release();
+
+    PythonGcPolicy& gcPolicy();
+    PythonMemoryBudget& memoryBudget();
+    PythonDeadline& deadline();
+    PythonFrameDropPolicy& frameDropPolicy();
+    PythonSchedulingPolicy& schedulingPolicy();
+    PythonSignals& signals();
+    PythonResultCache& resultCache();
+
+private:
+    void showWarning(const std::string& warning);
+    void clearWarning(const std::string& warning);
+
+private:
+    Parameterizable* owner_;
+    PythonThreadStates* thread_states_;
+    PythonErrorHandler* error_handler_;
+    NodeModifier* modifier_;
+
+    PythonGcPolicy gc_policy_;
+    PythonMemoryBudget memory_budget_;
+    std::shared_ptr<PythonDeadline> deadline_;
+    PythonFrameDropPolicy frame_drop_policy_;
+    PythonSchedulingPolicy scheduling_policy_;
+    PythonSignals signals_;
+    PythonResultCache result_cache_;
+
+    bool memory_warning_;
+    std::string shown_warning_;
+};
+
+}
+
+#endif // PYTHON_RUNTIME_CONTROLS_H
@@ -0,0 +1,338 @@
+/// HEADER
+#include "python_scheduling_policy.h"
+
+/// SYSTEM
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <sstream>
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace csapex;
+
+namespace
+{
+#ifdef __linux__
+pid_t current_tid()
+{
+    return static_cast<pid_t>(syscall(SYS_gettid));
+}
+
+// unprivileged threads may only lower their nice value down to the limit of RLIMIT_NICE
+bool may_lower_nice_to(int nice)
+{
+    if(geteuid() == 0) {
+        return true;
+    }
+    rlimit limit;
+    if(getrlimit(RLIMIT_NICE, &limit) != 0) {
+        return false;
+    }
+    return limit.rlim_cur == RLIM_INFINITY || 20 - static_cast<long>(limit.rlim_cur) <= nice;
+}
+
+bool parse_cpu(const char*& p, long& cpu)
+{
+    char* end = nullptr;
+    cpu = std::strtol(p, &end, 10);
+    if(end == p || cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    p = end;
+    return true;
+}
+
+bool parse_range(const std::string& range, cpu_set_t& cpus)
+{
+    const char* p = range.c_str();
+    long first = 0;
+    if(!parse_cpu(p, first)) {
+        return false;
+    }
+    long last = first;
+    if(*p == '-') {
+        ++p;
+        if(!parse_cpu(p, last) || last < first) {
+            return false;
+        }
+    }
+    while(*p == ' ') {
+        ++p;
+    }
+    if(*p != '\0') {
+        return false;
+    }
+
+    for(long cpu = first; cpu <= last; ++cpu) {
+        CPU_SET(cpu, &cpus);
+    }
+    return true;
+}
+
+const char* class_name(int scheduling_class)
+{
+    switch(scheduling_class) {
+    case SCHED_FIFO:
+        return "SCHED_FIFO";
+    case SCHED_BATCH:
+        return "SCHED_BATCH";
+    default:
+        return "SCHED_OTHER";
+    }
+}
+#endif
+}
+
+std::map<std::string, int> PythonSchedulingPolicy::classNames()
+{
+    return {
+        {"inherit", static_cast<int>(SchedulingClass::INHERIT)},
+        {"other", static_cast<int>(SchedulingClass::OTHER)},
+        {"batch", static_cast<int>(SchedulingClass::BATCH)},
+        {"fifo (real-time)", static_cast<int>(SchedulingClass::FIFO)}
+    };
+}
+
+PythonSchedulingPolicy::Scope::Scope(PythonSchedulingPolicy *policy)
+    : policy_(policy && policy->active_ ? policy : nullptr),
+      restore_affinity_(false), restore_nice_(false), nice_(0),
+      restore_class_(false), class_(SCHED_OTHER)
+{
+    if(!policy_) {
+        return;
+    }
+
+#ifdef __linux__
+    Settings settings;
+    {
+        std::unique_lock<std::mutex> lock(policy_->mutex_);
+        settings = policy_->settings_;
+    }
+
+    const pthread_t self = pthread_self();
+
+    if(settings.pin) {
+        int error = pthread_getaffinity_np(self, sizeof(affinity_), &affinity_);
+        if(error == 0) {
+            error = pthread_setaffinity_np(self, sizeof(settings.cpus), &settings.cpus);
+        }
+        if(error == 0) {
+            restore_affinity_ = true;
+        } else {
+            policy_->failed("cannot pin to cpus " + settings.cpu_list, error);
+        }
+    }
+
+    if(settings.change_nice) {
+        const pid_t tid = current_tid();
+        errno = 0;
+        const int current = getpriority(PRIO_PROCESS, tid);
+        if(errno != 0) {
+            policy_->failed("cannot read the nice value", errno);
+
+        } else if(settings.nice > current && !may_lower_nice_to(current)) {
+            // the worker thread would keep the lower priority after the call
+            policy_->failed("nice " + std::to_string(current) + " could not be restored", EPERM);
+
+        } else if(settings.nice != current) {
+            if(setpriority(PRIO_PROCESS, tid, settings.nice) == 0) {
+                nice_ = current;
+                restore_nice_ = true;
+            } else {
+                policy_->failed("cannot set nice " + std::to_string(settings.nice), errno);
+            }
+        }
+    }
+
+    if(settings.scheduling_class != SchedulingClass::INHERIT) {
+        int target_class = SCHED_OTHER;
+        sched_param target;
+        std::memset(&target, 0, sizeof(target));
+        if(settings.scheduling_class == SchedulingClass::BATCH) {
+            target_class = SCHED_BATCH;
+        } else if(settings.scheduling_class == SchedulingClass::FIFO) {
+            target_class = SCHED_FIFO;
+            target.sched_priority = settings.fifo_priority;
+        }
+
+        int error = pthread_getschedparam(self, &class_, &param_);
+        if(error == 0 && (target_class != class_ || target.sched_priority != param_.sched_priority)) {
+            error = pthread_setschedparam(self, target_class, &target);
+            restore_class_ = error == 0;
+        }
+        if(error != 0) {
+            policy_->failed(std::string("cannot switch to ") + class_name(target_class), error);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(policy_->mutex_);
+    ++policy_->calls_;
+    policy_->last_cpu_ = sched_getcpu();
+#endif
+}
+
+PythonSchedulingPolicy::Scope::~Scope()
+{
+    if(!policy_) {
+        return;
+    }
+
+#ifdef __linux__
+    const pthread_t self = pthread_self();
+    if(restore_class_) {
+        int error = pthread_setschedparam(self, class_, &param_);
+        if(error != 0) {
+            policy_->failed(std::string("cannot restore ") + class_name(class_), error);
+        }
+    }
+    if(restore_nice_) {
+        if(setpriority(PRIO_PROCESS, current_tid(), nice_) != 0) {
+            policy_->failed("cannot restore nice " + std::to_string(nice_), errno);
+        }
+    }
+    if(restore_affinity_) {
+        int error = pthread_setaffinity_np(self, sizeof(affinity_), &affinity_);
+        if(error != 0) {
+            policy_->failed("cannot restore the cpu affinity", error);
+        }
+    }
+#endif
+}
+
+PythonSchedulingPolicy::PythonSchedulingPolicy()
+    : active_(false), calls_(0), failures_(0), last_cpu_(-1), reported_calls_(0)
+{
+    settings_.pin = false;
+#ifdef __linux__
+    CPU_ZERO(&settings_.cpus);
+#endif
+    settings_.change_nice = false;
+    settings_.nice = 0;
+    settings_.scheduling_class = SchedulingClass::INHERIT;
+    settings_.fifo_priority = 10;
+}
+
+bool PythonSchedulingPolicy::setCpus(const std::string &cpus, std::string &error)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    bool pin = false;
+    std::stringstream list(cpus);
+    std::string range;
+    while(std::getline(list, range, ',')) {
+        range.erase(0, range.find_first_not_of(' '));
+        if(range.empty()) {
+            continue;
+        }
+        if(!parse_range(range, set)) {
+            error = "invalid cpu range '" + range + "'";
+            return false;
+        }
+        pin = true;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    settings_.pin = pin;
+    settings_.cpus = set;
+    settings_.cpu_list = cpus;
+    updateActive();
+    return true;
+#else
+    if(cpus.find_first_not_of(" ,") != std::string::npos) {
+        error = "pinning to cpus is unsupported on this platform";
+        return false;
+    }
+    return true;
+#endif
+}
+
+void PythonSchedulingPolicy::setNiceEnabled(bool enabled)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    settings_.change_nice = enabled;
+    updateActive();
+}
+
+bool PythonSchedulingPolicy::isNiceEnabled()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return settings_.change_nice;
+}
+
+void PythonSchedulingPolicy::setNice(int nice)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    settings_.nice = nice;
+}
+
+void PythonSchedulingPolicy::setSchedulingClass(SchedulingClass scheduling_class)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    settings_.scheduling_class = scheduling_class;
+    updateActive();
+}
+
+PythonSchedulingPolicy::SchedulingClass PythonSchedulingPolicy::getSchedulingClass()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return settings_.scheduling_class;
+}
+
+void PythonSchedulingPolicy::setFifoPriority(int priority)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    settings_.fifo_priority = priority;
+}
+
+void PythonSchedulingPolicy::updateActive()
+{
+#ifdef __linux__
+    active_ = settings_.pin || settings_.change_nice || settings_.scheduling_class != SchedulingClass::INHERIT;
+#else
+    // nothing is applied, so that the scopes stay free
+    active_ = false;
+#endif
+}
+
+void PythonSchedulingPolicy::failed(const std::string &what, int error)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++failures_;
+    last_error_ = what + ": " + std::strerror(error);
+}
+
+bool PythonSchedulingPolicy::pollReport(std::string &report)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto now = std::chrono::steady_clock::now();
+#ifndef __linux__
+    // reported once, the settings are never applied
+    if(last_report_ != std::chrono::steady_clock::time_point()) {
+        return false;
+    }
+    last_report_ = now;
+    report = "unsupported on this platform";
+    return true;
+#endif
+    if(calls_ == reported_calls_ || now - last_report_ < std::chrono::seconds(1)) {
+        return false;
+    }
+    reported_calls_ = calls_;
+    last_report_ = now;
+
+    std::stringstream ss;
+    ss << calls_ << " calls, last one on cpu " << last_cpu_;
+    if(failures_ > 0) {
+        ss << ", " << failures_ << " failures (" << last_error_ << ")";
+    }
+    report = ss.str();
+    return true;
+}
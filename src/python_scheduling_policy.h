@@ -0,0 +1,112 @@
+#ifndef PYTHON_SCHEDULING_POLICY_H
+#define PYTHON_SCHEDULING_POLICY_H
+
+/// SYSTEM
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <sched.h>
+#include <string>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonSchedulingPolicy pins the threads executing a script to a set
+ *        of CPUs and changes their nice value and scheduling class.
+ *
+ * The settings are applied to the calling thread for the lifetime of a Scope and
+ * restored afterwards, since the scheduler threads also execute other nodes.
+ * They are only supported on Linux, elsewhere they are ignored and the status
+ * reports that.
+ */
+class PythonSchedulingPolicy
+{
+public:
+    enum class SchedulingClass {
+        INHERIT = 0,
+        OTHER = 1,
+        BATCH = 2,
+        FIFO = 3
+    };
+
+    static std::map<std::string, int> classNames();
+
+    class Scope
+    {
+    public:
+        Scope(PythonSchedulingPolicy* policy);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator = (const Scope&) = delete;
+
+    private:
+        PythonSchedulingPolicy* policy_;
+
+        bool restore_affinity_;
+#ifdef __linux__
+        cpu_set_t affinity_;
+#endif
+
+        bool restore_nice_;
+        int nice_;
+
+        bool restore_class_;
+        int class_;
+        sched_param param_;
+    };
+
+public:
+    PythonSchedulingPolicy();
+
+    //! parses a list like "2-3,6", an empty list keeps the affinity of the calling thread
+    bool setCpus(const std::string& cpus, std::string& error);
+
+    void setNiceEnabled(bool enabled);
+    bool isNiceEnabled();
+    void setNice(int nice);
+
+    void setSchedulingClass(SchedulingClass scheduling_class);
+    SchedulingClass getSchedulingClass();
+    void setFifoPriority(int priority);
+
+    bool pollReport(std::string& report);
+
+private:
+    struct Settings
+    {
+        bool pin;
+#ifdef __linux__
+        cpu_set_t cpus;
+#endif
+        std::string cpu_list;
+
+        bool change_nice;
+        int nice;
+
+        SchedulingClass scheduling_class;
+        int fifo_priority;
+    };
+
+    void updateActive();
+    void failed(const std::string& what, int error);
+
+private:
+    std::atomic<bool> active_;
+
+    std::mutex mutex_;
+    Settings settings_;
+
+    std::size_t calls_;
+    std::size_t failures_;
+    int last_cpu_;
+    std::string last_error_;
+    std::size_t reported_calls_;
+    std::chrono::steady_clock::time_point last_report_;
+};
+
+}
+
+#endif // PYTHON_SCHEDULING_POLICY_H
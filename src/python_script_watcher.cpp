@@ -0,0 +1,162 @@
+/// HEADER
+#include "python_script_watcher.h"
+
+/// SYSTEM
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <boost/filesystem.hpp>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+using namespace csapex;
+namespace bfs = boost::filesystem;
+
+namespace
+{
+std::string readFile(const std::string& file)
+{
+    std::ifstream in(file.c_str());
+    std::stringstream sstr;
+    sstr << in.rdbuf();
+    return sstr.str();
+}
+}
+
+PythonScriptWatcher::PythonScriptWatcher()
+    : inotify_fd_(-1), running_(false)
+{
+#ifdef __linux__
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotify_fd_ < 0) {
+        std::cerr << "[Python] cannot watch scripts for changes: inotify is not available" << std::endl;
+        return;
+    }
+
+    running_ = true;
+    thread_ = std::thread([this]() {
+        run();
+    });
+#endif
+}
+
+PythonScriptWatcher::~PythonScriptWatcher()
+{
+    stop();
+}
+
+void PythonScriptWatcher::stop()
+{
+    running_ = false;
+    if(thread_.joinable()) {
+        thread_.join();
+    }
+#ifdef __linux__
+    if(inotify_fd_ >= 0) {
+        close(inotify_fd_);
+        inotify_fd_ = -1;
+    }
+#endif
+}
+
+void PythonScriptWatcher::watch(const std::string &file)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    std::string path = bfs::absolute(file).string();
+    if(contents_.find(path) != contents_.end()) {
+        return;
+    }
+    contents_[path] = readFile(path);
+
+#ifdef __linux__
+    if(inotify_fd_ < 0) {
+        return;
+    }
+
+    // editors tend to replace files instead of writing them, so the directory is watched
+    std::string dir = bfs::path(path).parent_path().string();
+    int wd = inotify_add_watch(inotify_fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if(wd < 0) {
+        std::cerr << "[Python] cannot watch " << dir << " for changes" << std::endl;
+        return;
+    }
+    watched_directories_[wd] = dir;
+#endif
+}
+
+void PythonScriptWatcher::track(const std::string &file, const Listener &listener)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    std::string path = bfs::absolute(file).string();
+    listeners_[path].push_back(listener);
+}
+
+void PythonScriptWatcher::run()
+{
+#ifdef __linux__
+    alignas(struct inotify_event) char buffer[4096];
+
+    while(running_) {
+        pollfd pfd;
+        pfd.fd = inotify_fd_;
+        pfd.events = POLLIN;
+        if(poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+
+        ssize_t len = read(inotify_fd_, buffer, sizeof(buffer));
+        if(len <= 0) {
+            continue;
+        }
+
+        std::vector<std::string> changed;
+        for(char* ptr = buffer; ptr < buffer + len; ) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+            if(event->len > 0) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                auto pos = watched_directories_.find(event->wd);
+                if(pos != watched_directories_.end()) {
+                    std::string path = (bfs::path(pos->second) / event->name).string();
+                    if(contents_.find(path) != contents_.end()) {
+                        changed.push_back(path);
+                    }
+                }
+            }
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+
+        for(const std::string& file : changed) {
+            fileChanged(file);
+        }
+    }
+#endif
+}
+
+void PythonScriptWatcher::fileChanged(const std::string &file)
+{
+    std::string code = readFile(file);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::string& known = contents_[file];
+    if(code.empty() || code == known) {
+        return;
+    }
+    known = code;
+
+    std::cout << "[Python] reloading " << file << std::endl;
+
+    // listeners only queue the reload, so they are cheap enough to be called under the lock
+    std::vector<Listener>& list = listeners_[file];
+    for(auto it = list.begin(); it != list.end();) {
+        if((*it)()) {
+            ++it;
+        } else {
+            it = list.erase(it);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef PYTHON_SCRIPT_WATCHER_H
+#define PYTHON_SCRIPT_WATCHER_H
+
+/// SYSTEM
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonScriptWatcher observes python scripts on disk and notifies the
+ *        wrappers that were created from a changed file.
+ *        The watcher holds no reference to the wrappers, listeners only hand the
+ *        reload to the execution thread of their node.
+ */
+class PythonScriptWatcher
+{
+public:
+    /**
+     * @brief Listener is called on the watcher thread when the file has changed
+     * @return false, once the wrapper is gone and the listener can be dropped
+     */
+    typedef std::function<bool()> Listener;
+
+public:
+    PythonScriptWatcher();
+    ~PythonScriptWatcher();
+
+    void watch(const std::string& file);
+    void track(const std::string& file, const Listener& listener);
+
+    void stop();
+
+private:
+    void run();
+    void fileChanged(const std::string& file);
+
+private:
+    int inotify_fd_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+
+    std::mutex mutex_;
+    std::map<int, std::string> watched_directories_;
+    std::map<std::string, std::string> contents_;
+    std::map<std::string, std::vector<Listener>> listeners_;
+};
+
+}
+
+#endif // PYTHON_SCRIPT_WATCHER_H
@@ -0,0 +1,176 @@
+/// HEADER
+#include "python_shared_array.h"
+
+/// COMPONENT
+#include "python_array_view.h"
+
+/// SYSTEM
+#include <boost/python.hpp>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace csapex;
+namespace bp = boost::python;
+
+std::shared_ptr<SharedMapping> SharedMapping::mapFile(const std::string &path, bool copy_on_write)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        throw std::runtime_error(std::string("cannot open ") + path + ": " + std::strerror(errno));
+    }
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        throw std::runtime_error(std::string("cannot map empty or unreadable file ") + path);
+    }
+
+    std::size_t size = static_cast<std::size_t>(info.st_size);
+    void* data = copy_on_write ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+                               : mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        throw std::runtime_error(std::string("cannot map ") + path + ": " + std::strerror(errno));
+    }
+
+    return std::shared_ptr<SharedMapping>(new SharedMapping(data, size, !copy_on_write, path));
+}
+
+std::shared_ptr<SharedMapping> SharedMapping::mapAnonymous(std::size_t bytes)
+{
+    if(bytes == 0) {
+        throw std::runtime_error("cannot create an empty shared array");
+    }
+
+    void* data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(data == MAP_FAILED) {
+        throw std::runtime_error(std::string("cannot create shared mapping: ") + std::strerror(errno));
+    }
+
+    return std::shared_ptr<SharedMapping>(new SharedMapping(data, bytes, false, std::string()));
+}
+
+SharedMapping::SharedMapping(void *data, std::size_t size, bool read_only, const std::string &path)
+    : data_(data), size_(size), read_only_(read_only), path_(path)
+{
+}
+
+SharedMapping::~SharedMapping()
+{
+    munmap(data_, size_);
+}
+
+void* SharedMapping::getData() const
+{
+    return data_;
+}
+
+std::size_t SharedMapping::getSize() const
+{
+    return size_;
+}
+
+bool SharedMapping::isReadOnly() const
+{
+    return read_only_;
+}
+
+const std::string& SharedMapping::getPath() const
+{
+    return path_;
+}
+
+
+SharedArrayRegistry& SharedArrayRegistry::instance()
+{
+    static SharedArrayRegistry registry;
+    return registry;
+}
+
+std::shared_ptr<SharedMapping> SharedArrayRegistry::acquireFile(const std::string &name, const std::string &path)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if(std::shared_ptr<SharedMapping> existing = mappings_[name].lock()) {
+        if(existing->getPath() != path) {
+            throw std::runtime_error("shared array '" + name + "' is already mapped from a different source");
+        }
+        return existing;
+    }
+
+    std::shared_ptr<SharedMapping> mapping = SharedMapping::mapFile(path);
+    mappings_[name] = mapping;
+    return mapping;
+}
+
+std::shared_ptr<SharedMapping> SharedArrayRegistry::acquireAnonymous(const std::string &name, std::size_t bytes)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if(std::shared_ptr<SharedMapping> existing = mappings_[name].lock()) {
+        if(!existing->getPath().empty() || existing->getSize() != bytes) {
+            throw std::runtime_error("shared array '" + name + "' already exists with a different size");
+        }
+        return existing;
+    }
+
+    std::shared_ptr<SharedMapping> mapping = SharedMapping::mapAnonymous(bytes);
+    mappings_[name] = mapping;
+    return mapping;
+}
+
+namespace
+{
+bp::object shared_array(const std::string& name, bp::object source, bp::object dtype)
+{
+    bp::object np_dtype = bp::import("numpy").attr("dtype")(dtype);
+    std::string typestr = bp::extract<std::string>(np_dtype.attr("str"));
+    std::size_t itemsize = bp::extract<std::size_t>(np_dtype.attr("itemsize"));
+
+    std::shared_ptr<SharedMapping> mapping;
+    std::vector<Py_ssize_t> shape;
+
+    bp::extract<std::string> path(source);
+    if(path.check()) {
+        mapping = SharedArrayRegistry::instance().acquireFile(name, path());
+        shape.push_back(static_cast<Py_ssize_t>(mapping->getSize() / itemsize));
+
+    } else {
+        bp::extract<Py_ssize_t> scalar(source);
+        if(scalar.check()) {
+            shape.push_back(scalar());
+        } else {
+            for(Py_ssize_t i = 0, n = bp::len(source); i < n; ++i) {
+                shape.push_back(bp::extract<Py_ssize_t>(source[i]));
+            }
+        }
+
+        std::size_t bytes = itemsize;
+        for(Py_ssize_t dim : shape) {
+            if(dim <= 0) {
+                PyErr_SetString(PyExc_ValueError, "the shape of a shared array must be positive");
+                bp::throw_error_already_set();
+            }
+            bytes *= static_cast<std::size_t>(dim);
+        }
+        mapping = SharedArrayRegistry::instance().acquireAnonymous(name, bytes);
+    }
+
+    ArrayView view(mapping, mapping->getData(), shape, typestr, mapping->isReadOnly());
+    return view.toNumpy();
+}
+}
+
+namespace csapex
+{
+void registerSharedArray()
+{
+    bp::def("shared_array", &shared_array, (bp::arg("name"), bp::arg("path_or_shape"), bp::arg("dtype") = "float32"));
+}
+}
@@ -0,0 +1,65 @@
+#ifndef PYTHON_SHARED_ARRAY_H
+#define PYTHON_SHARED_ARRAY_H
+
+/// SYSTEM
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace csapex
+{
+
+/**
+ * @brief The SharedMapping is a memory mapped file or an anonymous shared mapping.
+ */
+class SharedMapping
+{
+public:
+    //! a copy on write mapping can be modified, the changes stay private to the process
+    static std::shared_ptr<SharedMapping> mapFile(const std::string& path, bool copy_on_write = false);
+    static std::shared_ptr<SharedMapping> mapAnonymous(std::size_t bytes);
+
+    ~SharedMapping();
+
+    void* getData() const;
+    std::size_t getSize() const;
+    bool isReadOnly() const;
+    const std::string& getPath() const;
+
+private:
+    SharedMapping(void* data, std::size_t size, bool read_only, const std::string& path);
+
+private:
+    void* data_;
+    std::size_t size_;
+    bool read_only_;
+    std::string path_;
+};
+
+/**
+ * @brief The SharedArrayRegistry hands out one mapping per name to all nodes and
+ *        interpreters of the process. A mapping is released once no view refers to it anymore.
+ */
+class SharedArrayRegistry
+{
+public:
+    static SharedArrayRegistry& instance();
+
+    std::shared_ptr<SharedMapping> acquireFile(const std::string& name, const std::string& path);
+    std::shared_ptr<SharedMapping> acquireAnonymous(const std::string& name, std::size_t bytes);
+
+private:
+    SharedArrayRegistry() = default;
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, std::weak_ptr<SharedMapping>> mappings_;
+};
+
+void registerSharedArray();
+
+}
+
+#endif // PYTHON_SHARED_ARRAY_H
@@ -0,0 +1,203 @@
+/// HEADER
+#include "python_signals.h"
+
+/// PROJECT
+#include <csapex/model/node_modifier.h>
+#include <csapex/signal/event.h>
+#include <csapex/signal/slot.h>
+
+/// SYSTEM
+#include <algorithm>
+#include <cstdio>
+
+using namespace csapex;
+namespace bp = boost::python;
+
+namespace
+{
+thread_local PythonSignals* g_current_signals = nullptr;
+}
+
+PythonSignals::Scope::Scope(PythonSignals *signals)
+    : previous_(g_current_signals)
+{
+    g_current_signals = signals;
+}
+
+PythonSignals::Scope::~Scope()
+{
+    g_current_signals = previous_;
+}
+
+PythonSignals* PythonSignals::current()
+{
+    return g_current_signals;
+}
+
+PythonSignals::PythonSignals()
+    : dispatch_requested_(false),
+      signals_(0), dispatches_(0), failures_(0), requested_triggers_(0), triggers_(0),
+      reported_signals_(0), reported_triggers_(0)
+{
+}
+
+void PythonSignals::setDispatchRequest(std::function<void()> request)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    request_ = request;
+}
+
+Slot* PythonSignals::addSlot(NodeModifier *modifier, const std::string &label, const bp::object &handler)
+{
+    std::size_t index;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for(Handler& existing : handlers_) {
+            if(existing.label == label) {
+                existing.callback = handler;
+                return existing.slot;
+            }
+        }
+        index = handlers_.size();
+        handlers_.push_back(Handler { label, nullptr, handler, 0 });
+    }
+
+    Slot* slot = modifier->addSlot(label, [this, index]() {
+        enqueue(index);
+    });
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    handlers_[index].slot = slot;
+    return slot;
+}
+
+void PythonSignals::rebind(const bp::object &globals)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(Handler& handler : handlers_) {
+        bp::object callback;
+        if(!handler.callback.is_none() && PyObject_HasAttrString(handler.callback.ptr(), "__name__")) {
+            std::string name = bp::extract<std::string>(handler.callback.attr("__name__"));
+            PyObject* replacement = PyDict_GetItemString(globals.ptr(), name.c_str());
+            if(replacement != NULL && PyCallable_Check(replacement)) {
+                callback = bp::object(bp::handle<>(bp::borrowed(replacement)));
+            }
+        }
+        handler.callback = callback;
+    }
+}
+
+void PythonSignals::enqueue(std::size_t handler)
+{
+    std::function<void()> request;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ++handlers_[handler].pending;
+        ++signals_;
+
+        if(dispatch_requested_) {
+            return;
+        }
+        dispatch_requested_ = true;
+        request = request_;
+    }
+
+    if(request) {
+        request();
+    }
+}
+
+bool PythonSignals::hasPending()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return dispatch_requested_;
+}
+
+void PythonSignals::dispatch(const std::function<void()>& report)
+{
+    std::vector<std::pair<bp::object, std::size_t>> batch;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        dispatch_requested_ = false;
+        for(Handler& handler : handlers_) {
+            if(handler.pending > 0 && !handler.callback.is_none()) {
+                batch.emplace_back(handler.callback, handler.pending);
+            }
+            handler.pending = 0;
+        }
+        if(!batch.empty()) {
+            ++dispatches_;
+        }
+    }
+
+    // a failing handler must not cost the other slots their signals
+    for(const auto& entry : batch) {
+        try {
+            entry.first(entry.second);
+
+        } catch( bp::error_already_set ) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ++failures_;
+            }
+            report();
+        }
+    }
+}
+
+void PythonSignals::coalesce(Event *event)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++requested_triggers_;
+    if(std::find(coalesced_.begin(), coalesced_.end(), event) == coalesced_.end()) {
+        coalesced_.push_back(event);
+    }
+}
+
+void PythonSignals::flushEvents()
+{
+    std::vector<Event*> events;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if(coalesced_.empty()) {
+            return;
+        }
+        events.swap(coalesced_);
+        triggers_ += events.size();
+    }
+
+    for(Event* event : events) {
+        event->trigger();
+    }
+}
+
+void PythonSignals::release()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(Handler& handler : handlers_) {
+        handler.callback = bp::object();
+        handler.pending = 0;
+    }
+    coalesced_.clear();
+    request_ = nullptr;
+}
+
+bool PythonSignals::pollReport(std::string &report)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto now = std::chrono::steady_clock::now();
+    if((signals_ == reported_signals_ && requested_triggers_ == reported_triggers_) ||
+            now - last_report_ < std::chrono::seconds(1)) {
+        return false;
+    }
+    reported_signals_ = signals_;
+    reported_triggers_ = requested_triggers_;
+    last_report_ = now;
+
+    char buffer[192];
+    std::snprintf(buffer, sizeof(buffer), "%zu signals in %zu batches, %zu failed handlers, %zu coalesced triggers sent as %zu",
+                  signals_, dispatches_, failures_, requested_triggers_, triggers_);
+    report = buffer;
+    return true;
+}
@@ -0,0 +1,114 @@
+#ifndef PYTHON_SIGNALS_H
+#define PYTHON_SIGNALS_H
+
+/// PROJECT
+#include <csapex/model/node.h>
+
+/// SYSTEM
+#include <boost/python.hpp>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonSignals deliver the signals of slots with python handlers in
+ *        batches and merge repeated event triggers of one call.
+ *
+ * A signal only increments the counter of its slot. The first signal after a
+ * dispatch requests the next one, which calls every handler with pending signals
+ * once, passing the number of signals it received, under a single acquisition
+ * of the GIL.
+ *
+ * Handlers are identified by the label of their slot. Adding a slot with a label
+ * that is already known only replaces its handler, so running setup again after
+ * reloading the script does not add the slot twice.
+ */
+class PythonSignals
+{
+public:
+    class Scope
+    {
+    public:
+        Scope(PythonSignals* signals);
+        ~Scope();
+
+    private:
+        PythonSignals* previous_;
+    };
+
+public:
+    static PythonSignals* current();
+
+public:
+    PythonSignals();
+
+    //! is called for the first signal after a dispatch, has to lead to a call of dispatch()
+    void setDispatchRequest(std::function<void()> request);
+
+    //! requires the GIL
+    Slot* addSlot(NodeModifier* modifier, const std::string& label, const boost::python::object& handler);
+
+    /**
+     * @brief rebind replaces every handler by the function of the same name in the given
+     *        globals, after the script has been reloaded. Handlers without such a function
+     *        are unbound, their signals are dropped until addSlot binds them again.
+     *        Requires the GIL.
+     */
+    void rebind(const boost::python::object& globals);
+
+    bool hasPending();
+
+    /**
+     * @brief dispatch calls the handlers of all slots with pending signals, requires the GIL
+     * @param report is called with the python error set, whenever a handler raised
+     */
+    void dispatch(const std::function<void()>& report);
+
+    //! the event is triggered once by flushEvents, no matter how often it is requested
+    void coalesce(Event* event);
+
+    //! triggers the coalesced events, has to be called without holding the GIL
+    void flushEvents();
+
+    //! drops all handlers, requires the GIL
+    void release();
+
+    bool pollReport(std::string& report);
+
+private:
+    struct Handler
+    {
+        std::string label;
+        Slot* slot;
+        boost::python::object callback;
+        std::size_t pending;
+    };
+
+    void enqueue(std::size_t handler);
+
+private:
+    std::mutex mutex_;
+    std::vector<Handler> handlers_;
+    bool dispatch_requested_;
+    std::function<void()> request_;
+
+    std::vector<Event*> coalesced_;
+
+    std::size_t signals_;
+    std::size_t dispatches_;
+    std::size_t failures_;
+    std::size_t requested_triggers_;
+    std::size_t triggers_;
+    std::size_t reported_signals_;
+    std::size_t reported_triggers_;
+    std::chrono::steady_clock::time_point last_report_;
+};
+
+}
+
+#endif // PYTHON_SIGNALS_H
@@ -0,0 +1,314 @@
+/// HEADER
+#include "python_state_persistence.h"
+
+/// COMPONENT
+#include "python_array_view.h"
+#include "python_cache_directory.h"
+#include "python_hash.h"
+#include "python_parallel.h"
+#include "python_shared_array.h"
+
+/// SYSTEM
+#include <cerrno>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unistd.h>
+
+using namespace csapex;
+namespace bp = boost::python;
+
+namespace
+{
+// states with less out-of-band data are stored in the graph completely
+const std::size_t SIDECAR_THRESHOLD = 1024 * 1024;
+const std::size_t ALIGNMENT = 64;
+const char MAGIC[8] = { 'C', 'S', 'X', 'S', 'T', 'A', 'T', 'E' };
+
+std::mutex references_mutex;
+std::map<std::string, std::size_t> references;
+
+struct SidecarHeader
+{
+    char magic[8];
+    char id[32];
+    std::uint64_t count;
+    char padding[ALIGNMENT - 48];
+};
+static_assert(sizeof(SidecarHeader) == ALIGNMENT, "the sidecar header has to fill one block");
+
+std::size_t align(std::size_t offset)
+{
+    return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+// relative sidecar names are resolved in the state directory, so that graphs can be moved
+std::string sidecar_path(const std::string& sidecar)
+{
+    if(!sidecar.empty() && sidecar[0] == '/') {
+        return sidecar;
+    }
+    return cacheDirectory("state", "CSAPEX_PYTHON_STATE_DIR") + "/" + sidecar;
+}
+
+std::string to_string(const bp::object& bytes)
+{
+    Py_buffer buffer;
+    if(PyObject_GetBuffer(bytes.ptr(), &buffer, PyBUF_SIMPLE) != 0) {
+        bp::throw_error_already_set();
+    }
+    std::string res(static_cast<const char*>(buffer.buf), buffer.len);
+    PyBuffer_Release(&buffer);
+    return res;
+}
+
+struct BufferGuard
+{
+    ~BufferGuard()
+    {
+        for(Py_buffer& buffer : buffers) {
+            PyBuffer_Release(&buffer);
+        }
+    }
+
+    std::vector<Py_buffer> buffers;
+};
+
+// sidecars are named after their content, so nodes with the same state share one file,
+// and serializing the same state again does not write anything
+void write_sidecar(const bp::list& pickle_buffers, PythonStatePersistence::Snapshot& snapshot)
+{
+    BufferGuard guard;
+    for(long i = 0, n = bp::len(pickle_buffers); i < n; ++i) {
+        bp::object raw = pickle_buffers[i].attr("raw")();
+        Py_buffer buffer;
+        if(PyObject_GetBuffer(raw.ptr(), &buffer, PyBUF_SIMPLE) != 0) {
+            bp::throw_error_already_set();
+        }
+        guard.buffers.push_back(buffer);
+    }
+
+    ScopedGilRelease nogil;
+
+    std::uint64_t hash = 0;
+    std::size_t offset = sizeof(SidecarHeader);
+    for(const Py_buffer& buffer : guard.buffers) {
+        const std::size_t start = align(offset);
+        const std::size_t size = static_cast<std::size_t>(buffer.len);
+        hash = xxh64(&size, sizeof(size), hash);
+        hash = xxh64(buffer.buf, size, hash);
+        snapshot.buffers.emplace_back(start, size);
+        offset = start + size;
+    }
+
+    char id[sizeof(SidecarHeader::id)];
+    std::snprintf(id, sizeof(id), "%016" PRIx64 "-%zu", hash, guard.buffers.size());
+    snapshot.sidecar_id = id;
+    snapshot.sidecar = snapshot.sidecar_id + ".state";
+
+    // checked and counted under one lock, so that a node releasing the same content cannot remove it in between
+    std::unique_lock<std::mutex> lock(references_mutex);
+
+    const std::string path = sidecar_path(snapshot.sidecar);
+    if(access(path.c_str(), R_OK) == 0) {
+        ++references[snapshot.sidecar];
+        return;
+    }
+
+    SidecarHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    std::strncpy(header.id, snapshot.sidecar_id.c_str(), sizeof(header.id) - 1);
+    header.count = guard.buffers.size();
+
+    // the file is replaced atomically, so that it is either complete or missing
+    const std::string tmp = path + "." + std::to_string(getpid()) + ".tmp";
+
+    std::unique_ptr<FILE, int(*)(FILE*)> file(std::fopen(tmp.c_str(), "wb"), &std::fclose);
+    if(!file) {
+        throw std::runtime_error("cannot write " + tmp + ": " + std::strerror(errno));
+    }
+
+    static const char zeros[ALIGNMENT] = {};
+    bool ok = std::fwrite(&header, sizeof(header), 1, file.get()) == 1;
+    offset = sizeof(header);
+    for(std::size_t i = 0; i < guard.buffers.size(); ++i) {
+        const std::size_t start = snapshot.buffers[i].first;
+        const std::size_t size = snapshot.buffers[i].second;
+        ok = ok && std::fwrite(zeros, 1, start - offset, file.get()) == start - offset;
+        ok = ok && std::fwrite(guard.buffers[i].buf, 1, size, file.get()) == size;
+        offset = start + size;
+    }
+    ok = std::fclose(file.release()) == 0 && ok;
+
+    if(!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("cannot write " + path + ": " + std::strerror(errno));
+    }
+    ++references[snapshot.sidecar];
+}
+
+bp::list map_sidecar(const PythonStatePersistence::Snapshot& snapshot)
+{
+    const std::string path = sidecar_path(snapshot.sidecar);
+    std::shared_ptr<SharedMapping> mapping = SharedMapping::mapFile(path, true);
+
+    const SidecarHeader* header = static_cast<const SidecarHeader*>(mapping->getData());
+    bool valid = mapping->getSize() >= sizeof(SidecarHeader) &&
+            std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 &&
+            std::strncmp(header->id, snapshot.sidecar_id.c_str(), sizeof(header->id)) == 0 &&
+            header->count == snapshot.buffers.size();
+    for(const auto& buffer : snapshot.buffers) {
+        valid = valid && buffer.first + buffer.second <= mapping->getSize();
+    }
+    if(!valid) {
+        throw std::runtime_error(path + " does not contain the saved state");
+    }
+
+    bp::object bytes = ArrayView(mapping, mapping->getData(), { static_cast<Py_ssize_t>(mapping->getSize()) },
+                                 ArrayView::typestr<std::uint8_t>(), false).toNumpy();
+    bp::list buffers;
+    for(const auto& buffer : snapshot.buffers) {
+        buffers.append(bytes.slice(buffer.first, buffer.first + buffer.second));
+    }
+    return buffers;
+}
+}
+
+bool PythonStatePersistence::Snapshot::empty() const
+{
+    return pickle.empty();
+}
+
+bool PythonStatePersistence::capture(const bp::object &globals, Snapshot &snapshot)
+{
+    if(PyDict_GetItemString(globals.ptr(), "__getstate__") == NULL) {
+        return false;
+    }
+
+    bp::object state = globals["__getstate__"]();
+
+    bp::object pickle = bp::import("pickle");
+    bp::object dumps = pickle.attr("dumps");
+    const int protocol = bp::extract<int>(pickle.attr("HIGHEST_PROTOCOL"));
+
+    snapshot = Snapshot();
+
+    bp::list buffers;
+    bp::object data;
+    if(protocol >= 5) {
+        bp::dict kwargs;
+        kwargs["buffer_callback"] = buffers.attr("append");
+        data = dumps(*bp::make_tuple(state, protocol), **kwargs);
+
+        std::size_t bytes = 0;
+        for(long i = 0, n = bp::len(buffers); i < n; ++i) {
+            bytes += bp::extract<std::size_t>(buffers[i].attr("raw")().attr("nbytes"));
+        }
+        if(bytes < SIDECAR_THRESHOLD) {
+            buffers = bp::list();
+            data = dumps(state, protocol);
+        }
+    } else {
+        data = dumps(state, protocol);
+    }
+
+    snapshot.pickle = to_string(data);
+
+    if(bp::len(buffers) > 0) {
+        write_sidecar(buffers, snapshot);
+    }
+
+    return true;
+}
+
+bool PythonStatePersistence::restore(const bp::object &globals, const Snapshot &snapshot)
+{
+    if(PyDict_GetItemString(globals.ptr(), "__setstate__") == NULL) {
+        return false;
+    }
+
+    bp::object data(bp::handle<>(PyBytes_FromStringAndSize(snapshot.pickle.data(), snapshot.pickle.size())));
+    bp::object loads = bp::import("pickle").attr("loads");
+
+    bp::object state;
+    if(snapshot.sidecar.empty()) {
+        state = loads(data);
+    } else {
+        bp::dict kwargs;
+        kwargs["buffers"] = map_sidecar(snapshot);
+        state = loads(*bp::make_tuple(data), **kwargs);
+    }
+
+    globals["__setstate__"](state);
+    return true;
+}
+
+void PythonStatePersistence::retain(const Snapshot &snapshot)
+{
+    if(snapshot.sidecar.empty()) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(references_mutex);
+    ++references[snapshot.sidecar];
+}
+
+void PythonStatePersistence::release(const Snapshot &snapshot)
+{
+    if(snapshot.sidecar.empty()) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(references_mutex);
+    auto pos = references.find(snapshot.sidecar);
+    if(pos == references.end() || --pos->second > 0) {
+        return;
+    }
+    references.erase(pos);
+
+    // arrays restored from the sidecar keep their mapping, even when the file is gone
+    std::remove(sidecar_path(snapshot.sidecar).c_str());
+}
+
+void PythonStatePersistence::write(const Snapshot &snapshot, YAML::Node &doc)
+{
+    doc["pickle"] = YAML::Binary(reinterpret_cast<const unsigned char*>(snapshot.pickle.data()), snapshot.pickle.size());
+
+    if(!snapshot.sidecar.empty()) {
+        doc["sidecar"] = snapshot.sidecar;
+        doc["sidecar_id"] = snapshot.sidecar_id;
+        for(const auto& buffer : snapshot.buffers) {
+            YAML::Node entry;
+            entry.push_back(buffer.first);
+            entry.push_back(buffer.second);
+            doc["buffers"].push_back(entry);
+        }
+    }
+}
+
+bool PythonStatePersistence::read(const YAML::Node &doc, Snapshot &snapshot)
+{
+    if(!doc["pickle"].IsDefined()) {
+        return false;
+    }
+
+    snapshot = Snapshot();
+
+    YAML::Binary binary = doc["pickle"].as<YAML::Binary>();
+    snapshot.pickle.assign(reinterpret_cast<const char*>(binary.data()), binary.size());
+
+    if(doc["sidecar"].IsDefined()) {
+        snapshot.sidecar = doc["sidecar"].as<std::string>();
+        snapshot.sidecar_id = doc["sidecar_id"].as<std::string>();
+        for(const YAML::Node& entry : doc["buffers"]) {
+            snapshot.buffers.emplace_back(entry[0].as<std::size_t>(), entry[1].as<std::size_t>());
+        }
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+#ifndef PYTHON_STATE_PERSISTENCE_H
+#define PYTHON_STATE_PERSISTENCE_H
+
+/// SYSTEM
+#include <boost/python.hpp>
+#include <yaml-cpp/yaml.h>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonStatePersistence saves what a script returns from __getstate__ with
+ *        the graph and passes it to __setstate__ once the script has been loaded again,
+ *        so that expensive warm-up like loading models can be skipped.
+ *
+ * The state is pickled into the graph. Large contiguous buffers, like numpy arrays,
+ * are written to a sidecar file instead (pickle protocol 5). Sidecars are stored in
+ * the state cache directory, named after a hash of their content, and the graph only
+ * refers to them by name. The sidecar is mapped copy-on-write when loading, so the
+ * restored arrays are neither decoded nor copied.
+ *
+ * Snapshots that are kept by a node are counted, a sidecar is removed once the last
+ * of them has been replaced by a newer state. Like any cache, a graph saved before
+ * that then starts without the out-of-band part of its state.
+ */
+class PythonStatePersistence
+{
+public:
+    struct Snapshot
+    {
+        std::string pickle;
+
+        //! file name relative to the state directory
+        std::string sidecar;
+        std::string sidecar_id;
+        //! offset and size of each out-of-band buffer in the sidecar
+        std::vector<std::pair<std::size_t, std::size_t>> buffers;
+
+        bool empty() const;
+    };
+
+    /**
+     * @brief capture calls __getstate__ and pickles the result, requires the GIL.
+     *        A written sidecar is already retained for the snapshot.
+     * @return false, iff the script does not define __getstate__
+     */
+    static bool capture(const boost::python::object& globals, Snapshot& snapshot);
+
+    /**
+     * @brief restore unpickles the state and passes it to __setstate__, requires the GIL
+     * @return false, iff the script does not define __setstate__
+     */
+    static bool restore(const boost::python::object& globals, const Snapshot& snapshot);
+
+    //! counts the snapshot as a reference to its sidecar
+    static void retain(const Snapshot& snapshot);
+    //! drops the reference and removes the sidecar if it was the last one
+    static void release(const Snapshot& snapshot);
+
+    static void write(const Snapshot& snapshot, YAML::Node& doc);
+    static bool read(const YAML::Node& doc, Snapshot& snapshot);
+};
+
+}
+
+#endif // PYTHON_STATE_PERSISTENCE_H
@@ -0,0 +1,119 @@
+/// HEADER
+#include "python_thread_states.h"
+
+/// PROJECT
+#include <csapex/utility/assert.h>
+
+/// SYSTEM
+#include <algorithm>
+
+using namespace csapex;
+
+namespace
+{
+struct CachedState
+{
+    std::uint64_t id;
+    std::weak_ptr<bool> alive;
+    PyThreadState* state;
+};
+
+thread_local std::vector<CachedState> g_cached_states;
+
+std::atomic<std::uint64_t> g_next_id(1);
+}
+
+PythonThreadStates::PythonThreadStates()
+    : id_(0), interpreter_(nullptr)
+{
+}
+
+PythonThreadStates::~PythonThreadStates()
+{
+}
+
+void PythonThreadStates::adopt(PyThreadState *main)
+{
+    interpreter_ = main->interp;
+    alive_ = std::make_shared<bool>(true);
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        states_.assign(1, main);
+    }
+
+    // ids are never reused, an entry of an ended interpreter cannot match again
+    id_ = g_next_id++;
+    g_cached_states.push_back(CachedState { id_, alive_, main });
+}
+
+bool PythonThreadStates::isValid() const
+{
+    return id_ != 0;
+}
+
+PyThreadState* PythonThreadStates::get()
+{
+    const std::uint64_t id = id_.load(std::memory_order_relaxed);
+    if(id == 0) {
+        // without an interpreter, PyThreadState_New would dereference a null interpreter
+        return nullptr;
+    }
+    for(const CachedState& cached : g_cached_states) {
+        if(cached.id == id) {
+            return cached.state;
+        }
+    }
+    return create();
+}
+
+PyThreadState* PythonThreadStates::create()
+{
+    PyThreadState* state = PyThreadState_New(interpreter_);
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        states_.push_back(state);
+    }
+
+    g_cached_states.erase(std::remove_if(g_cached_states.begin(), g_cached_states.end(), [](const CachedState& cached) {
+        return cached.alive.expired();
+    }), g_cached_states.end());
+    g_cached_states.push_back(CachedState { id_, alive_, state });
+
+    return state;
+}
+
+void PythonThreadStates::acquire()
+{
+    PyThreadState* state = get();
+    apex_assert(state != nullptr);
+    PyEval_AcquireThread(state);
+}
+
+void PythonThreadStates::release()
+{
+    PyThreadState* state = get();
+    apex_assert(state != nullptr);
+    PyEval_ReleaseThread(state);
+}
+
+void PythonThreadStates::end()
+{
+    PyThreadState* current = PyThreadState_Get();
+
+    std::vector<PyThreadState*> states;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        states.swap(states_);
+    }
+    for(PyThreadState* state : states) {
+        if(state != current) {
+            PyThreadState_Clear(state);
+            PyThreadState_Delete(state);
+        }
+    }
+
+    id_ = 0;
+    alive_.reset();
+
+    Py_EndInterpreter(current);
+}
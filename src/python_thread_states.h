@@ -0,0 +1,65 @@
+#ifndef PYTHON_THREAD_STATES_H
+#define PYTHON_THREAD_STATES_H
+
+/// SYSTEM
+#include <Python.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonThreadStates hand out one thread state per OS thread for a
+ *        sub-interpreter, so that any worker thread of the scheduler can enter it.
+ *
+ * The states are looked up in a thread-local cache without taking a lock. Each
+ * state is registered with its interpreter as well, because all of them have to
+ * be deleted before the interpreter can be ended.
+ */
+class PythonThreadStates
+{
+public:
+    PythonThreadStates();
+    ~PythonThreadStates();
+
+    PythonThreadStates(const PythonThreadStates&) = delete;
+    PythonThreadStates& operator = (const PythonThreadStates&) = delete;
+
+    //! takes over the state returned by Py_NewInterpreter as the state of the calling thread
+    void adopt(PyThreadState* main);
+
+    bool isValid() const;
+
+    //! returns the state of the calling thread, it is created on first use, nullptr before adopt and after end
+    PyThreadState* get();
+
+    void acquire();
+    void release();
+
+    /**
+     * @brief end deletes the states of all threads and ends the interpreter,
+     *        the state of the calling thread has to be the current one
+     */
+    void end();
+
+private:
+    PyThreadState* create();
+
+private:
+    std::atomic<std::uint64_t> id_;
+    PyInterpreterState* interpreter_;
+
+    // expires when the interpreter is ended, stale cache entries are dropped lazily
+    std::shared_ptr<bool> alive_;
+
+    std::mutex mutex_;
+    std::vector<PyThreadState*> states_;
+};
+
+}
+
+#endif // PYTHON_THREAD_STATES_H
@@ -0,0 +1,365 @@
+/// HEADER
+#include "python_tile_processor.h"
+
+/// COMPONENT
+#include "python_array_view.h"
+#include "python_parallel.h"
+
+/// SYSTEM
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace csapex;
+namespace bp = boost::python;
+
+namespace
+{
+// the ports and the node belong to the interpreter of the node, workers get placeholders
+// that explain why they cannot be used instead of failing with a NameError
+const char* WORKER_GLOBALS =
+        "class _NodeOnly(object):\n"
+        "    def __init__(self, name):\n"
+        "        object.__setattr__(self, '_name', name)\n"
+        "    def _fail(self, *args, **kwargs):\n"
+        "        raise RuntimeError(\"'%s' is not available in process_tile, tiles run in separate \"\n"
+        "                           \"interpreters, use setup_tile() to initialize them\" % object.__getattribute__(self, '_name'))\n"
+        "    __getattr__ = __setattr__ = __getitem__ = __iter__ = __len__ = __call__ = _fail\n"
+        "for _name in ('inputs', 'outputs', 'slots', 'events', 'node'):\n"
+        "    globals()[_name] = _NodeOnly(_name)\n"
+        "del _name\n";
+
+// the OpenCV depth of a buffer format, see the struct module
+int buffer_depth(const char* format, Py_ssize_t itemsize)
+{
+    if(!format || !*format) {
+        return itemsize == 1 ? CV_8U : -1;
+    }
+    switch(format[std::strlen(format) - 1]) {
+    case '?': case 'B': return CV_8U;
+    case 'b': return CV_8S;
+    case 'H': return CV_16U;
+    case 'h': return CV_16S;
+    case 'i': case 'l': return itemsize == 4 ? CV_32S : -1;
+    case 'f': return CV_32F;
+    case 'd': return CV_64F;
+    default: return -1;
+    }
+}
+}
+
+PythonTileProcessor::PythonTileProcessor(PythonMemoryArena *arena, PythonSchedulingPolicy *scheduling_policy)
+    : arena_(arena), scheduling_policy_(scheduling_policy), tile_size_(512), overlap_(16), worker_count_(4),
+      running_(false), generation_(0), next_tile_(0), active_(0)
+{
+}
+
+PythonTileProcessor::~PythonTileProcessor()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        running_ = false;
+        job_changed_.notify_all();
+    }
+    for(const std::unique_ptr<Worker>& worker : workers_) {
+        if(worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void PythonTileProcessor::setTileSize(int size)
+{
+    tile_size_ = std::max(1, size);
+}
+
+void PythonTileProcessor::setOverlap(int overlap)
+{
+    overlap_ = std::max(0, overlap);
+}
+
+void PythonTileProcessor::setWorkerCount(int count)
+{
+    worker_count_ = std::max(1, count);
+}
+
+bool PythonTileProcessor::prepare(const std::string &code, std::string &error)
+{
+    const int count = worker_count_;
+    if(code == code_ && static_cast<int>(workers_.size()) == count) {
+        return true;
+    }
+
+    release();
+
+    PyThreadState* caller = PyThreadState_Get();
+    for(int i = 0; i < count; ++i) {
+        std::unique_ptr<Worker> worker(new Worker);
+        PyThreadState* main = Py_NewInterpreter();
+        if(!main) {
+            PyThreadState_Swap(caller);
+            error = "cannot create a worker interpreter";
+            release();
+            return false;
+        }
+        worker->states.adopt(main);
+
+        try {
+            worker->globals = bp::import("__main__").attr("__dict__");
+            worker->globals["csapex"] = bp::import("csapex");
+            bp::exec(WORKER_GLOBALS, worker->globals, worker->globals);
+            bp::exec(code.c_str(), worker->globals, worker->globals);
+            if(PyDict_GetItemString(worker->globals.ptr(), "setup_tile") != NULL) {
+                worker->globals["setup_tile"]();
+            }
+            worker->process_tile = worker->globals["process_tile"];
+
+        } catch( bp::error_already_set ) {
+            error = worker->error_handler.describe();
+        }
+
+        PyThreadState_Swap(caller);
+        workers_.push_back(std::move(worker));
+
+        if(!error.empty()) {
+            release();
+            return false;
+        }
+    }
+
+    code_ = code;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    running_ = true;
+    // a worker that starts late must still take part in the next job
+    const std::size_t generation = generation_;
+    for(const std::unique_ptr<Worker>& worker : workers_) {
+        Worker* w = worker.get();
+        w->thread = std::thread([this, w, generation]() {
+            workerLoop(w, generation);
+        });
+    }
+    return true;
+}
+
+void PythonTileProcessor::release()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        running_ = false;
+        job_changed_.notify_all();
+    }
+    for(const std::unique_ptr<Worker>& worker : workers_) {
+        if(worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+
+    // the objects of each worker have to be released in its own interpreter
+    PyThreadState* caller = PyThreadState_Get();
+    for(const std::unique_ptr<Worker>& worker : workers_) {
+        PyThreadState_Swap(worker->states.get());
+        worker->process_tile = bp::object();
+        worker->globals = bp::object();
+        worker->error_handler.release();
+        worker->states.end();
+    }
+    PyThreadState_Swap(caller);
+
+    workers_.clear();
+    code_.clear();
+}
+
+bool PythonTileProcessor::process(const cv::Mat &image, cv::Mat &result, std::string &error)
+{
+    if(image.empty()) {
+        error = "cannot split an empty image into tiles";
+        return false;
+    }
+
+    const int size = tile_size_;
+    const int overlap = overlap_;
+    const cv::Rect bounds(0, 0, image.cols, image.rows);
+
+    std::vector<Tile> tiles;
+    for(int y = 0; y < image.rows; y += size) {
+        for(int x = 0; x < image.cols; x += size) {
+            Tile tile;
+            tile.core = cv::Rect(x, y, std::min(size, image.cols - x), std::min(size, image.rows - y));
+            tile.extended = cv::Rect(x - overlap, y - overlap, tile.core.width + 2 * overlap, tile.core.height + 2 * overlap) & bounds;
+            tiles.push_back(tile);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(workers_.empty()) {
+        error = "the tile workers are not prepared";
+        return false;
+    }
+
+    image_ = std::make_shared<cv::Mat>(image);
+    tiles_ = std::move(tiles);
+    next_tile_ = 0;
+    active_ = 0;
+    error_.clear();
+    result_ = cv::Mat();
+    ++generation_;
+    job_changed_.notify_all();
+
+    job_done_.wait(lock, [this]() {
+        return next_tile_ >= tiles_.size() && active_ == 0;
+    });
+
+    image_.reset();
+    tiles_.clear();
+    if(!error_.empty()) {
+        error = error_;
+        result_ = cv::Mat();
+        return false;
+    }
+
+    result = result_;
+    result_ = cv::Mat();
+    return true;
+}
+
+void PythonTileProcessor::workerLoop(Worker *worker, std::size_t generation)
+{
+    PythonMemoryArena::Scope memory_scope(arena_);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(true) {
+        job_changed_.wait(lock, [this, generation]() {
+            return !running_ || generation_ != generation;
+        });
+        if(!running_) {
+            return;
+        }
+        generation = generation_;
+
+        while(next_tile_ < tiles_.size()) {
+            std::size_t index = next_tile_++;
+            ++active_;
+            lock.unlock();
+
+            std::string error;
+            bool success = processTile(worker, index, error);
+
+            lock.lock();
+            --active_;
+            if(!success && error_.empty()) {
+                // the remaining tiles are skipped
+                error_ = error;
+                next_tile_ = tiles_.size();
+            }
+        }
+
+        if(active_ == 0) {
+            job_done_.notify_all();
+        }
+    }
+}
+
+bool PythonTileProcessor::processTile(Worker *worker, std::size_t index, std::string &error)
+{
+    const Tile& tile = tiles_[index];
+
+    worker->states.acquire();
+
+    bool success = true;
+    {
+        // the settings apply once the GIL is held, changes take effect with the next tile
+        PythonSchedulingPolicy::Scope scheduling_scope(scheduling_policy_);
+        try {
+            cv::Mat roi = (*image_)(tile.extended);
+            std::string typestr;
+            if(!ArrayView::depthTypestr(roi.depth(), typestr)) {
+                throw std::runtime_error("unsupported image depth");
+            }
+
+            std::vector<Py_ssize_t> shape { roi.rows, roi.cols };
+            std::vector<Py_ssize_t> strides { static_cast<Py_ssize_t>(roi.step[0]), static_cast<Py_ssize_t>(roi.elemSize()) };
+            if(roi.channels() > 1) {
+                shape.push_back(roi.channels());
+                strides.push_back(static_cast<Py_ssize_t>(roi.elemSize1()));
+            }
+            ArrayView view(image_, roi.data, shape, strides, typestr, true);
+
+            bp::dict info;
+            info["index"] = index;
+            info["count"] = tiles_.size();
+            info["x"] = tile.core.x;
+            info["y"] = tile.core.y;
+            info["width"] = tile.core.width;
+            info["height"] = tile.core.height;
+            info["left"] = tile.core.x - tile.extended.x;
+            info["top"] = tile.core.y - tile.extended.y;
+            info["image_width"] = image_->cols;
+            info["image_height"] = image_->rows;
+
+            bp::object output = worker->process_tile(view.toNumpy(), info);
+            store(tile, output);
+
+        } catch( bp::error_already_set ) {
+            error = worker->error_handler.describe();
+            success = false;
+        } catch(const std::exception& e) {
+            error = e.what();
+            success = false;
+        }
+    }
+
+    worker->states.release();
+
+    return success;
+}
+
+void PythonTileProcessor::store(const Tile &tile, const bp::object &output)
+{
+    if(output.is_none()) {
+        throw std::runtime_error("process_tile has to return an array");
+    }
+
+    bp::object array = bp::import("numpy").attr("ascontiguousarray")(output);
+
+    Py_buffer buffer;
+    if(PyObject_GetBuffer(array.ptr(), &buffer, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+        bp::throw_error_already_set();
+    }
+    std::unique_ptr<Py_buffer, void(*)(Py_buffer*)> guard(&buffer, &PyBuffer_Release);
+
+    if(buffer.ndim != 2 && buffer.ndim != 3) {
+        throw std::runtime_error("process_tile has to return an array of shape (h, w) or (h, w, c)");
+    }
+    const int rows = static_cast<int>(buffer.shape[0]);
+    const int cols = static_cast<int>(buffer.shape[1]);
+    const int channels = buffer.ndim == 3 ? static_cast<int>(buffer.shape[2]) : 1;
+    const int depth = buffer_depth(buffer.format, buffer.itemsize);
+    if(depth < 0 || channels < 1 || channels > CV_CN_MAX) {
+        throw std::runtime_error("process_tile returned an unsupported dtype, use uint8, int8, uint16, int16, int32, float32 or float64");
+    }
+
+    cv::Point offset;
+    if(rows == tile.core.height && cols == tile.core.width) {
+        offset = cv::Point(0, 0);
+    } else if(rows == tile.extended.height && cols == tile.extended.width) {
+        offset = tile.core.tl() - tile.extended.tl();
+    } else {
+        throw std::runtime_error("process_tile has to return an array of the size of the tile or of its core region");
+    }
+
+    const int type = CV_MAKETYPE(depth, channels);
+    {
+        std::unique_lock<std::mutex> lock(result_mutex_);
+        if(result_.empty()) {
+            result_.create(image_->rows, image_->cols, type);
+        } else if(result_.type() != type) {
+            throw std::runtime_error("all tiles have to return the same dtype and number of channels");
+        }
+    }
+
+    // the tiles write to disjoint regions of the result
+    cv::Mat source(rows, cols, type, buffer.buf);
+    ScopedGilRelease nogil;
+    source(cv::Rect(offset, tile.core.size())).copyTo(result_(tile.core));
+}
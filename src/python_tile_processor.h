@@ -0,0 +1,112 @@
+#ifndef PYTHON_TILE_PROCESSOR_H
+#define PYTHON_TILE_PROCESSOR_H
+
+/// COMPONENT
+#include "python_error_handler.h"
+#include "python_memory_arena.h"
+#include "python_scheduling_policy.h"
+#include "python_thread_states.h"
+
+/// SYSTEM
+#include <boost/python.hpp>
+#include <opencv2/core/core.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonTileProcessor calls the process_tile(tile, info) function of a script
+ *        on overlapping tiles of an image and stitches the results into one image in C++.
+ *
+ * Every worker executes the script in its own sub-interpreter and thread. The
+ * sub-interpreters share the GIL, so tiles only run concurrently while the script is
+ * in native code that releases it, like most numpy and OpenCV operations. Tile mode
+ * is meant for such kernels, pure Python in process_tile is executed one tile at a time.
+ *
+ * process_tile receives a read-only view of the tile including the overlap and returns
+ * either an array of the same size or of the size of the core region given in info.
+ *
+ * process_tile has to be self-contained: workers do not run setup() and have no access
+ * to inputs, outputs, slots, events or the node. A script can define setup_tile(),
+ * which every worker calls once after executing the code, to prepare its own state.
+ */
+class PythonTileProcessor
+{
+public:
+    PythonTileProcessor(PythonMemoryArena* arena, PythonSchedulingPolicy* scheduling_policy);
+    ~PythonTileProcessor();
+
+    void setTileSize(int size);
+    void setOverlap(int overlap);
+    void setWorkerCount(int count);
+
+    /**
+     * @brief prepare (re-)creates the workers if the code or their count changed,
+     *        requires the GIL of the calling interpreter
+     * @return false, iff the code cannot be executed in the workers
+     */
+    bool prepare(const std::string& code, std::string& error);
+
+    //! has to be called without holding the GIL
+    bool process(const cv::Mat& image, cv::Mat& result, std::string& error);
+
+    //! destroys the workers, requires the GIL of the calling interpreter
+    void release();
+
+private:
+    struct Worker
+    {
+        PythonThreadStates states;
+        boost::python::object globals;
+        boost::python::object process_tile;
+        PythonErrorHandler error_handler;
+        std::thread thread;
+    };
+
+    struct Tile
+    {
+        cv::Rect core;
+        cv::Rect extended;
+    };
+
+    void workerLoop(Worker* worker, std::size_t generation);
+    bool processTile(Worker* worker, std::size_t index, std::string& error);
+    void store(const Tile& tile, const boost::python::object& output);
+
+private:
+    PythonMemoryArena* arena_;
+    PythonSchedulingPolicy* scheduling_policy_;
+
+    std::atomic<int> tile_size_;
+    std::atomic<int> overlap_;
+    std::atomic<int> worker_count_;
+
+    std::string code_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable job_changed_;
+    std::condition_variable job_done_;
+    bool running_;
+    std::size_t generation_;
+
+    std::shared_ptr<cv::Mat> image_;
+    std::vector<Tile> tiles_;
+    std::size_t next_tile_;
+    std::size_t active_;
+    std::string error_;
+
+    std::mutex result_mutex_;
+    cv::Mat result_;
+};
+
+}
+
+#endif // PYTHON_TILE_PROCESSOR_H
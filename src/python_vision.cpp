@@ -0,0 +1,168 @@
+/// HEADER
+#include "python_vision.h"
+
+/// PROJECT
+#include <csapex_opencv/cv_mat_message.h>
+
+/// COMPONENT
+#include "python_parallel.h"
+
+/// SYSTEM
+#include <boost/python.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <vector>
+
+using namespace csapex;
+namespace bp = boost::python;
+
+namespace
+{
+struct Conversion
+{
+    const Encoding& from;
+    const Encoding& to;
+    int code;
+};
+
+// all encodings can be reached via bgr
+const std::vector<Conversion>& conversions()
+{
+    static std::vector<Conversion> table {
+        { enc::bgr, enc::mono, cv::COLOR_BGR2GRAY },
+        { enc::bgr, enc::rgb, cv::COLOR_BGR2RGB },
+        { enc::bgr, enc::hsv, cv::COLOR_BGR2HSV },
+        { enc::bgr, enc::hsl, cv::COLOR_BGR2HLS },
+        { enc::bgr, enc::lab, cv::COLOR_BGR2Lab },
+        { enc::bgr, enc::yuv, cv::COLOR_BGR2YUV },
+        { enc::mono, enc::bgr, cv::COLOR_GRAY2BGR },
+        { enc::mono, enc::rgb, cv::COLOR_GRAY2RGB },
+        { enc::rgb, enc::bgr, cv::COLOR_RGB2BGR },
+        { enc::rgb, enc::mono, cv::COLOR_RGB2GRAY },
+        { enc::hsv, enc::bgr, cv::COLOR_HSV2BGR },
+        { enc::hsl, enc::bgr, cv::COLOR_HLS2BGR },
+        { enc::lab, enc::bgr, cv::COLOR_Lab2BGR },
+        { enc::yuv, enc::bgr, cv::COLOR_YUV2BGR }
+    };
+    return table;
+}
+
+bool find_conversion(const Encoding& from, const Encoding& to, int& code)
+{
+    for(const Conversion& c : conversions()) {
+        if(c.from.matches(from) && c.to.matches(to)) {
+            code = c.code;
+            return true;
+        }
+    }
+    return false;
+}
+
+connection_types::CvMatMessage::Ptr derive(const connection_types::CvMatMessage& message, const Encoding& encoding)
+{
+    return std::make_shared<connection_types::CvMatMessage>(encoding, message.frame_id, message.stamp_micro_seconds);
+}
+
+connection_types::CvMatMessage::Ptr cvt_color(const connection_types::CvMatMessage& message, const Encoding& target)
+{
+    const Encoding& source = message.getEncoding();
+    auto res = derive(message, target);
+    if(source.matches(target)) {
+        res->value = message.value;
+        return res;
+    }
+
+    int direct = 0, first = 0, second = 0;
+    bool has_direct = find_conversion(source, target, direct);
+    bool has_indirect = !has_direct && find_conversion(source, enc::bgr, first) && find_conversion(enc::bgr, target, second);
+    if(!has_direct && !has_indirect) {
+        PyErr_Format(PyExc_ValueError, "cannot convert from %s to %s", source.getName().c_str(), target.getName().c_str());
+        bp::throw_error_already_set();
+    }
+
+    ScopedGilRelease nogil;
+    if(has_direct) {
+        cv::cvtColor(message.value, res->value, direct);
+    } else {
+        cv::Mat bgr;
+        cv::cvtColor(message.value, bgr, first);
+        cv::cvtColor(bgr, res->value, second);
+    }
+    return res;
+}
+
+connection_types::CvMatMessage::Ptr resize(const connection_types::CvMatMessage& message, int width, int height, int interpolation)
+{
+    if(width <= 0 || height <= 0) {
+        PyErr_SetString(PyExc_ValueError, "the size has to be positive");
+        bp::throw_error_already_set();
+    }
+
+    auto res = derive(message, message.getEncoding());
+    ScopedGilRelease nogil;
+    cv::resize(message.value, res->value, cv::Size(width, height), 0, 0, interpolation);
+    return res;
+}
+
+// the result is a copy by default, a view shares the pixels with the input, which may be published elsewhere
+connection_types::CvMatMessage::Ptr crop(const connection_types::CvMatMessage& message, int x, int y, int width, int height, bool copy)
+{
+    cv::Rect roi = cv::Rect(x, y, width, height) & cv::Rect(0, 0, message.value.cols, message.value.rows);
+    if(roi.area() == 0) {
+        PyErr_SetString(PyExc_ValueError, "the region does not overlap the image");
+        bp::throw_error_already_set();
+    }
+
+    auto res = derive(message, message.getEncoding());
+    if(copy) {
+        ScopedGilRelease nogil;
+        message.value(roi).copyTo(res->value);
+    } else {
+        res->value = message.value(roi);
+    }
+    return res;
+}
+
+connection_types::CvMatMessage::Ptr normalize(const connection_types::CvMatMessage& message, double alpha, double beta,
+                                              int norm_type, int dtype)
+{
+    cv::Mat result;
+    {
+        ScopedGilRelease nogil;
+        cv::normalize(message.value, result, alpha, beta, norm_type, dtype);
+    }
+
+    // the channel ranges of an encoding only hold for the source depth or 8 bit images
+    const Encoding& encoding = result.depth() == message.value.depth() || result.depth() == CV_8U ? message.getEncoding()
+                                                                                                 : enc::unknown;
+    auto res = derive(message, encoding);
+    res->value = result;
+    return res;
+}
+}
+
+namespace csapex
+{
+void registerVision()
+{
+    std::string nested_name = bp::extract<std::string>(bp::scope().attr("__name__") + ".vision");
+    bp::object nested_module(bp::handle<>(bp::borrowed(PyImport_AddModule(nested_name.c_str()))));
+    bp::scope().attr("vision") = nested_module;
+    bp::scope parent = nested_module;
+
+    bp::def("cvt_color", &cvt_color, (bp::arg("image"), bp::arg("encoding")));
+    bp::def("resize", &resize, (bp::arg("image"), bp::arg("width"), bp::arg("height"),
+                                bp::arg("interpolation") = static_cast<int>(cv::INTER_LINEAR)));
+    bp::def("crop", &crop, (bp::arg("image"), bp::arg("x"), bp::arg("y"), bp::arg("width"), bp::arg("height"),
+                            bp::arg("copy") = true));
+    bp::def("normalize", &normalize, (bp::arg("image"), bp::arg("alpha") = 0.0, bp::arg("beta") = 255.0,
+                                      bp::arg("norm_type") = static_cast<int>(cv::NORM_MINMAX), bp::arg("dtype") = -1));
+
+    parent.attr("INTER_NEAREST") = static_cast<int>(cv::INTER_NEAREST);
+    parent.attr("INTER_LINEAR") = static_cast<int>(cv::INTER_LINEAR);
+    parent.attr("INTER_CUBIC") = static_cast<int>(cv::INTER_CUBIC);
+    parent.attr("INTER_AREA") = static_cast<int>(cv::INTER_AREA);
+    parent.attr("NORM_MINMAX") = static_cast<int>(cv::NORM_MINMAX);
+    parent.attr("NORM_L2") = static_cast<int>(cv::NORM_L2);
+}
+}
@@ -0,0 +1,16 @@
+#ifndef PYTHON_VISION_H
+#define PYTHON_VISION_H
+
+namespace csapex
+{
+
+/**
+ * @brief registerVision adds the csapex.vision submodule, which applies common image
+ *        operations directly to CvMatMessages. The results are new messages with a
+ *        consistent encoding that can be published as they are.
+ */
+void registerVision();
+
+}
+
+#endif // PYTHON_VISION_H
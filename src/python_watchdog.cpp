@@ -0,0 +1,257 @@
+/// HEADER
+#include "python_watchdog.h"
+
+/// SYSTEM
+#include <cstdio>
+
+using namespace csapex;
+
+namespace
+{
+std::int64_t to_ns(const std::chrono::steady_clock::time_point& t)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+}
+
+std::shared_ptr<PythonDeadline> PythonDeadline::create()
+{
+    std::shared_ptr<PythonDeadline> res(new PythonDeadline);
+    PythonWatchdog::instance().add(res);
+    return res;
+}
+
+PythonDeadline::PythonDeadline()
+    : timeout_ms_(0), deadline_ns_(0), call_(0), thread_id_(0), overrun_(false), interrupted_(false),
+      interpreter_(nullptr), closed_(false), users_(0),
+      overruns_(0), interrupts_(0), last_overrun_ms_(0.0), reported_overruns_(0)
+{
+}
+
+void PythonDeadline::setTimeout(std::chrono::milliseconds timeout)
+{
+    timeout_ms_ = timeout.count();
+}
+
+void PythonDeadline::begin()
+{
+    overrun_ = false;
+    interrupted_ = false;
+
+    long timeout = timeout_ms_;
+    if(timeout <= 0) {
+        deadline_ns_ = 0;
+        return;
+    }
+
+    PyThreadState* state = PyThreadState_Get();
+    interpreter_ = state->interp;
+    thread_id_ = state->thread_id;
+    ++call_;
+
+    start_ = std::chrono::steady_clock::now();
+    deadline_ns_ = to_ns(start_ + std::chrono::milliseconds(timeout));
+
+    PythonWatchdog::instance().armed();
+}
+
+PythonDeadline::Outcome PythonDeadline::end()
+{
+    if(deadline_ns_.exchange(0) == 0) {
+        return Outcome::IN_TIME;
+    }
+
+    if(!overrun_) {
+        return Outcome::IN_TIME;
+    }
+
+    std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start_;
+    last_overrun_ms_ = duration.count();
+
+    if(interrupted_) {
+        // the exception may not have been raised before the call returned, it must not leak into the next call
+        PyThreadState_SetAsyncExc(thread_id_, NULL);
+        return Outcome::INTERRUPTED;
+    }
+
+    return Outcome::OVERRUN;
+}
+
+void PythonDeadline::close()
+{
+    std::unique_lock<std::mutex> lock(close_mutex_);
+    closed_ = true;
+
+    // a pending interrupt can take the GIL, since the caller does not hold it
+    released_.wait(lock, [this]() {
+        return users_ == 0;
+    });
+}
+
+bool PythonDeadline::enter()
+{
+    std::unique_lock<std::mutex> lock(close_mutex_);
+    if(closed_ || interpreter_ == nullptr) {
+        return false;
+    }
+    ++users_;
+    return true;
+}
+
+void PythonDeadline::leave()
+{
+    std::unique_lock<std::mutex> lock(close_mutex_);
+    if(--users_ == 0) {
+        released_.notify_all();
+    }
+}
+
+bool PythonDeadline::pollReport(std::string &report)
+{
+    std::size_t overruns = overruns_;
+    if(overruns == reported_overruns_) {
+        return false;
+    }
+    reported_overruns_ = overruns;
+
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer), "%zu overruns, %zu interrupted, last %.1f ms",
+                  overruns, interrupts_.load(), last_overrun_ms_.load());
+    report = buffer;
+    return true;
+}
+
+bool PythonDeadline::expired(std::int64_t now_ns, std::uint64_t& call)
+{
+    call = call_;
+    std::int64_t deadline = deadline_ns_;
+    if(deadline == 0 || now_ns < deadline) {
+        return false;
+    }
+    if(overrun_.exchange(true)) {
+        return false;
+    }
+
+    ++overruns_;
+    return true;
+}
+
+std::int64_t PythonDeadline::expiry() const
+{
+    return overrun_ ? 0 : deadline_ns_.load();
+}
+
+void PythonDeadline::interrupt(std::uint64_t call)
+{
+    // the GIL is taken without holding the mutex, close() waits for this call instead
+    if(!enter()) {
+        return;
+    }
+
+    PyThreadState* state = PyThreadState_New(interpreter_);
+    PyEval_AcquireThread(state);
+
+    // holding the GIL, the watched call cannot end concurrently
+    if(call_ == call && deadline_ns_ != 0) {
+#if PY_MAJOR_VERSION >= 3
+        PyObject* exception = PyExc_TimeoutError;
+#else
+        PyObject* exception = PyExc_RuntimeError;
+#endif
+        if(PyThreadState_SetAsyncExc(thread_id_, exception) > 0) {
+            interrupted_ = true;
+            ++interrupts_;
+        }
+    }
+
+    PyThreadState_Clear(state);
+    PyEval_ReleaseThread(state);
+    PyThreadState_Delete(state);
+
+    leave();
+}
+
+
+PythonWatchdog& PythonWatchdog::instance()
+{
+    static PythonWatchdog watchdog;
+    return watchdog;
+}
+
+PythonWatchdog::PythonWatchdog()
+    : running_(true), arms_(0)
+{
+    thread_ = std::thread([this]() {
+        run();
+    });
+}
+
+PythonWatchdog::~PythonWatchdog()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        running_ = false;
+        changed_.notify_all();
+    }
+    thread_.join();
+}
+
+void PythonWatchdog::add(const std::weak_ptr<PythonDeadline> &deadline)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    deadlines_.push_back(deadline);
+    changed_.notify_all();
+}
+
+void PythonWatchdog::armed()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++arms_;
+    changed_.notify_all();
+}
+
+void PythonWatchdog::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(running_) {
+        // calls started after this point wake the watchdog, even if the scan below misses them
+        const std::uint64_t arms = arms_;
+
+        std::vector<std::shared_ptr<PythonDeadline>> watched;
+        for(auto it = deadlines_.begin(); it != deadlines_.end();) {
+            if(std::shared_ptr<PythonDeadline> deadline = it->lock()) {
+                watched.push_back(deadline);
+                ++it;
+            } else {
+                it = deadlines_.erase(it);
+            }
+        }
+        lock.unlock();
+
+        std::int64_t now = to_ns(std::chrono::steady_clock::now());
+        std::int64_t next = 0;
+        for(const std::shared_ptr<PythonDeadline>& deadline : watched) {
+            std::uint64_t call;
+            if(deadline->expired(now, call)) {
+                deadline->interrupt(call);
+            }
+            std::int64_t expiry = deadline->expiry();
+            if(expiry != 0 && (next == 0 || expiry < next)) {
+                next = expiry;
+            }
+        }
+        watched.clear();
+
+        lock.lock();
+        auto woken = [this, arms]() {
+            return !running_ || arms_ != arms;
+        };
+        if(next == 0) {
+            changed_.wait(lock, woken);
+        } else {
+            std::chrono::steady_clock::time_point until(
+                        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(next)));
+            changed_.wait_until(lock, until, woken);
+        }
+    }
+}
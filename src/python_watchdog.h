@@ -0,0 +1,116 @@
+#ifndef PYTHON_WATCHDOG_H
+#define PYTHON_WATCHDOG_H
+
+/// SYSTEM
+#include <Python.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace csapex
+{
+
+/**
+ * @brief The PythonDeadline bounds the duration of the calls into one interpreter.
+ *        A call that exceeds its deadline is interrupted with a TimeoutError by the
+ *        PythonWatchdog. If the script is stuck in native code, the exception cannot be
+ *        delivered before the call returns, which end() reports as an overrun.
+ */
+class PythonDeadline
+{
+public:
+    enum class Outcome {
+        IN_TIME,
+        OVERRUN,
+        INTERRUPTED
+    };
+
+public:
+    static std::shared_ptr<PythonDeadline> create();
+
+    //! a timeout of 0 disables the deadline
+    void setTimeout(std::chrono::milliseconds timeout);
+
+    //! starts a watched call, requires the GIL
+    void begin();
+    //! ends the current call, requires the GIL
+    Outcome end();
+
+    //! has to be called before the interpreter is ended, without holding the GIL
+    void close();
+
+    bool pollReport(std::string& report);
+
+private:
+    friend class PythonWatchdog;
+
+    PythonDeadline();
+
+    bool expired(std::int64_t now_ns, std::uint64_t& call);
+    //! the time at which the current call expires, 0 if no call is watched
+    std::int64_t expiry() const;
+    void interrupt(std::uint64_t call);
+
+    //! keeps the interpreter from being ended until leave is called, false if it is closed
+    bool enter();
+    void leave();
+
+private:
+    std::atomic<long> timeout_ms_;
+
+    // written by the executing thread while holding the GIL
+    std::atomic<std::int64_t> deadline_ns_;
+    std::atomic<std::uint64_t> call_;
+    std::atomic<unsigned long> thread_id_;
+    std::atomic<bool> overrun_;
+    std::atomic<bool> interrupted_;
+    std::chrono::steady_clock::time_point start_;
+
+    std::atomic<PyInterpreterState*> interpreter_;
+    std::mutex close_mutex_;
+    std::condition_variable released_;
+    bool closed_;
+    int users_;
+
+    std::atomic<std::size_t> overruns_;
+    std::atomic<std::size_t> interrupts_;
+    std::atomic<double> last_overrun_ms_;
+    std::size_t reported_overruns_;
+};
+
+/**
+ * @brief The PythonWatchdog is a single thread that observes all deadlines of the process.
+ *        It sleeps until the earliest armed deadline expires, or until a call is started.
+ */
+class PythonWatchdog
+{
+public:
+    static PythonWatchdog& instance();
+    ~PythonWatchdog();
+
+    void add(const std::weak_ptr<PythonDeadline>& deadline);
+    //! wakes the watchdog, so that it takes a newly started call into account
+    void armed();
+
+private:
+    PythonWatchdog();
+    void run();
+
+private:
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    bool running_;
+    std::uint64_t arms_;
+    std::vector<std::weak_ptr<PythonDeadline>> deadlines_;
+    std::thread thread_;
+};
+
+}
+
+#endif // PYTHON_WATCHDOG_H
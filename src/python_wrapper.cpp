@@ -11,69 +11,48 @@
 #include <csapex/msg/end_of_program_message.h>
 #include <csapex/msg/input.h>
 #include <csapex/msg/output.h>
+#include <csapex/param/parameter_factory.h>
 #include <csapex/signal/event.h>
 #include <csapex/signal/slot.h>
 
 /// SYSTEM
 #include <yaml-cpp/yaml.h>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <chrono>
 
 using namespace csapex;
 namespace bp = boost::python;
 
-namespace
-{
-std::string parse_python_exception(){
-    PyObject *type_ptr = NULL, *value_ptr = NULL, *traceback_ptr = NULL;
-    PyErr_Fetch(&type_ptr, &value_ptr, &traceback_ptr);
-    std::string ret("Unfetchable Python error");
-
-    if(type_ptr != NULL){
-        bp::handle<> h_type(type_ptr);
-        bp::str type_pstr(h_type);
-        bp::extract<std::string> e_type_pstr(type_pstr);
-        if(e_type_pstr.check())
-            ret = e_type_pstr();
-        else
-            ret = "Unknown exception type";
-    }
-
-    if(value_ptr != NULL){
-        bp::handle<> h_val(value_ptr);
-        bp::str a(h_val);
-        bp::extract<std::string> returned(a);
-        if(returned.check())
-            ret +=  ": " + returned();
-        else
-            ret += std::string(": Unparseable Python error: ");
-    }
-
-    if(traceback_ptr != NULL){
-        bp::handle<> h_tb(traceback_ptr);
-        bp::object tb(bp::import("traceback"));
-        bp::object fmt_tb(tb.attr("format_tb"));
-        bp::object tb_list(fmt_tb(h_tb));
-        bp::object tb_str(bp::str("\n").join(tb_list));
-        bp::extract<std::string> returned(tb_str);
-        if(returned.check())
-            ret += ": " + returned();
-        else
-            ret += std::string(": Unparseable Python traceback");
-    }
-    return ret;
-}
-}
-
 PythonWrapper::PythonWrapper()
-    : is_setup_(false), python_is_initialized_(false)
+    : is_setup_(false), python_is_initialized_(false),
+      controls_(this, &thread_states_, &error_handler_), script_parameters_(this), has_pending_code_(false)
 {
+    controls_.gcPolicy().setErrorReport([this]() {
+        reportError();
+    });
+    // cached results were computed with the old parameter values
+    script_parameters_.setChangeCallback([this]() {
+        controls_.resultCache().clear();
+    });
 }
 
 PythonWrapper::~PythonWrapper()
 {
-    PyEval_AcquireThread(thread_state);
+    // requests queued on the execution thread must not run after this point
+    requests_.close();
+
+    controls_.deadline().close();
+
+    thread_states_.acquire();
+
+    error_handler_.release();
+    controls_.release();
+    script_parameters_.release();
+    pending_code_ = bp::object();
 
-    Py_EndInterpreter(thread_state);
+    thread_states_.end();
 
     PyEval_ReleaseLock();
 }
@@ -86,23 +65,25 @@ std::string PythonWrapper::getCode() const
 
 void PythonWrapper::setCode(const std::string &code)
 {
+    PythonMemoryArena::Scope memory_scope(controls_.memoryBudget().getArena());
+
     code_ = code;
 
     static bool init = false;
     if(!init) {
         init = true;
+        PythonMemoryArena::installAllocator();
         Py_Initialize();
         PyEval_InitThreads();
     }
 
     if(!python_is_initialized_) {
-        thread_state = nullptr;
         PyThreadState *current_state = PyThreadState_Swap(nullptr);
         if (current_state == nullptr) {
             PyEval_AcquireLock();
         }
 
-        thread_state = Py_NewInterpreter();
+        thread_states_.adopt(Py_NewInterpreter());
 
         bp::object main = bp::import("__main__");
         globals = main.attr("__dict__");
@@ -110,53 +91,155 @@ void PythonWrapper::setCode(const std::string &code)
         try {
             globals["csapex"] = bp::import("csapex");
         }catch(boost::python::error_already_set const &){
-            std::string perror_str = parse_python_exception();
+            std::string perror_str = error_handler_.describe();
             std::cout << "Error in Python: " << perror_str << std::endl;
         }
 
         python_is_initialized_ = true;
 
     } else {
-        PyEval_AcquireThread(thread_state);
+        thread_states_.acquire();
     }
 
-    PyEval_ReleaseThread(thread_state);
+    thread_states_.release();
 }
 
-void PythonWrapper::setupIO()
+std::function<bool()> PythonWrapper::reloadRequest(const std::string &file)
 {
-    if(!is_setup_) {
-        PyEval_AcquireThread(thread_state);
-
+    // the watcher only queues the request, so the node is never touched on the watcher thread
+    return requests_.wrap([this, file]() {
         if(node_handle_) {
-            try {
-                bp::list inputs;
-                for(const InputPtr& i : node_modifier_->getMessageInputs()) {
-                    if(!node_handle_->isParameterInput(i->getUUID())) {
-                        inputs.append(bp::pointer_wrapper<Input*>(i.get()));
-                    }
-                }
-                globals["inputs"] = inputs;
+            node_handle_->execution_requested(requests_.wrap([this, file]() {
+                reloadFile(file);
+            }));
+        }
+    });
+}
 
-                bp::list outputs;
-                for(const OutputPtr& o : node_modifier_->getMessageOutputs()) {
-                    if(!node_handle_->isParameterOutput(o->getUUID())) {
-                        outputs.append(bp::pointer_wrapper<Output*>(o.get()));
-                    }
-                }
-                globals["outputs"] = outputs;
+void PythonWrapper::reloadFile(const std::string &file)
+{
+    std::ifstream in(file.c_str());
+    std::stringstream sstr;
+    sstr << in.rdbuf();
+    std::string code = sstr.str();
 
-                bp::list slot;
-                for(const SlotPtr& i : node_modifier_->getSlots()) {
-                    slot.append(bp::pointer_wrapper<Slot*>(i.get()));
-                }
-                globals["slots"] = slot;
+    if(!python_is_initialized_ || code.empty() || code == code_) {
+        return;
+    }
+
+    thread_states_.acquire();
+
+    PyObject* compiled = Py_CompileString(code.c_str(), "<script>", Py_file_input);
+    if(compiled == NULL) {
+        std::string perror_str = error_handler_.describe();
+        std::cout << "Error in reloaded Python script: " << perror_str << std::endl;
+
+    } else {
+        std::unique_lock<std::mutex> lock(pending_mutex_);
+        pending_code_ = bp::object(bp::handle<>(compiled));
+        pending_source_ = code;
+        has_pending_code_ = true;
+    }
+
+    thread_states_.release();
 
-                bp::list events;
-                for(const EventPtr& o : node_modifier_->getEvents()) {
-                    events.append(bp::pointer_wrapper<Event*>(o.get()));
+    installPendingCode();
+}
+
+void PythonWrapper::installPendingCode()
+{
+    if(!has_pending_code_) {
+        return;
+    }
+
+    PythonMemoryArena::Scope memory_scope(controls_.memoryBudget().getArena());
+    PythonSignals::Scope signals_scope(&controls_.signals());
+    PythonParameters::Scope parameters_scope(&script_parameters_);
+
+    thread_states_.acquire();
+
+    {
+        bp::object code;
+        std::string source;
+        {
+            std::unique_lock<std::mutex> lock(pending_mutex_);
+            code = pending_code_;
+            source = pending_source_;
+            pending_code_ = bp::object();
+            has_pending_code_ = false;
+        }
+
+        // the module is replaced in place, so that __main__ and the functions of the new code share one dict
+        bp::dict main_dict = bp::extract<bp::dict>(globals);
+        bp::dict previous = main_dict.copy();
+
+        try {
+            // the warm state of the old module is handed over to the new one
+            bp::object state;
+            bool has_state = PyDict_GetItemString(previous.ptr(), "__getstate__") != NULL;
+            if(has_state) {
+                state = previous["__getstate__"]();
+            }
+
+            main_dict.clear();
+            for(const char* name : {"__builtins__", "__name__", "csapex", "inputs", "outputs", "slots", "events"}) {
+                PyObject* value = PyDict_GetItemString(previous.ptr(), name);
+                if(value != NULL) {
+                    main_dict[name] = bp::object(bp::handle<>(bp::borrowed(value)));
                 }
-                globals["events"] = events;
+            }
+
+#if PY_MAJOR_VERSION >= 3
+            PyObject* res = PyEval_EvalCode(code.ptr(), main_dict.ptr(), main_dict.ptr());
+#else
+            PyObject* res = PyEval_EvalCode(reinterpret_cast<PyCodeObject*>(code.ptr()), main_dict.ptr(), main_dict.ptr());
+#endif
+            if(res == NULL) {
+                bp::throw_error_already_set();
+            }
+            Py_DECREF(res);
+
+            if(has_state && PyDict_GetItemString(main_dict.ptr(), "__setstate__") != NULL) {
+                main_dict["__setstate__"](state);
+            }
+
+            // ports and slots are looked up by their label, so setup may add them again
+            if(PyDict_GetItemString(main_dict.ptr(), "setup") != NULL && node_modifier_) {
+                main_dict["setup"](bp::pointer_wrapper<NodeModifier*>(node_modifier_));
+                updatePorts();
+            }
+
+            code_ = source;
+            controls_.resultCache().clear();
+            history_.clear();
+
+            // handlers that setup did not register again still refer to the functions of the old module
+            controls_.signals().rebind(globals);
+
+            flush();
+
+        } catch( bp::error_already_set ) {
+            std::string perror_str = error_handler_.describe();
+            std::cout << "Error in reloaded Python script, keeping the old version: " << perror_str << std::endl;
+
+            main_dict.clear();
+            main_dict.update(previous);
+        }
+    }
+
+    thread_states_.release();
+}
+
+void PythonWrapper::setupIO()
+{
+    if(!is_setup_) {
+        PythonMemoryArena::Scope memory_scope(controls_.memoryBudget().getArena());
+
+        thread_states_.acquire();
+
+        if(node_handle_) {
+            try {
+                updatePorts();
 
                 bp::exec(code_.c_str(), globals, globals);
 
@@ -165,27 +248,76 @@ void PythonWrapper::setupIO()
                 is_setup_ = true;
 
             } catch( bp::error_already_set ) {
-                PyErr_Print();
+                reportError();
             }
         }
 
-        PyEval_ReleaseThread(thread_state);
+        thread_states_.release();
+    }
+}
+
+void PythonWrapper::updatePorts()
+{
+    controls_.resultCache().clear();
+    message_inputs_.clear();
+
+    bp::list inputs;
+    for(const InputPtr& i : node_modifier_->getMessageInputs()) {
+        if(!node_handle_->isParameterInput(i->getUUID())) {
+            inputs.append(bp::pointer_wrapper<Input*>(i.get()));
+            message_inputs_.push_back(i);
+        }
+    }
+    globals["inputs"] = inputs;
+    history_.prune(message_inputs_);
+
+    bp::list outputs;
+    for(const OutputPtr& o : node_modifier_->getMessageOutputs()) {
+        if(!node_handle_->isParameterOutput(o->getUUID())) {
+            outputs.append(bp::pointer_wrapper<Output*>(o.get()));
+        }
+    }
+    globals["outputs"] = outputs;
+
+    bp::list slot;
+    for(const SlotPtr& i : node_modifier_->getSlots()) {
+        slot.append(bp::pointer_wrapper<Slot*>(i.get()));
+    }
+    globals["slots"] = slot;
+
+    bp::list events;
+    for(const EventPtr& o : node_modifier_->getEvents()) {
+        events.append(bp::pointer_wrapper<Event*>(o.get()));
     }
+    globals["events"] = events;
 }
 
 void PythonWrapper::setup(NodeModifier& node_modifier)
 {
     setupIO();
+    controls_.setNodeModifier(&node_modifier);
+
+    controls_.signals().setDispatchRequest([this]() {
+        node_handle_->execution_requested(requests_.wrap([this]() {
+            dispatchSignals();
+        }));
+    });
 
     if(exists("setup")) {
         call("setup", &node_modifier);
 
         is_setup_ = false;
     }
+
+    thread_states_.acquire();
+    controls_.gcPolicy().afterSetup();
+    thread_states_.release();
 }
 
 void PythonWrapper::setupParameters(Parameterizable &parameters)
 {
+    controls_.setNodeModifier(node_modifier_);
+    controls_.setupParameters(parameters);
 }
 
 bool PythonWrapper::canProcess() const
@@ -193,68 +325,170 @@ bool PythonWrapper::canProcess() const
     return is_setup_;
 }
 
+bool PythonWrapper::reportError()
+{
+    std::string report;
+    if(error_handler_.handle(report)) {
+        std::cerr << "Error in Python: " << report << std::endl;
+        return true;
+    }
+    return false;
+}
+
 void PythonWrapper::flush()
 {
     bp::exec("import sys\n"
              "sys.stdout.flush()\n", globals, globals);
 }
 
-void PythonWrapper::call(const std::string& method, NodeModifier* modifier)
+bool PythonWrapper::call(const std::string& method, NodeModifier* modifier)
 {
-    PyEval_AcquireThread(thread_state);
+    PythonMemoryArena::Scope memory_scope(controls_.memoryBudget().getArena());
+    PythonHistory::Scope history_scope(&history_);
+    PythonSignals::Scope signals_scope(&controls_.signals());
+    PythonParameters::Scope parameters_scope(&script_parameters_);
 
-    try {
-        if(modifier) {
-            globals[method](bp::pointer_wrapper<NodeModifier*>(modifier));
-        } else {
-            globals[method]();
-        }
+    thread_states_.acquire();
 
-        flush();
+    bool success = false;
+    {
+        // the settings apply once the GIL is held, so that waiting for it is not affected by them
+        PythonSchedulingPolicy::Scope scheduling_scope(&controls_.schedulingPolicy());
+        try {
+            controls_.gcPolicy().beforeCall();
+            script_parameters_.notify(globals);
+
+            if(modifier) {
+                globals[method](bp::pointer_wrapper<NodeModifier*>(modifier));
+            } else {
+                controls_.deadline().begin();
+                globals[method]();
+                controls_.finishDeadline(controls_.deadline().end());
+            }
 
-        std::cout << std::flush;
-        std::cerr << std::flush;
-        std::clog << std::flush;
+            if(method == "process") {
+                controls_.gcPolicy().afterProcess();
+            }
 
-    } catch( bp::error_already_set ) {
-        PyErr_Print();
+            flush();
+
+            std::cout << std::flush;
+            std::cerr << std::flush;
+            std::clog << std::flush;
+
+            success = true;
+
+        } catch( bp::error_already_set ) {
+            if(controls_.finishDeadline(controls_.deadline().end())) {
+                // interrupted by the watchdog, the rest of the call is skipped,
+                // messages published before the interrupt are still sent
+                PyErr_Clear();
+            } else {
+                reportError();
+            }
+        }
     }
 
-    PyEval_ReleaseThread(thread_state);
+    thread_states_.release();
+
+    controls_.signals().flushEvents();
+
+    controls_.updateStatistics();
+
+    return success;
 }
 
 bool PythonWrapper::exists(const std::string &method)
 {
-    PyEval_AcquireThread(thread_state);
+    thread_states_.acquire();
 
     bool res = false;
     try {
         res = is_setup_ && globals.contains(method) != bp::object();
     } catch( bp::error_already_set ) {
-        PyErr_Print();
+        reportError();
     }
 
-    PyEval_ReleaseThread(thread_state);
+    thread_states_.release();
 
     return res;
 }
 
+void PythonWrapper::dispatchSignals()
+{
+    if(!controls_.signals().hasPending()) {
+        return;
+    }
+
+    PythonMemoryArena::Scope memory_scope(controls_.memoryBudget().getArena());
+    PythonSignals::Scope signals_scope(&controls_.signals());
+
+    thread_states_.acquire();
+    {
+        PythonSchedulingPolicy::Scope scheduling_scope(&controls_.schedulingPolicy());
+        try {
+            controls_.signals().dispatch([this]() {
+                reportError();
+            });
+            flush();
+
+        } catch( bp::error_already_set ) {
+            reportError();
+        }
+    }
+
+    thread_states_.release();
+
+    controls_.signals().flushEvents();
+    controls_.updateStatistics();
+}
+
 void PythonWrapper::process()
 {
     setupIO();
+    installPendingCode();
+    dispatchSignals();
+
+    if(controls_.frameDropPolicy().shouldDrop(message_inputs_)) {
+        controls_.updateStatistics();
+        return;
+    }
 
+    if(!controls_.admitFrame()) {
+        return;
+    }
+
+    // identical inputs are answered from the cache without entering the interpreter
+    std::uint64_t cache_key = 0;
+    std::uint64_t cache_stamp = 0;
+    bool cacheable = controls_.resultCache().isEnabled() && controls_.resultCache().hash(message_inputs_, cache_key, cache_stamp);
+    if(cacheable && controls_.resultCache().replay(cache_key, cache_stamp)) {
+        controls_.updateStatistics();
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
     if(exists("process")) {
-        call("process", nullptr);
+        PythonResultCache::Recording recording(cacheable);
+        if(call("process", nullptr) && cacheable) {
+            controls_.resultCache().store(cache_key, cache_stamp, recording.getOutputs());
+        }
     }
+    controls_.frameDropPolicy().processed(std::chrono::steady_clock::now() - start);
+
+    controls_.updateStatistics();
 }
 
 
 void PythonWrapper::processMarker(const connection_types::MessageConstPtr &marker)
 {
+    installPendingCode();
+
     if(std::dynamic_pointer_cast<connection_types::NoMessage const>(marker)) {
         if(exists("processNoMessage")) {
             call("processNoMessage", nullptr);
         }
+        controls_.collectDeferredGarbage();
 
     } else if(std::dynamic_pointer_cast<connection_types::EndOfProgramMessage const>(marker)) {
         if(exists("processEndOfProgram")) {
@@ -265,6 +499,7 @@ void PythonWrapper::processMarker(const connection_types::MessageConstPtr &marke
         if(exists("processEndOfSequence")) {
             call("processEndOfSequence", nullptr);
         }
+        controls_.collectDeferredGarbage();
     }
 }
 
@@ -5,8 +5,19 @@
 #include <csapex/model/node.h>
 #include <csapex/model/variadic_io.h>
 
+/// COMPONENT
+#include "python_error_handler.h"
+#include "python_history.h"
+#include "python_parameters.h"
+#include "python_request_guard.h"
+#include "python_runtime_controls.h"
+#include "python_thread_states.h"
+
 /// SYSTEM
 #include <boost/python.hpp>
+#include <atomic>
+#include <functional>
+#include <mutex>
 
 namespace csapex
 {
@@ -20,6 +31,12 @@ public:
     std::string getCode() const;
     void setCode(const std::string& code);
 
+    /**
+     * @brief reloadRequest returns a listener for the script watcher, the file is
+     *        read again and installed on the execution thread of the node
+     */
+    std::function<bool()> reloadRequest(const std::string& file);
+
     virtual void setup(csapex::NodeModifier& node_modifier) override;
     virtual void setupParameters(Parameterizable &parameters) override;
 
@@ -30,19 +47,39 @@ public:
 
 
 private:
+    bool reportError();
+
+    void dispatchSignals();
+
     void flush();
     bool exists(const std::string& method);
-    void call(const std::string& method, NodeModifier *modifier);
+    bool call(const std::string& method, NodeModifier *modifier);
     void setupIO();
+    void updatePorts();
+    void reloadFile(const std::string& file);
+    void installPendingCode();
 
 private:
     std::string code_;
     bool is_setup_;
     bool python_is_initialized_;
 
-    PyThreadState* thread_state;
+    PythonThreadStates thread_states_;
     boost::python::object globals;
     boost::python::dict locals;
+
+    PythonErrorHandler error_handler_;
+    PythonRuntimeControls controls_;
+    PythonParameters script_parameters_;
+    std::vector<InputPtr> message_inputs_;
+    PythonHistory history_;
+
+    std::mutex pending_mutex_;
+    std::atomic<bool> has_pending_code_;
+    std::string pending_source_;
+    boost::python::object pending_code_;
+
+    PythonRequestGuard requests_;
 };
 
 }
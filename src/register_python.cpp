@@ -9,6 +9,7 @@
 #include <csapex/model/node_constructor.h>
 #include <csapex/factory/node_factory_impl.h>
 #include "python_wrapper.h"
+#include "python_script_watcher.h"
 
 /// SYSTEM
 #include <fstream>
@@ -40,7 +41,10 @@ public:
     {
         CsApexCore* core_ptr = &core;
 
-        core.getNodeFactory()->manifest_loaded.connect([this, core_ptr](const std::string& manifest_file, const TiXmlElement* root) {
+        watcher_ = std::make_shared<PythonScriptWatcher>();
+        std::shared_ptr<PythonScriptWatcher> watcher = watcher_;
+
+        core.getNodeFactory()->manifest_loaded.connect([this, core_ptr, watcher](const std::string& manifest_file, const TiXmlElement* root) {
 
             const TiXmlElement* library = root;
             if (library->ValueStr() != "library") {
@@ -72,13 +76,17 @@ public:
                         std::string icon = readString(python_element, "icon");
                         std::string tags = readString(python_element, "tags") + ", Python";
 
-                        NodeConstructor::Ptr constructor = std::make_shared<NodeConstructor>(file_name, [file](){
+                        watcher->watch(file.string());
+
+                        NodeConstructor::Ptr constructor = std::make_shared<NodeConstructor>(file_name, [file, watcher](){
                             std::shared_ptr<PythonWrapper> res = std::make_shared<PythonWrapper>();
 
                             std::ifstream in(file.string().c_str());
                             std::stringstream sstr;
                             sstr << in.rdbuf();
                             res->setCode(sstr.str());
+
+                            watcher->track(file.string(), res->reloadRequest(file.string()));
                             return res;
                         });
                         constructor->setDescription(description);
@@ -111,8 +119,13 @@ public:
 
     void shutdown()
     {
-
+        if(watcher_) {
+            watcher_->stop();
+        }
     }
+
+private:
+    std::shared_ptr<PythonScriptWatcher> watcher_;
 };
 
 }